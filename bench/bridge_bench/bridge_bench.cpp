@@ -0,0 +1,793 @@
+// End-to-end loopback benchmark of the bridge forwarding path. Bridges run in-process on their
+// own event loops, exactly as tcp_bridge_app runs them, in front of echo devices listening on
+// 127.0.0.2 and up. Closed-loop clients send a message, wait for the whole echo, and go again;
+// each run of the matrix (message size x client count) reports payload throughput, messages per
+// second and round-trip percentiles. Results go to stdout (or --out) as JSON. A cell whose round
+// trips are slow while the process sits idle is marked stalled: that is a timer, such as Nagle
+// waiting on a delayed ACK, not forwarding cost.
+//
+// A plain bridge hands device data to whichever client spoke last, so every client gets a
+// bridge of its own; N clients means N bridges, N device links and N listening ports.
+#include "metrics.h"
+#include "tcp_bridge.h"
+#include "trace_clock.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kDevices = 8;                 // echo listeners on 127.0.0.2 .. 127.0.0.9
+constexpr size_t kEchoBacklog = 256 * 1024; // a device stops reading with this much unsent
+constexpr size_t kScratch = 256 * 1024;
+
+// A cell whose median round trip is at least this long while the whole process used under
+// kStallCpu of one CPU was waiting on a timer (Nagle's delayed-ACK wait is 40 ms), not working
+constexpr uint64_t kStallNanos = 10 * 1000 * 1000;
+constexpr double kStallCpu = 0.5;
+
+struct Options
+{
+    std::vector<size_t> sizes = {16, 256, 4096, 65536, 1024 * 1024};
+    std::vector<size_t> clientCounts = {1, 10, 100, 1000, 10000};
+    int durationMs = 1000;
+    int portBase = 20000; // bridges listen on portBase + i, devices on portBase - 1
+    unsigned workers = 0;
+    unsigned drivers = 0;
+    bool spliceForward = false;
+    bool ioUring = false;
+    std::string outPath;
+};
+
+uint64_t nowNanos()
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+std::vector<size_t> parseList(const char* text)
+{
+    std::vector<size_t> values;
+    const char* p = text;
+    while (*p)
+    {
+        char* end = nullptr;
+        const unsigned long long value = std::strtoull(p, &end, 10);
+        if (end == p)
+        {
+            break;
+        }
+        values.push_back(static_cast<size_t>(value));
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+std::string deviceIp(size_t index)
+{
+    return "127.0.0." + std::to_string(2 + index % kDevices);
+}
+
+void setNonBlocking(int fd)
+{
+    SetSocketNonBlocking(fd, true);
+}
+
+// Echo devices: every listener and device connection on one epoll thread, level-triggered.
+// A connection stops being read while kEchoBacklog bytes wait to be written back.
+class EchoDevices
+{
+public:
+    bool start(int port)
+    {
+        epoll = epoll_create1(0);
+        for (int i = 0; i < kDevices; ++i)
+        {
+            int s = socket(AF_INET, SOCK_STREAM, 0);
+            int one = 1;
+            setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<uint16_t>(port));
+            inet_pton(AF_INET, deviceIp(static_cast<size_t>(i)).c_str(), &addr.sin_addr);
+            if (bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(s, 4096) < 0)
+            {
+                std::perror("device listen");
+                return false;
+            }
+            setNonBlocking(s);
+            listeners.push_back(s);
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = kListenerTag | static_cast<uint64_t>(s);
+            epoll_ctl(epoll, EPOLL_CTL_ADD, s, &ev);
+        }
+        thread = std::thread([this] { run(); });
+        return true;
+    }
+
+    void stop()
+    {
+        running = false;
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+private:
+    static constexpr uint64_t kListenerTag = uint64_t(1) << 63;
+
+    struct Conn
+    {
+        int fd = -1;
+        std::vector<uint8_t> pending;
+        size_t head = 0;
+        uint32_t mask = 0;
+    };
+
+    int epoll = -1;
+    std::vector<int> listeners;
+    std::vector<std::unique_ptr<Conn>> conns; // indexed by fd
+    std::atomic<bool> running{true};
+    std::thread thread;
+
+    void setMask(Conn& conn, uint32_t mask)
+    {
+        if (conn.mask != mask)
+        {
+            epoll_event ev{};
+            ev.events = mask;
+            ev.data.u64 = static_cast<uint64_t>(conn.fd);
+            epoll_ctl(epoll, EPOLL_CTL_MOD, conn.fd, &ev);
+            conn.mask = mask;
+        }
+    }
+
+    void accept(int listener)
+    {
+        int fd = -1;
+        while ((fd = ::accept(listener, nullptr, nullptr)) >= 0)
+        {
+            setNonBlocking(fd);
+            if (conns.size() <= static_cast<size_t>(fd))
+            {
+                conns.resize(static_cast<size_t>(fd) + 1);
+            }
+            auto conn = std::make_unique<Conn>();
+            conn->fd = fd;
+            conn->mask = EPOLLIN;
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = static_cast<uint64_t>(fd);
+            epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &ev);
+            conns[static_cast<size_t>(fd)] = std::move(conn);
+        }
+    }
+
+    void close(Conn& conn)
+    {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, conn.fd, nullptr);
+        ::close(conn.fd);
+        conns[static_cast<size_t>(conn.fd)].reset();
+    }
+
+    void serve(Conn& conn, uint32_t events, uint8_t* scratch)
+    {
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        {
+            const size_t queued = conn.pending.size() - conn.head;
+            if (queued < kEchoBacklog)
+            {
+                const ssize_t n = recv(conn.fd, scratch, std::min(kScratch, kEchoBacklog - queued), 0);
+                if (n == 0 || (n < 0 && errno != EAGAIN))
+                {
+                    close(conn);
+                    return;
+                }
+                if (n > 0)
+                {
+                    conn.pending.insert(conn.pending.end(), scratch, scratch + n);
+                }
+            }
+        }
+        while (conn.head < conn.pending.size())
+        {
+            const ssize_t n = send(conn.fd, conn.pending.data() + conn.head, conn.pending.size() - conn.head,
+                                   MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                if (n < 0 && errno != EAGAIN)
+                {
+                    close(conn);
+                    return;
+                }
+                break;
+            }
+            conn.head += static_cast<size_t>(n);
+        }
+        if (conn.head == conn.pending.size())
+        {
+            conn.pending.clear();
+            conn.head = 0;
+        }
+        else if (conn.head > kEchoBacklog)
+        {
+            conn.pending.erase(conn.pending.begin(), conn.pending.begin() + static_cast<std::ptrdiff_t>(conn.head));
+            conn.head = 0;
+        }
+        const size_t queued = conn.pending.size() - conn.head;
+        setMask(conn, (queued < kEchoBacklog ? EPOLLIN : 0u) | (queued > 0 ? EPOLLOUT : 0u));
+    }
+
+    void run()
+    {
+        std::vector<uint8_t> scratch(kScratch);
+        epoll_event events[256];
+        while (running)
+        {
+            const int n = epoll_wait(epoll, events, 256, 20);
+            for (int i = 0; i < n; ++i)
+            {
+                const uint64_t tag = events[i].data.u64;
+                if (tag & kListenerTag)
+                {
+                    accept(static_cast<int>(tag & ~kListenerTag));
+                    continue;
+                }
+                const size_t fd = static_cast<size_t>(tag);
+                if (fd < conns.size() && conns[fd])
+                {
+                    serve(*conns[fd], events[i].events, scratch.data());
+                }
+            }
+        }
+    }
+};
+
+// Closed-loop clients on one epoll thread: send a message, read its whole echo, repeat until
+// the deadline, then finish the message in flight.
+class Driver
+{
+public:
+    struct Client
+    {
+        int fd = -1;
+        size_t sent = 0;
+        size_t received = 0;
+        uint64_t startNanos = 0;
+        bool wantWrite = false;
+        bool done = false;
+    };
+
+    Driver(std::vector<int> fds, const std::vector<uint8_t>& payload, size_t size)
+        : payload(payload), size(size)
+    {
+        for (int fd : fds)
+        {
+            Client client;
+            client.fd = fd;
+            clients.push_back(client);
+        }
+        histogram = std::make_unique<LatencyHistogram>();
+    }
+
+    void run(uint64_t deadlineNanos)
+    {
+        epoll = epoll_create1(0);
+        for (size_t i = 0; i < clients.size(); ++i)
+        {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = i;
+            epoll_ctl(epoll, EPOLL_CTL_ADD, clients[i].fd, &ev);
+        }
+        for (Client& client : clients)
+        {
+            begin(client);
+        }
+        std::vector<uint8_t> scratch(kScratch);
+        epoll_event events[256];
+        size_t active = clients.size();
+        // Give stragglers a few seconds past the deadline before calling them failed
+        const uint64_t giveUp = deadlineNanos + 5000000000ull;
+        while (active > 0 && nowNanos() < giveUp)
+        {
+            const int n = epoll_wait(epoll, events, 256, 20);
+            for (int i = 0; i < n; ++i)
+            {
+                Client& client = clients[events[i].data.u64];
+                if (client.done)
+                {
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT)
+                {
+                    pushOut(client);
+                }
+                if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                {
+                    continue;
+                }
+                while (true)
+                {
+                    const ssize_t got = recv(client.fd, scratch.data(), scratch.size(), 0);
+                    if (got > 0)
+                    {
+                        client.received += static_cast<size_t>(got);
+                        continue;
+                    }
+                    if (got == 0 || errno != EAGAIN)
+                    {
+                        ++errors;
+                        finish(client, active);
+                    }
+                    break;
+                }
+                if (client.done || client.received < size)
+                {
+                    continue;
+                }
+                const uint64_t now = nowNanos();
+                histogram->record(now - client.startNanos);
+                ++messages;
+                if (now >= deadlineNanos)
+                {
+                    finish(client, active);
+                    continue;
+                }
+                begin(client);
+            }
+        }
+        errors += active; // never completed
+        ::close(epoll);
+    }
+
+    uint64_t messages = 0;
+    uint64_t errors = 0;
+    std::unique_ptr<LatencyHistogram> histogram; // round trips, nanoseconds
+
+private:
+    const std::vector<uint8_t>& payload;
+    size_t size;
+    std::vector<Client> clients;
+    int epoll = -1;
+
+    void begin(Client& client)
+    {
+        client.sent = 0;
+        client.received = 0;
+        client.startNanos = nowNanos();
+        pushOut(client);
+    }
+
+    void pushOut(Client& client)
+    {
+        while (client.sent < size)
+        {
+            const size_t chunk = std::min(size - client.sent, payload.size());
+            const ssize_t n = send(client.fd, payload.data(), chunk, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                break;
+            }
+            client.sent += static_cast<size_t>(n);
+        }
+        const bool want = client.sent < size;
+        if (want != client.wantWrite)
+        {
+            epoll_event ev{};
+            ev.events = EPOLLIN | (want ? EPOLLOUT : 0u);
+            ev.data.u64 = static_cast<uint64_t>(&client - clients.data());
+            epoll_ctl(epoll, EPOLL_CTL_MOD, client.fd, &ev);
+            client.wantWrite = want;
+        }
+    }
+
+    void finish(Client& client, size_t& active)
+    {
+        client.done = true;
+        --active;
+    }
+};
+
+struct Result
+{
+    size_t clients = 0;
+    size_t messageBytes = 0;
+    uint64_t messages = 0;
+    uint64_t errors = 0;
+    double seconds = 0;
+    double cpuSeconds = 0; // user + system time of the whole process over the run
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0;
+
+    bool stalled() const { return p50 >= kStallNanos && cpuSeconds < kStallCpu * seconds; }
+};
+
+double cpuSeconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+uint64_t quantile(const std::vector<uint64_t>& buckets, uint64_t total, double q)
+{
+    if (total == 0)
+    {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(total) + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return LatencyHistogram::bucketUpperBound(i);
+        }
+    }
+    return 0;
+}
+
+int connectTo(int port)
+{
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        ::close(s);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setNonBlocking(s);
+    return s;
+}
+
+bool waitForClients(const std::vector<std::unique_ptr<TcpBridgeInstance>>& bridges, size_t count, int64_t expected)
+{
+    const auto until = Clock::now() + std::chrono::seconds(10);
+    while (Clock::now() < until)
+    {
+        bool settled = true;
+        for (size_t i = 0; i < count && settled; ++i)
+        {
+            settled = bridges[i]->getMetrics().clientsActive.load() == expected;
+        }
+        if (settled)
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+}
+
+Result runScenario(const Options& options, const std::vector<std::unique_ptr<TcpBridgeInstance>>& bridges,
+                   const std::vector<uint8_t>& payload, size_t clientCount, size_t size)
+{
+    Result result;
+    result.clients = clientCount;
+    result.messageBytes = size;
+
+    std::vector<int> fds;
+    for (size_t i = 0; i < clientCount; ++i)
+    {
+        const int fd = connectTo(options.portBase + static_cast<int>(i));
+        if (fd < 0)
+        {
+            ++result.errors;
+            continue;
+        }
+        fds.push_back(fd);
+    }
+    // The bridge must have taken each client before its first message can be routed back
+    waitForClients(bridges, clientCount, 1);
+
+    const size_t driverCount = std::max<size_t>(1, std::min<size_t>(options.drivers, fds.size()));
+    std::vector<std::unique_ptr<Driver>> drivers;
+    for (size_t d = 0; d < driverCount; ++d)
+    {
+        std::vector<int> share;
+        for (size_t i = d; i < fds.size(); i += driverCount)
+        {
+            share.push_back(fds[i]);
+        }
+        drivers.push_back(std::make_unique<Driver>(std::move(share), payload, size));
+    }
+
+    const double cpuStart = cpuSeconds();
+    const uint64_t start = nowNanos();
+    const uint64_t deadline = start + static_cast<uint64_t>(options.durationMs) * 1000000ull;
+    std::vector<std::thread> threads;
+    for (auto& driver : drivers)
+    {
+        threads.emplace_back([&driver, deadline] { driver->run(deadline); });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    result.seconds = static_cast<double>(nowNanos() - start) / 1e9;
+    result.cpuSeconds = cpuSeconds() - cpuStart;
+
+    std::vector<uint64_t> buckets(LatencyHistogram::kBuckets, 0);
+    uint64_t total = 0;
+    for (const auto& driver : drivers)
+    {
+        result.messages += driver->messages;
+        result.errors += driver->errors;
+        result.max = std::max(result.max, driver->histogram->max());
+        total += driver->histogram->count();
+        for (size_t i = 0; i < buckets.size(); ++i)
+        {
+            buckets[i] += driver->histogram->bucket(i);
+        }
+    }
+    // Bucket bounds overshoot by up to 1/16; the true maximum caps them
+    result.p50 = std::min(quantile(buckets, total, 0.50), result.max);
+    result.p99 = std::min(quantile(buckets, total, 0.99), result.max);
+    result.p999 = std::min(quantile(buckets, total, 0.999), result.max);
+
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    waitForClients(bridges, clientCount, 0);
+    return result;
+}
+
+size_t raiseFdLimit()
+{
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    return static_cast<size_t>(limit.rlim_cur);
+}
+
+std::string micros(uint64_t nanos)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", static_cast<double>(nanos) / 1e3);
+    return text;
+}
+
+std::string toJson(const Options& options, const std::vector<Result>& results, const std::vector<std::string>& skipped,
+                   unsigned workers)
+{
+    char line[512];
+    std::string out = "{\n  \"bench\": \"bridge_bench\",\n  \"version\": 1,\n";
+    std::snprintf(line, sizeof(line),
+                  "  \"config\": {\"mode\": \"%s\", \"workers\": %u, \"duration_ms\": %d, \"cpus\": %u, "
+                  "\"timestamp\": %lld},\n",
+                  options.ioUring ? "io_uring" : options.spliceForward ? "splice" : "copy", workers, options.durationMs,
+                  std::thread::hardware_concurrency(), static_cast<long long>(std::time(nullptr)));
+    out += line;
+    out += "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        const double bytes = static_cast<double>(r.messages) * static_cast<double>(r.messageBytes);
+        std::snprintf(line, sizeof(line),
+                      "%s\n    {\"clients\": %zu, \"message_bytes\": %zu, \"messages\": %llu, \"errors\": %llu, "
+                      "\"seconds\": %.3f, \"cpu_seconds\": %.3f, \"stalled\": %s, \"mb_per_s\": %.2f, "
+                      "\"msgs_per_s\": %.1f, \"rtt_us\": {\"p50\": %s, \"p99\": %s, \"p999\": %s, \"max\": %s}}",
+                      i ? "," : "", r.clients, r.messageBytes, static_cast<unsigned long long>(r.messages),
+                      static_cast<unsigned long long>(r.errors), r.seconds, r.cpuSeconds,
+                      r.stalled() ? "true" : "false", r.seconds > 0 ? bytes / r.seconds / 1e6 : 0.0,
+                      r.seconds > 0 ? static_cast<double>(r.messages) / r.seconds : 0.0, micros(r.p50).c_str(),
+                      micros(r.p99).c_str(), micros(r.p999).c_str(), micros(r.max).c_str());
+        out += line;
+    }
+    out += results.empty() ? "],\n" : "\n  ],\n";
+    out += "  \"skipped\": [";
+    for (size_t i = 0; i < skipped.size(); ++i)
+    {
+        out += (i ? ", \"" : "\"") + skipped[i] + "\"";
+    }
+    out += "]\n}\n";
+    return out;
+}
+
+void usage()
+{
+    std::fprintf(stderr,
+                 "bridge_bench [--sizes 16,256,...] [--clients 1,10,...] [--duration-ms N] [--workers N]\n"
+                 "             [--drivers N] [--port-base P] [--splice] [--io-uring] [--out file.json]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--sizes" && hasValue)
+        {
+            options.sizes = parseList(argv[++i]);
+        }
+        else if (arg == "--clients" && hasValue)
+        {
+            options.clientCounts = parseList(argv[++i]);
+        }
+        else if (arg == "--duration-ms" && hasValue)
+        {
+            options.durationMs = std::atoi(argv[++i]);
+        }
+        else if (arg == "--workers" && hasValue)
+        {
+            options.workers = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--drivers" && hasValue)
+        {
+            options.drivers = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--port-base" && hasValue)
+        {
+            options.portBase = std::atoi(argv[++i]);
+        }
+        else if (arg == "--splice")
+        {
+            options.spliceForward = true;
+        }
+        else if (arg == "--io-uring")
+        {
+            options.ioUring = true;
+        }
+        else if (arg == "--out" && hasValue)
+        {
+            options.outPath = argv[++i];
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+    TraceClock::calibrate();
+
+    const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    const unsigned workers = options.workers ? options.workers : std::max(1u, cpus / 2);
+    if (options.drivers == 0)
+    {
+        options.drivers = std::max(1u, cpus / 4);
+    }
+
+    // Per client: its socket, the bridge's accepted socket and listener, both ends of the
+    // device link, plus pipes or a ring when those paths are on
+    const size_t fdsPerClient = 5 + (options.spliceForward ? 4 : 0) + (options.ioUring ? 2 : 0);
+    const size_t fdLimit = raiseFdLimit();
+    const size_t maxClients = fdLimit > 256 ? (fdLimit - 256) / fdsPerClient : 0;
+    size_t bridgeCount = 0;
+    std::vector<std::string> skipped;
+    for (size_t clients : options.clientCounts)
+    {
+        if (clients > maxClients)
+        {
+            skipped.push_back(std::to_string(clients) + " clients: needs " + std::to_string(clients * fdsPerClient) +
+                              " fds, limit " + std::to_string(fdLimit));
+            continue;
+        }
+        bridgeCount = std::max(bridgeCount, clients);
+    }
+
+    EchoDevices devices;
+    if (!devices.start(options.portBase - 1))
+    {
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<EventLoop>> loops;
+    for (unsigned i = 0; i < workers; ++i)
+    {
+        loops.emplace_back(std::make_unique<EventLoop>());
+        loops.back()->startThread(workers > 1 ? static_cast<int>(i % cpus) : -1);
+    }
+    std::vector<std::unique_ptr<TcpBridgeInstance>> bridges;
+    for (size_t i = 0; i < bridgeCount; ++i)
+    {
+        BridgeConfig config;
+        config.remoteIp = deviceIp(i);
+        config.remotePort = options.portBase - 1;
+        config.listenPort = options.portBase + static_cast<int>(i);
+        config.spliceForward = options.spliceForward;
+        config.ioUring = options.ioUring;
+        bridges.emplace_back(std::make_unique<TcpBridgeInstance>(config, *loops[i % loops.size()]));
+        bridges.back()->start();
+    }
+    for (size_t i = 0; i < bridgeCount; ++i)
+    {
+        if (!bridges[i]->waitRemoteConnected(std::chrono::seconds(10)))
+        {
+            std::fprintf(stderr, "bridge %zu: device link did not come up\n", i);
+            return 1;
+        }
+    }
+    std::fprintf(stderr, "%zu bridges on %u workers, %u client drivers\n", bridgeCount, workers, options.drivers);
+
+    // One shared payload; messages larger than it are sent in several pieces
+    std::vector<uint8_t> payload(std::min<size_t>(*std::max_element(options.sizes.begin(), options.sizes.end()),
+                                                  kScratch));
+    for (size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<uint8_t>(i * 131);
+    }
+
+    std::vector<Result> results;
+    for (size_t clients : options.clientCounts)
+    {
+        if (clients > bridgeCount)
+        {
+            continue;
+        }
+        for (size_t size : options.sizes)
+        {
+            const Result r = runScenario(options, bridges, payload, clients, size);
+            std::fprintf(stderr, "%6zu clients %8zu B: %10.1f msg/s %9.2f MB/s p50 %s us p99 %s us%s%s\n", clients,
+                         size, static_cast<double>(r.messages) / r.seconds,
+                         static_cast<double>(r.messages) * static_cast<double>(size) / r.seconds / 1e6,
+                         micros(r.p50).c_str(), micros(r.p99).c_str(), r.errors ? " (errors)" : "",
+                         r.stalled() ? " (stalled: slow round trips on an idle process, check TCP_NODELAY)" : "");
+            results.push_back(r);
+        }
+    }
+
+    const std::string json = toJson(options, results, skipped, workers);
+    if (options.outPath.empty())
+    {
+        std::fputs(json.c_str(), stdout);
+    }
+    else if (FILE* file = std::fopen(options.outPath.c_str(), "w"))
+    {
+        std::fputs(json.c_str(), file);
+        std::fclose(file);
+    }
+    else
+    {
+        std::perror(options.outPath.c_str());
+        return 1;
+    }
+
+    for (auto& loop : loops)
+    {
+        loop->stop();
+    }
+    devices.stop();
+    bridges.clear();
+    return 0;
+}
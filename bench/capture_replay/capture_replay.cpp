@@ -0,0 +1,789 @@
+// Reads the ring files a bridge writes with --capture and drives a captured session back
+// through a bridge:
+//   info FILE            header, record counts and the span of time captured
+//   dump FILE [--hex]    one line per record
+//   run FILE [options]   replay: one connection per captured client, each sending what its
+//                        client sent; with --device-listen the tool also stands in for the
+//                        device, so point the bridge's remote at that port, and plays back
+//                        what the device sent
+// Timing is the capture's (scaled by --speed), or --full-speed: every record goes as soon as
+// causality allows, i.e. a client's request once the responses captured before it have come
+// back, and a device response once the requests captured before it have arrived. A record
+// whose precondition is not met within --stall-ms goes anyway and counts as a stall. At the end
+// the bytes seen are compared with the captured ones, per client and on the device side.
+#include "capture.h"
+#include "event_loop.h"
+#include "net_io.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kReadSize = 64 * 1024;
+constexpr int kLinkWaitMs = 60000; // bridge reconnect backoff tops out well below this
+
+void closeSocket(SOCKET_T s)
+{
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+bool wouldBlock()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+uint64_t nowNanos()
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+SOCKET_T connectTo(const std::string& host, int port)
+{
+    SOCKET_T sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET_T)
+    {
+        return INVALID_SOCKET_T;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        closeSocket(sock);
+        return INVALID_SOCKET_T;
+    }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+    SetSocketNonBlocking(sock, true);
+    return sock;
+}
+
+SOCKET_T listenOn(int port)
+{
+    SOCKET_T sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET_T)
+    {
+        return INVALID_SOCKET_T;
+    }
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(sock, 16) != 0)
+    {
+        closeSocket(sock);
+        return INVALID_SOCKET_T;
+    }
+    SetSocketNonBlocking(sock, true);
+    return sock;
+}
+
+// Where two streams first differ, as text for the report
+std::string compareStreams(const std::string& expected, const std::string& actual)
+{
+    const size_t common = std::min(expected.size(), actual.size());
+    const auto mismatch = std::mismatch(expected.begin(), expected.begin() + static_cast<std::ptrdiff_t>(common),
+                                        actual.begin());
+    if (mismatch.first != expected.begin() + static_cast<std::ptrdiff_t>(common))
+    {
+        return "differs at byte " + std::to_string(mismatch.first - expected.begin());
+    }
+    if (expected.size() == actual.size())
+    {
+        return "identical";
+    }
+    if (actual.size() < expected.size())
+    {
+        return "short by " + std::to_string(expected.size() - actual.size()) + " bytes";
+    }
+    return "identical, then " + std::to_string(actual.size() - expected.size()) + " extra bytes";
+}
+
+struct Options
+{
+    std::string path;
+    std::string host = "127.0.0.1";
+    int port = 0; // 0 = the captured bridge's listen port
+    int deviceListen = 0;
+    double speed = 1;
+    bool fullSpeed = false;
+    int stallMs = 1000;
+    int lingerMs = 1000; // after the last record, how long to wait for the stragglers
+};
+
+// One stream end the replay writes to and reads from
+struct Peer
+{
+    SOCKET_T sock = INVALID_SOCKET_T;
+    std::string out;
+    size_t outOffset = 0;
+    std::string received; // clients only; the device's bytes go to deviceStream
+    bool closing = false; // close once out is flushed and closeAfter bytes have arrived
+    size_t closeAfter = 0; // what the captured client had received when it closed
+};
+
+class Replay
+{
+public:
+    Replay(const Options& opts, const CaptureFile& capture) : options(opts), records(capture.records)
+    {
+        // What each direction had carried before every record, for the full-speed gates
+        upBefore.reserve(records.size());
+        downBefore.reserve(records.size());
+        uint64_t up = 0;
+        uint64_t down = 0;
+        for (const CaptureRecord& record : records)
+        {
+            upBefore.push_back(up);
+            downBefore.push_back(down);
+            if (record.kind == CaptureKind::ClientClose)
+            {
+                const auto it = expectedDown.find(record.client);
+                closeAfter.push_back(it == expectedDown.end() ? 0 : it->second.size());
+            }
+            if (record.kind == CaptureKind::ClientToDevice)
+            {
+                up += record.payload.size();
+                expectedUp += record.payload;
+            }
+            else if (record.kind == CaptureKind::DeviceToClient)
+            {
+                down += record.payload.size();
+                if (record.client != kCaptureNoClient)
+                {
+                    expectedDown[record.client] += record.payload;
+                }
+            }
+        }
+        totalUp = up;
+        totalDown = down;
+    }
+
+    bool run()
+    {
+        if (options.deviceListen > 0)
+        {
+            listener = listenOn(options.deviceListen);
+            if (listener == INVALID_SOCKET_T ||
+                !loop.add(listener, [this](uint32_t) { acceptDevice(); }))
+            {
+                std::cerr << "cannot listen on device port " << options.deviceListen << "\n";
+                return false;
+            }
+        }
+        if (options.deviceListen > 0)
+        {
+            // The session starts with the bridge's device link up, and the bridge is probably in
+            // its reconnect backoff from before this port was open
+            std::cerr << "waiting for the bridge to connect to port " << options.deviceListen << "\n";
+            pumpTimer = loop.runAfter(std::chrono::milliseconds(kLinkWaitMs), [this] {
+                std::cerr << "no device link after " << kLinkWaitMs / 1000 << " s\n";
+                finish();
+            });
+        }
+        else
+        {
+            begin();
+        }
+        loop.run();
+        finishedNanos = finishedNanos ? finishedNanos : nowNanos();
+        return startNanos != 0;
+    }
+
+    void report() const
+    {
+        // Up to the last byte moved, not the linger that confirmed nothing more was coming
+        const uint64_t end = std::max(lastActivity, lastProgress);
+        const double seconds = static_cast<double>((end > startNanos ? end : finishedNanos) - startNanos) / 1e9;
+        uint64_t received = 0;
+        for (const auto& entry : clients)
+        {
+            received += entry.second->received.size();
+        }
+        std::printf("%zu records, %zu clients in %.3f s (%.0f records/s), %llu stalls\n", records.size(),
+                    clients.size(), seconds, static_cast<double>(records.size()) / seconds,
+                    static_cast<unsigned long long>(stalls));
+        std::printf("up    %llu bytes sent of %llu captured", static_cast<unsigned long long>(sentUp),
+                    static_cast<unsigned long long>(totalUp));
+        if (options.deviceListen > 0)
+        {
+            std::printf(", device received %zu: %s", deviceStream.size(),
+                        compareStreams(expectedUp, deviceStream).c_str());
+        }
+        std::printf("\ndown  %llu bytes received of %llu captured", static_cast<unsigned long long>(received),
+                    static_cast<unsigned long long>(totalDown));
+        if (options.deviceListen > 0)
+        {
+            std::printf(" (%llu played by the device)", static_cast<unsigned long long>(sentDown));
+        }
+        std::printf("\n%.2f MB/s through the bridge\n",
+                    static_cast<double>(sentUp + received) / seconds / 1e6);
+        for (const auto& entry : expectedDown)
+        {
+            auto it = clients.find(entry.first);
+            const std::string actual = it == clients.end() ? std::string() : it->second->received;
+            std::printf("client %llu: %zu of %zu bytes, %s\n", static_cast<unsigned long long>(entry.first),
+                        actual.size(), entry.second.size(), compareStreams(entry.second, actual).c_str());
+        }
+    }
+
+private:
+    const Options& options;
+    const std::vector<CaptureRecord>& records;
+    std::vector<uint64_t> upBefore;
+    std::vector<uint64_t> downBefore;
+    std::vector<size_t> closeAfter; // per close record, in order
+    size_t closesApplied = 0;
+    std::string expectedUp;
+    std::map<uint64_t, std::string> expectedDown;
+    uint64_t totalUp = 0;
+    uint64_t totalDown = 0;
+
+    EventLoop loop;
+    std::map<uint64_t, std::unique_ptr<Peer>> clients;
+    SOCKET_T listener = INVALID_SOCKET_T;
+    Peer device;
+    std::string deviceStream; // everything the device received, across reconnects
+    size_t next = 0;
+    uint64_t startNanos = 0;
+    uint64_t finishedNanos = 0;
+    uint64_t lastProgress = 0; // when the last record was applied
+    uint64_t lastActivity = 0; // when bytes last arrived anywhere
+    uint64_t sentUp = 0;
+    uint64_t sentDown = 0;
+    uint64_t receivedDown = 0;
+    uint64_t stalls = 0;
+    EventLoop::TimerId pumpTimer = 0;
+    bool forceNext = false;
+
+    void begin()
+    {
+        loop.cancelTimer(pumpTimer);
+        startNanos = nowNanos();
+        pump();
+    }
+
+    void pump()
+    {
+        loop.cancelTimer(pumpTimer);
+        pumpTimer = 0;
+        const uint64_t now = nowNanos();
+        while (next < records.size())
+        {
+            const CaptureRecord& record = records[next];
+            if (!options.fullSpeed)
+            {
+                const uint64_t due = startNanos + static_cast<uint64_t>(static_cast<double>(record.nanos) / options.speed);
+                if (due > now)
+                {
+                    arm((due - now + 999999) / 1000000, false);
+                    return;
+                }
+            }
+            else if (!ready(next) && !forceNext)
+            {
+                arm(static_cast<uint64_t>(options.stallMs), true);
+                return;
+            }
+            forceNext = false;
+            apply(record);
+            ++next;
+            lastProgress = nowNanos();
+        }
+        // Every record is out; wait for the bytes in flight
+        const uint64_t quietSince = std::max(lastProgress, lastActivity);
+        if (drained() || nowNanos() - quietSince >= static_cast<uint64_t>(options.lingerMs) * 1000000)
+        {
+            finish();
+            return;
+        }
+        arm(10, false);
+    }
+
+    void arm(uint64_t millis, bool stall)
+    {
+        pumpTimer = loop.runAfter(std::chrono::milliseconds(millis), [this, stall] {
+            pumpTimer = 0;
+            if (stall)
+            {
+                ++stalls;
+                forceNext = true;
+            }
+            pump();
+        });
+    }
+
+    bool ready(size_t index) const
+    {
+        if (options.deviceListen == 0)
+        {
+            // The real device answers; nothing here knows what to wait for
+            return true;
+        }
+        switch (records[index].kind)
+        {
+        case CaptureKind::ClientToDevice:
+        case CaptureKind::ClientOpen:
+        case CaptureKind::ClientClose:
+            return receivedDown >= downBefore[index];
+        case CaptureKind::DeviceToClient:
+            return device.sock != INVALID_SOCKET_T && deviceStream.size() >= upBefore[index];
+        default:
+            return true;
+        }
+    }
+
+    bool drained() const
+    {
+        for (const auto& entry : clients)
+        {
+            if (entry.second->outOffset < entry.second->out.size())
+            {
+                return false;
+            }
+        }
+        if (options.deviceListen == 0)
+        {
+            return false; // only the linger timeout knows when the device is done answering
+        }
+        return device.outOffset >= device.out.size() && deviceStream.size() >= totalUp && receivedDown >= totalDown;
+    }
+
+    void finish()
+    {
+        finishedNanos = nowNanos();
+        for (auto& entry : clients)
+        {
+            drop(*entry.second);
+        }
+        drop(device);
+        if (listener != INVALID_SOCKET_T)
+        {
+            loop.remove(listener);
+            closeSocket(listener);
+        }
+        loop.stop();
+    }
+
+    void apply(const CaptureRecord& record)
+    {
+        switch (record.kind)
+        {
+        case CaptureKind::ClientOpen:
+            client(record.client);
+            break;
+        case CaptureKind::ClientToDevice:
+        {
+            Peer& peer = client(record.client);
+            peer.out += record.payload;
+            sentUp += record.payload.size();
+            flush(peer);
+            break;
+        }
+        case CaptureKind::ClientClose:
+        {
+            // Not before the bytes the client got before it closed have come through the bridge
+            auto it = clients.find(record.client);
+            if (it != clients.end())
+            {
+                it->second->closing = true;
+                it->second->closeAfter = closeAfter[closesApplied];
+                flush(*it->second);
+            }
+            ++closesApplied;
+            break;
+        }
+        case CaptureKind::DeviceToClient:
+            if (options.deviceListen > 0)
+            {
+                device.out += record.payload;
+                sentDown += record.payload.size();
+                flush(device);
+            }
+            break;
+        case CaptureKind::LinkDown:
+            // The device dropped the link here; the bridge reconnects as it did then
+            if (options.deviceListen > 0)
+            {
+                drop(device);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // The replay connection of a captured client, opened on first use: a client accepted before
+    // the oldest record kept has no open record
+    Peer& client(uint64_t seq)
+    {
+        auto& slot = clients[seq];
+        if (!slot)
+        {
+            slot = std::make_unique<Peer>();
+            slot->sock = connectTo(options.host, options.port);
+            Peer* peer = slot.get();
+            if (slot->sock == INVALID_SOCKET_T ||
+                !loop.add(slot->sock, [this, peer](uint32_t events) { onEvent(*peer, events, false); }))
+            {
+                std::cerr << "client " << seq << ": connect to " << options.host << ":" << options.port
+                          << " failed\n";
+                drop(*slot);
+            }
+        }
+        return *slot;
+    }
+
+    void acceptDevice()
+    {
+        while (true)
+        {
+            const SOCKET_T sock = ::accept(listener, nullptr, nullptr);
+            if (sock == INVALID_SOCKET_T)
+            {
+                return;
+            }
+            // A reconnect replaces the link; what was queued for the old one goes to the new one
+            std::string pending = device.out.substr(std::min(device.outOffset, device.out.size()));
+            drop(device);
+            SetSocketNonBlocking(sock, true);
+            int one = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+            device.sock = sock;
+            device.out = std::move(pending);
+            device.outOffset = 0;
+            device.closing = false;
+            if (!loop.add(sock, [this](uint32_t events) { onEvent(device, events, true); }))
+            {
+                drop(device);
+                continue;
+            }
+            flush(device);
+            if (startNanos == 0)
+            {
+                begin();
+                continue;
+            }
+            pump();
+        }
+    }
+
+    void onEvent(Peer& peer, uint32_t events, bool isDevice)
+    {
+        if (peer.sock == INVALID_SOCKET_T)
+        {
+            return;
+        }
+        if (events & EvWrite)
+        {
+            flush(peer);
+        }
+        if (!(events & (EvRead | EvClosed)))
+        {
+            return;
+        }
+        char buffer[kReadSize];
+        while (peer.sock != INVALID_SOCKET_T)
+        {
+            const int n = ::recv(peer.sock, buffer, static_cast<int>(sizeof(buffer)), 0);
+            if (n > 0)
+            {
+                lastActivity = nowNanos();
+                if (isDevice)
+                {
+                    deviceStream.append(buffer, static_cast<size_t>(n));
+                }
+                else
+                {
+                    peer.received.append(buffer, static_cast<size_t>(n));
+                    receivedDown += static_cast<uint64_t>(n);
+                    if (peer.closing)
+                    {
+                        flush(peer);
+                    }
+                }
+                continue;
+            }
+            if (n < 0 && wouldBlock())
+            {
+                break;
+            }
+            drop(peer);
+        }
+        if (options.fullSpeed && next < records.size() && ready(next))
+        {
+            pump();
+        }
+    }
+
+    void flush(Peer& peer)
+    {
+        while (peer.sock != INVALID_SOCKET_T && peer.outOffset < peer.out.size())
+        {
+            const int n = ::send(peer.sock, peer.out.data() + peer.outOffset,
+                                 static_cast<int>(peer.out.size() - peer.outOffset), 0);
+            if (n > 0)
+            {
+                peer.outOffset += static_cast<size_t>(n);
+                continue;
+            }
+            if (n < 0 && wouldBlock())
+            {
+                loop.watchWrite(peer.sock, true);
+                return;
+            }
+            drop(peer);
+            return;
+        }
+        if (peer.sock == INVALID_SOCKET_T)
+        {
+            return;
+        }
+        peer.out.clear();
+        peer.outOffset = 0;
+        loop.watchWrite(peer.sock, false);
+        if (peer.closing && peer.received.size() >= peer.closeAfter)
+        {
+            drop(peer);
+        }
+    }
+
+    void drop(Peer& peer)
+    {
+        if (peer.sock != INVALID_SOCKET_T)
+        {
+            loop.remove(peer.sock);
+            closeSocket(peer.sock);
+            peer.sock = INVALID_SOCKET_T;
+        }
+    }
+};
+
+void printInfo(const std::string& path, const CaptureFile& file)
+{
+    uint64_t counts[7] = {};
+    uint64_t bytes[7] = {};
+    std::map<uint64_t, bool> seen;
+    for (const CaptureRecord& record : file.records)
+    {
+        const size_t kind = std::min<size_t>(static_cast<size_t>(record.kind), 6);
+        ++counts[kind];
+        bytes[kind] += record.payload.size();
+        if (record.client != kCaptureNoClient)
+        {
+            seen[record.client] = true;
+        }
+    }
+    const uint64_t span = file.records.empty() ? 0 : file.records.back().nanos - file.records.front().nanos;
+    const time_t started = static_cast<time_t>(file.startUnixNanos / 1000000000);
+    char when[64];
+    std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", std::localtime(&started));
+    std::printf("%s: bridge :%d -> %s:%d, started %s\n", path.c_str(), file.listenPort, file.remoteIp.c_str(),
+                file.remotePort, when);
+    std::printf("%zu records over %.3f s, %zu clients, %llu bytes overwritten by the ring\n", file.records.size(),
+                static_cast<double>(span) / 1e9, seen.size(), static_cast<unsigned long long>(file.overwrittenBytes));
+    for (size_t kind = 1; kind < 7; ++kind)
+    {
+        std::printf("  %-10s %10llu records %14llu bytes\n", captureKindName(static_cast<CaptureKind>(kind)),
+                    static_cast<unsigned long long>(counts[kind]), static_cast<unsigned long long>(bytes[kind]));
+    }
+}
+
+void printDump(const CaptureFile& file, bool hex)
+{
+    for (const CaptureRecord& record : file.records)
+    {
+        std::printf("%14.6f %-10s ", static_cast<double>(record.nanos) / 1e9, captureKindName(record.kind));
+        if (record.client == kCaptureNoClient)
+        {
+            std::printf("%8s", "-");
+        }
+        else
+        {
+            std::printf("%8llu", static_cast<unsigned long long>(record.client));
+        }
+        std::printf(" %6zu  ", record.payload.size());
+        const size_t shown = std::min<size_t>(record.payload.size(), hex ? 32 : 64);
+        for (size_t i = 0; i < shown; ++i)
+        {
+            const unsigned char c = static_cast<unsigned char>(record.payload[i]);
+            if (hex)
+            {
+                std::printf("%02x", c);
+            }
+            else
+            {
+                std::putchar(c >= 0x20 && c < 0x7f ? c : '.');
+            }
+        }
+        std::printf("%s\n", shown < record.payload.size() ? "..." : "");
+    }
+}
+
+void usage()
+{
+    std::cerr << "capture_replay info FILE\n"
+                 "capture_replay dump FILE [--hex]\n"
+                 "capture_replay run FILE [options]\n"
+                 "  --host H             bridge address (default 127.0.0.1)\n"
+                 "  --port P             bridge listen port (default: the captured one)\n"
+                 "  --device-listen P    stand in for the device on port P and play its side too\n"
+                 "  --speed X            X times the captured pace (default 1)\n"
+                 "  --full-speed         no pacing, only the request/response order\n"
+                 "  --stall-ms N         full speed: send anyway after waiting this long (default 1000)\n"
+                 "  --linger-ms N        wait this long for late bytes after the last record (default 1000)\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        usage();
+        return 2;
+    }
+    const std::string command = argv[1];
+    Options options;
+    options.path = argv[2];
+    bool hex = false;
+    for (int i = 3; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--hex")
+        {
+            hex = true;
+        }
+        else if (arg == "--host" && hasValue)
+        {
+            options.host = argv[++i];
+        }
+        else if (arg == "--port" && hasValue)
+        {
+            options.port = std::atoi(argv[++i]);
+        }
+        else if (arg == "--device-listen" && hasValue)
+        {
+            options.deviceListen = std::atoi(argv[++i]);
+        }
+        else if (arg == "--speed" && hasValue)
+        {
+            options.speed = std::atof(argv[++i]);
+        }
+        else if (arg == "--full-speed")
+        {
+            options.fullSpeed = true;
+        }
+        else if (arg == "--stall-ms" && hasValue)
+        {
+            options.stallMs = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--linger-ms" && hasValue)
+        {
+            options.lingerMs = std::max(0, std::atoi(argv[++i]));
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (options.speed <= 0)
+    {
+        usage();
+        return 2;
+    }
+
+    CaptureFile capture;
+    std::string error;
+    if (!readCaptureFile(options.path, capture, error))
+    {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    if (command == "info")
+    {
+        printInfo(options.path, capture);
+        return 0;
+    }
+    if (command == "dump")
+    {
+        printDump(capture, hex);
+        return 0;
+    }
+    if (command != "run")
+    {
+        usage();
+        return 2;
+    }
+
+#ifdef _WIN32
+    WSADATA wsa{};
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+    {
+        std::cerr << "WSAStartup failed\n";
+        return 1;
+    }
+#else
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    if (options.port == 0)
+    {
+        options.port = capture.listenPort;
+    }
+    // Replay time starts at the first record kept, not at the capture's start
+    const uint64_t origin = capture.records.empty() ? 0 : capture.records.front().nanos;
+    for (CaptureRecord& record : capture.records)
+    {
+        record.nanos -= origin;
+    }
+    Replay replay(options, capture);
+    if (!replay.run())
+    {
+        return 1;
+    }
+    replay.report();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
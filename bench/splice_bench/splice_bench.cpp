@@ -0,0 +1,261 @@
+// Compares the CPU cost of the two bridge forwarding paths on loopback TCP:
+//   copy   - recv() into a user buffer, then send() (the default path)
+//   splice - socket -> pipe -> socket with splice(), payload stays in the kernel
+// Only the forwarding thread's CPU time is charged, so source/sink costs cancel out.
+#include "splice_pipe.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t kCopyChunk = 16 * 1024; // matches the bridge's read size
+constexpr size_t kPipeSize = 256 * 1024; // matches the bridge's per-direction queue bound
+
+int listenLoopback(int& port)
+{
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    listen(s, 1);
+    socklen_t len = sizeof(addr);
+    getsockname(s, reinterpret_cast<sockaddr*>(&addr), &len);
+    port = ntohs(addr.sin_port);
+    return s;
+}
+
+int connectLoopback(int port)
+{
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        perror("connect");
+        std::exit(1);
+    }
+    return s;
+}
+
+void waitFor(int fd, short events)
+{
+    pollfd p{fd, events, 0};
+    poll(&p, 1, -1);
+}
+
+double threadCpuSeconds()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Move total bytes from in to out with the bridge's copy path
+bool forwardCopy(int in, int out, size_t total)
+{
+    std::vector<uint8_t> buffer(kCopyChunk);
+    size_t moved = 0;
+    while (moved < total)
+    {
+        ssize_t n = recv(in, buffer.data(), buffer.size(), 0);
+        if (n < 0 && errno == EAGAIN)
+        {
+            waitFor(in, POLLIN);
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        size_t offset = 0;
+        while (offset < static_cast<size_t>(n))
+        {
+            ssize_t w = send(out, buffer.data() + offset, n - offset, MSG_NOSIGNAL);
+            if (w < 0 && errno == EAGAIN)
+            {
+                waitFor(out, POLLOUT);
+                continue;
+            }
+            if (w <= 0)
+            {
+                return false;
+            }
+            offset += static_cast<size_t>(w);
+        }
+        moved += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Move total bytes from in to out through a SplicePipe, as the bridge does with --splice
+bool forwardSplice(int in, int out, size_t total)
+{
+    SplicePipe pipe;
+    if (!pipe.open(kPipeSize))
+    {
+        std::fprintf(stderr, "pipe creation failed\n");
+        return false;
+    }
+    size_t moved = 0;
+    while (moved < total)
+    {
+        int n = pipe.fill(in, kPipeSize);
+        if (n < 0 && errno == EAGAIN && pipe.buffered() == 0)
+        {
+            waitFor(in, POLLIN);
+            continue;
+        }
+        if (n == 0 || (n < 0 && errno != EAGAIN))
+        {
+            return false;
+        }
+        if (n > 0)
+        {
+            moved += static_cast<size_t>(n);
+        }
+        while (pipe.buffered() > 0)
+        {
+            if (!pipe.drain(out))
+            {
+                return false;
+            }
+            if (pipe.buffered() > 0)
+            {
+                waitFor(out, POLLOUT);
+            }
+        }
+    }
+    return true;
+}
+
+struct Result
+{
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+};
+
+Result runOnce(bool useSplice, size_t total)
+{
+    int inPort = 0;
+    int outPort = 0;
+    int inListen = listenLoopback(inPort);
+    int outListen = listenLoopback(outPort);
+
+    int source = connectLoopback(inPort);
+    int fwdIn = accept(inListen, nullptr, nullptr);
+    int fwdOut = connectLoopback(outPort);
+    int sink = accept(outListen, nullptr, nullptr);
+    int one = 1;
+    setsockopt(fwdOut, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    SetSocketNonBlocking(fwdIn, true);
+    SetSocketNonBlocking(fwdOut, true);
+
+    std::thread producer([source, total]() {
+        std::vector<uint8_t> block(64 * 1024, 0x5a);
+        size_t sent = 0;
+        while (sent < total)
+        {
+            size_t want = total - sent < block.size() ? total - sent : block.size();
+            ssize_t n = send(source, block.data(), want, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                break;
+            }
+            sent += static_cast<size_t>(n);
+        }
+    });
+    std::thread consumer([sink, total]() {
+        std::vector<uint8_t> block(64 * 1024);
+        size_t got = 0;
+        while (got < total)
+        {
+            ssize_t n = recv(sink, block.data(), block.size(), 0);
+            if (n <= 0)
+            {
+                break;
+            }
+            got += static_cast<size_t>(n);
+        }
+    });
+
+    Result result;
+    const auto wallStart = std::chrono::steady_clock::now();
+    const double cpuStart = threadCpuSeconds();
+    bool ok = useSplice ? forwardSplice(fwdIn, fwdOut, total) : forwardCopy(fwdIn, fwdOut, total);
+    result.cpuSeconds = threadCpuSeconds() - cpuStart;
+    producer.join();
+    consumer.join();
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    if (!ok)
+    {
+        std::fprintf(stderr, "%s forwarding failed\n", useSplice ? "splice" : "copy");
+    }
+
+    for (int fd : {source, fwdIn, fwdOut, sink, inListen, outListen})
+    {
+        close(fd);
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t totalMb = 2048;
+    int rounds = 3;
+    if (argc >= 2)
+    {
+        totalMb = static_cast<size_t>(std::atoll(argv[1]));
+    }
+    if (argc >= 3)
+    {
+        rounds = std::atoi(argv[2]);
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+
+    const size_t total = totalMb * 1024 * 1024;
+    const double gib = static_cast<double>(total) / (1024.0 * 1024.0 * 1024.0);
+    std::printf("forwarding %zu MiB per round, %d rounds\n", totalMb, rounds);
+    std::printf("%-8s %12s %14s %16s\n", "path", "MiB/s", "cpu s/GiB", "cpu share");
+
+    double cpuPerGib[2] = {0, 0};
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        Result sum;
+        for (int i = 0; i < rounds; ++i)
+        {
+            Result r = runOnce(mode == 1, total);
+            sum.wallSeconds += r.wallSeconds;
+            sum.cpuSeconds += r.cpuSeconds;
+        }
+        cpuPerGib[mode] = sum.cpuSeconds / (gib * rounds);
+        std::printf("%-8s %12.1f %14.3f %15.1f%%\n", mode == 1 ? "splice" : "copy",
+                    totalMb * rounds / sum.wallSeconds, cpuPerGib[mode],
+                    100.0 * sum.cpuSeconds / sum.wallSeconds);
+    }
+    if (cpuPerGib[1] > 0)
+    {
+        std::printf("splice uses %.2fx the forwarding CPU of copy\n", cpuPerGib[1] / cpuPerGib[0]);
+    }
+    return 0;
+}
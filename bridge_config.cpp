@@ -0,0 +1,240 @@
+#include "bridge_config.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <tuple>
+#include <unordered_set>
+
+namespace {
+
+auto fields(const BridgeConfig& c)
+{
+    return std::tie(c.remoteIp, c.remotePort, c.listenPort, c.spliceForward, c.ioUring, c.broadcast, c.modbusMux,
+                    c.highWatermark, c.lowWatermark, c.socketBufferBytes, c.connectTimeoutMs,
+                    c.heartbeatIntervalMs, c.heartbeatTimeoutMs, c.heartbeatProbe, c.dwellOutlierUs,
+                    c.clientIdleTimeoutMs, c.framing, c.captureDir, c.captureBytes, c.cache,
+                    c.coalesceRequests);
+}
+
+bool parseFlag(const std::string& value, bool& flag)
+{
+    if (value.empty() || value == "1")
+    {
+        flag = true;
+        return true;
+    }
+    if (value == "0")
+    {
+        flag = false;
+        return true;
+    }
+    return false;
+}
+
+bool applyOption(const std::string& option, BridgeConfig& cfg)
+{
+    const size_t eq = option.find('=');
+    const std::string name = option.substr(0, eq);
+    const std::string value = eq == std::string::npos ? std::string() : option.substr(eq + 1);
+    const auto intValue = [&value](int& field) {
+        long long number = 0;
+        if (!parseConfigNumber(value, INT_MAX, number))
+        {
+            return false;
+        }
+        field = static_cast<int>(number);
+        return true;
+    };
+    const auto sizeValue = [&value](size_t& field, size_t unit) {
+        long long number = 0;
+        if (!parseConfigNumber(value, kMaxConfigBytes / static_cast<long long>(unit), number))
+        {
+            return false;
+        }
+        field = static_cast<size_t>(number) * unit;
+        return true;
+    };
+    if (name == "splice")
+    {
+        return parseFlag(value, cfg.spliceForward);
+    }
+    if (name == "io-uring")
+    {
+        return parseFlag(value, cfg.ioUring);
+    }
+    if (name == "broadcast")
+    {
+        return parseFlag(value, cfg.broadcast);
+    }
+    if (name == "modbus")
+    {
+        return parseFlag(value, cfg.modbusMux);
+    }
+    if (name == "coalesce")
+    {
+        return parseFlag(value, cfg.coalesceRequests);
+    }
+    if (name == "framing")
+    {
+        return parseFraming(value, cfg.framing);
+    }
+    if (name == "capture")
+    {
+        cfg.captureDir = value;
+        return !value.empty();
+    }
+    if (name == "cache-rules")
+    {
+        return parseCacheRules(value, cfg.cache.rules);
+    }
+    if (name == "heartbeat-probe")
+    {
+        cfg.heartbeatProbe = parseHexBytes(value);
+        return cfg.heartbeatProbe.size() * 2 == value.size();
+    }
+    if (name == "high-water")
+    {
+        return sizeValue(cfg.highWatermark, 1);
+    }
+    if (name == "low-water")
+    {
+        return sizeValue(cfg.lowWatermark, 1);
+    }
+    if (name == "capture-mb")
+    {
+        return sizeValue(cfg.captureBytes, 1024 * 1024);
+    }
+    if (name == "sockbuf")
+    {
+        return intValue(cfg.socketBufferBytes);
+    }
+    if (name == "connect-timeout")
+    {
+        return intValue(cfg.connectTimeoutMs);
+    }
+    if (name == "heartbeat")
+    {
+        return intValue(cfg.heartbeatIntervalMs);
+    }
+    if (name == "heartbeat-timeout")
+    {
+        return intValue(cfg.heartbeatTimeoutMs);
+    }
+    if (name == "dwell-outlier-us")
+    {
+        return intValue(cfg.dwellOutlierUs);
+    }
+    if (name == "client-idle-timeout")
+    {
+        return intValue(cfg.clientIdleTimeoutMs);
+    }
+    if (name == "cache-ttl")
+    {
+        return intValue(cfg.cache.ttlMs);
+    }
+    return false;
+}
+
+} // namespace
+
+bool parseConfigNumber(const std::string& text, long long max, long long& value)
+{
+    if (text.empty() || text[0] < '0' || text[0] > '9')
+    {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    const long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed > max)
+    {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+bool operator==(const BridgeConfig& a, const BridgeConfig& b)
+{
+    return fields(a) == fields(b);
+}
+
+bool operator!=(const BridgeConfig& a, const BridgeConfig& b)
+{
+    return !(a == b);
+}
+
+std::vector<uint8_t> parseHexBytes(const std::string& text)
+{
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i + 1 < text.size(); i += 2)
+    {
+        char* end = nullptr;
+        const std::string pair = text.substr(i, 2);
+        const long value = std::strtol(pair.c_str(), &end, 16);
+        if (*end != '\0')
+        {
+            break;
+        }
+        bytes.push_back(static_cast<uint8_t>(value));
+    }
+    return bytes;
+}
+
+bool loadBridgeConfigs(const std::string& path, const BridgeConfig& defaults, std::vector<BridgeConfig>& configs,
+                       std::string& error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::vector<BridgeConfig> parsed;
+    std::unordered_set<int> listenPorts;
+    std::string line;
+    for (int lineNo = 1; std::getline(file, line); ++lineNo)
+    {
+        const std::string where = path + ":" + std::to_string(lineNo) + ": ";
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string listen;
+        std::string remote;
+        if (!(words >> listen))
+        {
+            continue; // blank or comment
+        }
+        long long listenPort = 0;
+        long long remotePort = 0;
+        const size_t colon = (words >> remote) ? remote.rfind(':') : std::string::npos;
+        if (!parseConfigNumber(listen, 65535, listenPort) || listenPort == 0 || colon == std::string::npos ||
+            colon == 0 || !parseConfigNumber(remote.substr(colon + 1), 65535, remotePort) || remotePort == 0)
+        {
+            error = where + "expected <listen port> <device ip>:<port>";
+            return false;
+        }
+        BridgeConfig cfg = defaults;
+        cfg.listenPort = static_cast<int>(listenPort);
+        cfg.remoteIp = remote.substr(0, colon);
+        cfg.remotePort = static_cast<int>(remotePort);
+        std::string option;
+        while (words >> option)
+        {
+            if (!applyOption(option, cfg))
+            {
+                error = where + "bad option " + option;
+                return false;
+            }
+        }
+        if (!listenPorts.insert(cfg.listenPort).second)
+        {
+            error = where + "listen port " + std::to_string(cfg.listenPort) + " used twice";
+            return false;
+        }
+        parsed.push_back(std::move(cfg));
+    }
+    configs = std::move(parsed);
+    return true;
+}
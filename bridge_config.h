@@ -0,0 +1,87 @@
+#pragma once
+
+#include "framer.h"
+#include "response_cache.h"
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-bridge configuration: target external endpoint and the local listening port paired to it
+struct BridgeConfig
+{
+    std::string remoteIp;
+    int remotePort = 0;
+    int listenPort = 0;
+    bool spliceForward = false; // Linux: move payload with splice() through per-client pipes
+    bool ioUring = false;       // Linux 6.0+: device link and listener I/O through io_uring
+    bool broadcast = false;     // every client gets the whole device stream, not just the last speaker
+    bool modbusMux = false;     // Modbus TCP: remap transaction IDs so clients share the link (overrides broadcast)
+    // Backpressure per connection and direction: reading the faster side stops once this many
+    // bytes wait for the slower side, and resumes when the backlog is back down to lowWatermark
+    size_t highWatermark = 256 * 1024;
+    size_t lowWatermark = 64 * 1024;
+    int socketBufferBytes = 0;  // SO_SNDBUF/SO_RCVBUF on bridge sockets, 0 = kernel autotuning
+    int connectTimeoutMs = 3000; // device connect attempts give up after this long, 0 = kernel SYN timeout
+    // Liveness: a device link silent for heartbeatIntervalMs gets heartbeatProbe and must answer
+    // within heartbeatTimeoutMs; the answer times the RTT. Without a probe, TCP keepalive and
+    // TCP_USER_TIMEOUT bound detection to about the same window and RTT is the kernel's estimate.
+    // Probes need modbus mode, where the reply is recognised by its transaction ID and absorbed;
+    // other modes cannot tell it from device data meant for clients and ignore the probe.
+    int heartbeatIntervalMs = 0; // 0 = off
+    int heartbeatTimeoutMs = 3000;
+    std::vector<uint8_t> heartbeatProbe;
+    // Forwarded bytes that spend longer than this between their read and their write are
+    // logged in the bridge's outlier ring, 0 = log none (dwell histograms are always kept)
+    int dwellOutlierUs = 1000;
+    // Clients that neither send nor receive for this long are closed, 0 = keep them forever
+    int clientIdleTimeoutMs = 0;
+    // Client -> device: only whole frames go onto the device link, so the requests of clients
+    // sharing it never interleave. Modbus mode frames by MBAP header regardless; framed
+    // client input takes the copy path even with spliceForward.
+    FramingConfig framing;
+    // Every byte read from clients and from the device, and every connect and disconnect, is
+    // recorded into captureDir/bridge-<listen port>-<unix time>.cap, a ring file of captureBytes
+    // that keeps the newest traffic (see capture.h). The bytes have to pass through user space
+    // for that, so capturing turns spliceForward off.
+    std::string captureDir; // empty = off
+    size_t captureBytes = 64 * 1024 * 1024;
+    // Modbus mode: repeated polls are answered by the bridge while the device's last answer
+    // is younger than cache.ttlMs. Other modes cannot tell which response answers which
+    // request and ignore it.
+    ResponseCacheConfig cache;
+    // Modbus mode: a request identical to one still waiting for the device is not sent again;
+    // the device's answer goes to every client that asked. Only requests matching cache.rules
+    // (reads, by default) are joined, whether or not the cache is on.
+    bool coalesceRequests = false;
+};
+
+
+// Same bridge: a reload leaves a running bridge alone only when every field matches
+bool operator==(const BridgeConfig& a, const BridgeConfig& b);
+bool operator!=(const BridgeConfig& a, const BridgeConfig& b);
+
+// Largest byte count a size option may hold on this platform
+constexpr long long kMaxConfigBytes = SIZE_MAX < LLONG_MAX ? static_cast<long long>(SIZE_MAX) : LLONG_MAX;
+
+// Whole-string decimal number in [0, max], so "15000x", "-1" and values that would wrap the
+// field they are meant for are errors rather than something else
+bool parseConfigNumber(const std::string& text, long long max, long long& value);
+
+// "0001000000060103000a0001" -> bytes; stops at the first character that is not a hex pair
+std::vector<uint8_t> parseHexBytes(const std::string& text);
+
+// Bridge topology file, one bridge per line:
+//
+//   # listen port, device address, then options as on the command line, without the dashes
+//   15000 192.168.200.112:9100
+//   15001 192.168.200.113:9100 modbus heartbeat=1000 heartbeat-probe=0001000000060103000a0001
+//
+// Each entry starts as a copy of defaults. Boolean options (splice, io-uring, broadcast,
+// modbus, coalesce) take an optional =0/=1; framing= takes a parseFraming() spec, capture= a directory,
+// cache-rules= a parseCacheRules() list.
+// Listen ports must be unique. On error nothing is returned but a message naming the line.
+bool loadBridgeConfigs(const std::string& path, const BridgeConfig& defaults, std::vector<BridgeConfig>& configs,
+                       std::string& error);
@@ -0,0 +1,274 @@
+#include "capture.h"
+
+#include "trace_clock.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'B', 'C', 'A', 'P', '1', 0, 0};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kHeaderSize = 4096;
+constexpr int kReadAttempts = 8; // copies of a file being written before settling for what is left
+
+static_assert(sizeof(CaptureFileHeader) <= kHeaderSize, "capture header outgrew its page");
+static_assert(sizeof(CaptureRecordHeader) % 8 == 0, "records must stay 8-byte aligned");
+
+uint64_t alignRecord(uint64_t bytes)
+{
+    return (bytes + 7) & ~uint64_t(7);
+}
+
+// Where the record starting at offset ends, given the ring bytes; the reader and the writer's
+// reclaim walk the ring the same way
+uint64_t recordEnd(const uint8_t* ring, uint64_t capacity, uint64_t offset)
+{
+    const uint64_t position = offset % capacity;
+    const uint64_t left = capacity - position;
+    if (left < sizeof(CaptureRecordHeader))
+    {
+        return offset + left;
+    }
+    CaptureRecordHeader record;
+    std::memcpy(&record, ring + position, sizeof(record));
+    return offset + alignRecord(sizeof(CaptureRecordHeader) + record.size);
+}
+
+} // namespace
+
+const char* captureKindName(CaptureKind kind)
+{
+    switch (kind)
+    {
+    case CaptureKind::Padding:
+        return "padding";
+    case CaptureKind::ClientToDevice:
+        return "up";
+    case CaptureKind::DeviceToClient:
+        return "down";
+    case CaptureKind::ClientOpen:
+        return "open";
+    case CaptureKind::ClientClose:
+        return "close";
+    case CaptureKind::LinkUp:
+        return "link-up";
+    case CaptureKind::LinkDown:
+        return "link-down";
+    }
+    return "unknown";
+}
+
+CaptureWriter::~CaptureWriter()
+{
+#ifndef _WIN32
+    if (header)
+    {
+        munmap(header, mappedBytes);
+    }
+#endif
+}
+
+bool CaptureWriter::open(const std::string& path, size_t bytes, const std::string& remoteIp, int remotePort,
+                         int listenPort)
+{
+#ifdef _WIN32
+    (void)path;
+    (void)bytes;
+    (void)remoteIp;
+    (void)remotePort;
+    (void)listenPort;
+    return false;
+#else
+    capacity = alignRecord(std::max<uint64_t>(bytes, 64 * 1024));
+    mappedBytes = kHeaderSize + capacity;
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // Reserve the blocks now, so a full disk fails here and not as a SIGBUS mid-forward
+    bool sized = ftruncate(fd, static_cast<off_t>(mappedBytes)) == 0;
+#ifdef __linux__
+    sized = sized && posix_fallocate(fd, 0, static_cast<off_t>(mappedBytes)) == 0;
+    const int flags = MAP_SHARED | MAP_POPULATE;
+#else
+    const int flags = MAP_SHARED;
+#endif
+    void* mapped = sized ? mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, flags, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        return false;
+    }
+
+    header = static_cast<CaptureFileHeader*>(mapped);
+    ring = static_cast<uint8_t*>(mapped) + kHeaderSize;
+    startTicks = TraceClock::now();
+    header->version = kVersion;
+    header->headerSize = kHeaderSize;
+    header->capacity = capacity;
+    header->head.store(0, std::memory_order_relaxed);
+    header->tail.store(0, std::memory_order_relaxed);
+    header->startUnixNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+    header->listenPort = static_cast<uint32_t>(listenPort);
+    header->remotePort = static_cast<uint32_t>(remotePort);
+    std::strncpy(header->remoteIp, remoteIp.c_str(), sizeof(header->remoteIp) - 1);
+    // Magic last: a file with it is a complete header
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, kMagic, sizeof(kMagic));
+    return true;
+#endif
+}
+
+void CaptureWriter::record(CaptureKind kind, uint64_t client, uint64_t ticks, const uint8_t* data, size_t size)
+{
+    const uint64_t length = alignRecord(sizeof(CaptureRecordHeader) + size);
+    if (!header || length > capacity / 2)
+    {
+        return;
+    }
+
+    uint64_t head = header->head.load(std::memory_order_relaxed);
+    const uint64_t left = capacity - head % capacity;
+    if (left < length)
+    {
+        // Records never wrap: skip to the start of the ring
+        reclaim(head + left);
+        if (left >= sizeof(CaptureRecordHeader))
+        {
+            const CaptureRecordHeader padding{static_cast<uint32_t>(left - sizeof(CaptureRecordHeader)),
+                                              static_cast<uint16_t>(CaptureKind::Padding), 0, kCaptureNoClient, 0};
+            std::memcpy(ring + head % capacity, &padding, sizeof(padding));
+        }
+        head += left;
+        header->head.store(head, std::memory_order_release);
+    }
+
+    reclaim(head + length);
+    const uint64_t elapsed = ticks > startTicks ? TraceClock::toNanos(ticks - startTicks) : 0;
+    const CaptureRecordHeader record{static_cast<uint32_t>(size), static_cast<uint16_t>(kind), 0, client, elapsed};
+    uint8_t* at = ring + head % capacity;
+    std::memcpy(at, &record, sizeof(record));
+    if (size > 0)
+    {
+        std::memcpy(at + sizeof(record), data, size);
+    }
+    header->head.store(head + length, std::memory_order_release);
+}
+
+void CaptureWriter::reclaim(uint64_t end)
+{
+    uint64_t tail = header->tail.load(std::memory_order_relaxed);
+    if (end - tail <= capacity)
+    {
+        return;
+    }
+    while (end - tail > capacity)
+    {
+        tail = recordEnd(ring, capacity, tail);
+    }
+    // Published before the bytes are overwritten, so a reader that sees the old tail after its
+    // copy knows the copy may be torn
+    header->tail.store(tail, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+bool readCaptureFile(const std::string& path, CaptureFile& file, std::string& error)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string bytes;
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    uint64_t start = 0;
+    for (int attempt = 0;; ++attempt)
+    {
+        in.clear();
+        in.seekg(0, std::ios::end);
+        bytes.resize(static_cast<size_t>(std::max<std::streamoff>(0, in.tellg())));
+        in.seekg(0);
+        in.read(&bytes[0], static_cast<std::streamsize>(bytes.size()));
+        if (bytes.size() < kHeaderSize || std::memcmp(bytes.data(), kMagic, sizeof(kMagic)) != 0)
+        {
+            error = path + " is not a capture file";
+            return false;
+        }
+        // Plain copies of the fields; the atomics are only read through their object representation
+        const auto* header = reinterpret_cast<const CaptureFileHeader*>(bytes.data());
+        const size_t tailAt = offsetof(CaptureFileHeader, tail);
+        std::memcpy(&head, bytes.data() + offsetof(CaptureFileHeader, head), sizeof(head));
+        std::memcpy(&tail, bytes.data() + tailAt, sizeof(tail));
+        if (header->version != kVersion || header->headerSize != kHeaderSize || header->capacity == 0 ||
+            bytes.size() < kHeaderSize + header->capacity || head < tail || head - tail > header->capacity)
+        {
+            error = path + " has an unsupported or damaged header";
+            return false;
+        }
+        // The copy raced the writer if it is still running. The writer moves tail before it
+        // overwrites anything, so the tail as it is now marks the oldest record the copy holds
+        // intact; a writer that lapped the whole ring meanwhile means trying again.
+        uint64_t settledTail = tail;
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(tailAt));
+        in.read(reinterpret_cast<char*>(&settledTail), sizeof(settledTail));
+        start = std::max(tail, settledTail);
+        if (start < head || head == tail || attempt == kReadAttempts)
+        {
+            start = std::min(start, head);
+            break;
+        }
+    }
+
+    const auto* header = reinterpret_cast<const CaptureFileHeader*>(bytes.data());
+    const uint64_t capacity = header->capacity;
+    file = CaptureFile();
+    file.startUnixNanos = header->startUnixNanos;
+    file.remoteIp.assign(header->remoteIp, strnlen(header->remoteIp, sizeof(header->remoteIp)));
+    file.remotePort = static_cast<int>(header->remotePort);
+    file.listenPort = static_cast<int>(header->listenPort);
+    file.overwrittenBytes = start;
+
+    const auto* ring = reinterpret_cast<const uint8_t*>(bytes.data()) + kHeaderSize;
+    for (uint64_t offset = start; offset < head;)
+    {
+        const uint64_t end = recordEnd(ring, capacity, offset);
+        if (end > head || end <= offset)
+        {
+            error = path + ": record at offset " + std::to_string(offset) + " runs past the head";
+            return false;
+        }
+        const uint64_t position = offset % capacity;
+        if (capacity - position >= sizeof(CaptureRecordHeader))
+        {
+            CaptureRecordHeader raw;
+            std::memcpy(&raw, ring + position, sizeof(raw));
+            if (static_cast<CaptureKind>(raw.kind) != CaptureKind::Padding)
+            {
+                CaptureRecord record;
+                record.kind = static_cast<CaptureKind>(raw.kind);
+                record.client = raw.client;
+                record.nanos = raw.nanos;
+                record.payload.assign(reinterpret_cast<const char*>(ring + position + sizeof(raw)), raw.size);
+                file.records.push_back(std::move(record));
+            }
+        }
+        offset = end;
+    }
+    return true;
+}
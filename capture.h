@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Traffic capture into a memory-mapped ring file. The bridge's loop thread appends records
+// with a memcpy into pages populated up front, so capturing costs no system call and never
+// waits for the disk; the kernel writes the pages back on its own schedule. When the ring is
+// full the oldest records are overwritten. A reader may open the file while it is written
+// and keeps only the records the writer had not reclaimed by the end of its copy.
+//
+// File layout: a 4 KiB CaptureFileHeader, then capacity bytes of 8-byte aligned records, each
+// a CaptureRecordHeader followed by its payload. head and tail count bytes ever written, so
+// a record at logical offset o sits at data + o % capacity; a record never wraps, the gap
+// before the end of the ring is skipped instead (as a Padding record when one fits).
+
+enum class CaptureKind : uint16_t
+{
+    Padding = 0,
+    ClientToDevice = 1, // payload read from a client
+    DeviceToClient = 2, // payload read from the device
+    ClientOpen = 3,     // payload is the peer address
+    ClientClose = 4,
+    LinkUp = 5,
+    LinkDown = 6,
+};
+
+const char* captureKindName(CaptureKind kind);
+
+struct CaptureRecordHeader
+{
+    uint32_t size;    // payload bytes
+    uint16_t kind;    // CaptureKind
+    uint16_t reserved;
+    uint64_t client;  // accept order of the client, kCaptureNoClient when not tied to one
+    uint64_t nanos;   // since the capture started
+};
+
+constexpr uint64_t kCaptureNoClient = ~uint64_t(0);
+
+struct CaptureFileHeader
+{
+    char magic[8]; // "TBCAP1\0\0"
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t capacity;
+    std::atomic<uint64_t> head; // end of the newest record
+    std::atomic<uint64_t> tail; // start of the oldest record still intact
+    int64_t startUnixNanos;     // wall clock at nanos == 0
+    uint32_t listenPort;
+    uint32_t remotePort;
+    char remoteIp[64];
+};
+
+class CaptureWriter
+{
+public:
+    CaptureWriter() = default;
+    ~CaptureWriter();
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    // Create (or replace) path with a ring of capacity bytes; false where mmap is unavailable
+    bool open(const std::string& path, size_t capacity, const std::string& remoteIp, int remotePort, int listenPort);
+
+    bool isOpen() const { return header != nullptr; }
+
+    // ticks: TraceClock reading the bytes were read at. Loop thread only.
+    void record(CaptureKind kind, uint64_t client, uint64_t ticks, const uint8_t* data = nullptr, size_t size = 0);
+
+private:
+    CaptureFileHeader* header = nullptr;
+    uint8_t* ring = nullptr;
+    size_t mappedBytes = 0;
+    uint64_t capacity = 0;
+    uint64_t startTicks = 0;
+
+    // Move tail past the records that [head, end) is about to overwrite
+    void reclaim(uint64_t end);
+    uint64_t recordLengthAt(uint64_t offset) const;
+};
+
+struct CaptureRecord
+{
+    CaptureKind kind = CaptureKind::Padding;
+    uint64_t client = kCaptureNoClient;
+    uint64_t nanos = 0;
+    std::string payload;
+};
+
+struct CaptureFile
+{
+    int64_t startUnixNanos = 0;
+    std::string remoteIp;
+    int remotePort = 0;
+    int listenPort = 0;
+    uint64_t overwrittenBytes = 0; // lost to the ring wrapping before the oldest record kept
+    std::vector<CaptureRecord> records;
+};
+
+// Read every intact record, oldest first
+bool readCaptureFile(const std::string& path, CaptureFile& file, std::string& error);
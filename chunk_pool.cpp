@@ -0,0 +1,254 @@
+#include "chunk_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+constexpr size_t kChunksPerSlab = 16;  // 256 KiB per slab
+constexpr size_t kLocalLimit = 128;    // chunks a thread keeps before spilling half of them
+
+std::mutex gSharedMutex;
+ChunkPool::Chunk* gShared = nullptr;
+std::atomic<size_t> gReserved{0};
+
+// Plain thread_locals stay usable while other thread_local objects are destroyed
+thread_local ChunkPool::Chunk* tFree = nullptr;
+thread_local size_t tFreeCount = 0;
+thread_local bool tExited = false;
+
+void pushShared(ChunkPool::Chunk* first, ChunkPool::Chunk* last)
+{
+    std::lock_guard<std::mutex> lock(gSharedMutex);
+    last->next = gShared;
+    gShared = first;
+}
+
+struct LocalListGuard
+{
+    ~LocalListGuard()
+    {
+        tExited = true;
+        if (!tFree)
+        {
+            return;
+        }
+        ChunkPool::Chunk* last = tFree;
+        while (last->next)
+        {
+            last = last->next;
+        }
+        pushShared(tFree, last);
+        tFree = nullptr;
+        tFreeCount = 0;
+    }
+};
+
+thread_local LocalListGuard tGuard;
+
+void refill()
+{
+    {
+        // Take back up to a slab's worth from the shared list first
+        std::lock_guard<std::mutex> lock(gSharedMutex);
+        for (size_t i = 0; i < kChunksPerSlab && gShared; ++i)
+        {
+            ChunkPool::Chunk* chunk = gShared;
+            gShared = chunk->next;
+            chunk->next = tFree;
+            tFree = chunk;
+            ++tFreeCount;
+        }
+    }
+    if (tFree)
+    {
+        return;
+    }
+    auto* slab = new ChunkPool::Chunk[kChunksPerSlab];
+    gReserved += sizeof(ChunkPool::Chunk) * kChunksPerSlab;
+    for (size_t i = 0; i < kChunksPerSlab; ++i)
+    {
+        slab[i].next = tFree;
+        tFree = &slab[i];
+    }
+    tFreeCount += kChunksPerSlab;
+}
+
+} // namespace
+
+ChunkPool::Chunk* ChunkPool::take()
+{
+    (void)tGuard; // registers the exit hook for this thread
+    if (!tFree)
+    {
+        refill();
+    }
+    Chunk* chunk = tFree;
+    tFree = chunk->next;
+    --tFreeCount;
+    chunk->next = nullptr;
+    return chunk;
+}
+
+void ChunkPool::give(Chunk* chunk)
+{
+    if (tExited)
+    {
+        pushShared(chunk, chunk);
+        return;
+    }
+    chunk->next = tFree;
+    tFree = chunk;
+    if (++tFreeCount <= kLocalLimit)
+    {
+        return;
+    }
+    // A burst has passed: hand half of the list to threads that may need it
+    Chunk* first = tFree;
+    Chunk* last = first;
+    for (size_t i = 1; i < kLocalLimit / 2; ++i)
+    {
+        last = last->next;
+    }
+    tFree = last->next;
+    tFreeCount -= kLocalLimit / 2;
+    pushShared(first, last);
+}
+
+size_t ChunkPool::reservedBytes()
+{
+    return gReserved;
+}
+
+ChunkRef::ChunkRef(const ChunkRef& other) : chunk(other.chunk)
+{
+    if (chunk)
+    {
+        chunk->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+ChunkRef::ChunkRef(ChunkRef&& other) noexcept : chunk(other.chunk)
+{
+    other.chunk = nullptr;
+}
+
+ChunkRef& ChunkRef::operator=(ChunkRef other) noexcept
+{
+    std::swap(chunk, other.chunk);
+    return *this;
+}
+
+ChunkRef::~ChunkRef()
+{
+    reset();
+}
+
+ChunkRef ChunkRef::acquire()
+{
+    ChunkRef ref;
+    ref.chunk = ChunkPool::take();
+    ref.chunk->refs.store(1, std::memory_order_relaxed);
+    return ref;
+}
+
+void ChunkRef::reset()
+{
+    if (chunk && chunk->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        ChunkPool::give(chunk);
+    }
+    chunk = nullptr;
+}
+
+bool ChunkQueue::append(const uint8_t* data, size_t size, const ChunkStamp& stamp)
+{
+    // Room needed beyond what the newest span's chunk can still take
+    Span* tail = spans.back();
+    const size_t room = tail && tail->chunk.unique() ? ChunkRef::capacity() - tail->end : 0;
+    const size_t extra = size > room ? (size - room + ChunkRef::capacity() - 1) / ChunkRef::capacity() : 0;
+    if (spans.size() + extra > kMaxSpans)
+    {
+        return false;
+    }
+    while (size > 0)
+    {
+        tail = spans.back();
+        if (!tail || !tail->chunk.unique() || tail->end == ChunkRef::capacity())
+        {
+            spans.push(Span{ChunkRef::acquire(), 0, 0, stamp, 0});
+            tail = spans.back();
+        }
+        if (tail->stamp.ticks == 0)
+        {
+            tail->stamp = stamp;
+        }
+        const size_t n = std::min(size, ChunkRef::capacity() - tail->end);
+        std::memcpy(tail->chunk.data() + tail->end, data, n);
+        tail->end += n;
+        tail->length += n;
+        bytes += n;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool ChunkQueue::append(const ChunkRef& chunk, size_t offset, size_t size, const ChunkStamp& stamp)
+{
+    if (size < ChunkRef::capacity() / 2)
+    {
+        // Pinning a whole chunk for a few bytes would let small reads inflate the queue
+        return append(chunk.data() + offset, size, stamp);
+    }
+    if (!spans.push(Span{chunk, offset, offset + size, stamp, size}))
+    {
+        return false;
+    }
+    bytes += size;
+    return true;
+}
+
+const uint8_t* ChunkQueue::front(size_t& size)
+{
+    Span* span = spans.front();
+    if (!span)
+    {
+        size = 0;
+        return nullptr;
+    }
+    size = span->end - span->begin;
+    return span->chunk.data() + span->begin;
+}
+
+int ChunkQueue::gather(NetIoVec* vecs, int max)
+{
+    int count = 0;
+    while (count < max)
+    {
+        Span* span = spans.peek(static_cast<size_t>(count));
+        if (!span)
+        {
+            break;
+        }
+        vecs[count].data = span->chunk.data() + span->begin;
+        vecs[count].size = span->end - span->begin;
+        ++count;
+    }
+    return count;
+}
+
+void ChunkQueue::consume(size_t size)
+{
+    consume(size, [](const ChunkStamp&, size_t) {});
+}
+
+void ChunkQueue::clear()
+{
+    while (spans.front())
+    {
+        spans.pop();
+    }
+    bytes = 0;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "net_io.h"
+#include "fixed_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-size I/O chunks carved out of slabs. Every thread keeps its own free list, so taking
+// and returning a chunk is a few pointer moves without a lock; a list that grows past its
+// limit (or belongs to an exiting thread) spills into a shared list. Slabs are never handed
+// back to the allocator, so steady-state forwarding never goes to the heap for buffers.
+class ChunkPool
+{
+public:
+    static constexpr size_t kChunkSize = 16 * 1024;
+
+    struct Chunk
+    {
+        std::atomic<uint32_t> refs{0};
+        Chunk* next = nullptr;
+        alignas(64) uint8_t data[kChunkSize];
+    };
+
+    static Chunk* take();
+    static void give(Chunk* chunk);
+
+    // Bytes of chunk memory obtained from the allocator so far
+    static size_t reservedBytes();
+};
+
+// Shared handle to a pooled chunk; the chunk goes back to the pool with its last handle.
+class ChunkRef
+{
+public:
+    ChunkRef() = default;
+    ChunkRef(const ChunkRef& other);
+    ChunkRef(ChunkRef&& other) noexcept;
+    ChunkRef& operator=(ChunkRef other) noexcept;
+    ~ChunkRef();
+
+    // A fresh chunk with a reference count of one
+    static ChunkRef acquire();
+
+    void reset();
+
+    explicit operator bool() const { return chunk != nullptr; }
+    uint8_t* data() const { return chunk->data; }
+    static constexpr size_t capacity() { return ChunkPool::kChunkSize; }
+
+    // Only the holder of the sole reference may write into the chunk
+    bool unique() const { return chunk && chunk->refs.load(std::memory_order_acquire) == 1; }
+
+private:
+    ChunkPool::Chunk* chunk = nullptr;
+};
+
+// Where queued bytes came from and when they entered the bridge (TraceClock ticks, 0 = untraced)
+struct ChunkStamp
+{
+    uint64_t ticks = 0;
+    uint64_t client = 0;
+};
+
+// Byte FIFO built from pooled chunks, stored as spans in a bounded ring: the socket reader
+// appends, the socket writer consumes. Appending a chunk that was read into shares it instead
+// of copying; an empty queue holds no chunks, so idle connections pin no buffer memory. Loop
+// thread only: a copy may grow the newest span in place.
+class ChunkQueue
+{
+public:
+    // Shared spans are at least half a chunk, so the ring always holds this many bytes
+    static constexpr size_t kMaxSpans = 128;
+    static constexpr size_t kMinCapacity = kMaxSpans * ChunkPool::kChunkSize / 2;
+
+    bool empty() const { return bytes == 0; }
+    size_t size() const { return bytes; }
+
+    // Copy bytes in, filling the spare room of the last chunk first; the grown span keeps its
+    // older stamp. false when the span ring is full; nothing is queued then.
+    bool append(const uint8_t* data, size_t size, const ChunkStamp& stamp = {});
+
+    // Queue size bytes of chunk starting at offset without copying (small spans are copied)
+    bool append(const ChunkRef& chunk, size_t offset, size_t size, const ChunkStamp& stamp = {});
+
+    // Contiguous bytes at the front (size is set, nullptr when empty)
+    const uint8_t* front(size_t& size);
+
+    // Describe up to max spans from the front for one gather write; returns the count
+    int gather(NetIoVec* vecs, int max);
+
+    // Drop size bytes from the front, releasing chunks that were fully consumed
+    void consume(size_t size);
+
+    // Same, calling done(stamp, bytes) for every span that has now left the queue entirely
+    template <typename Done>
+    void consume(size_t size, Done&& done);
+
+    void clear();
+
+private:
+    struct Span
+    {
+        ChunkRef chunk;
+        size_t begin = 0;
+        size_t end = 0;
+        ChunkStamp stamp;
+        size_t length = 0; // bytes ever appended, for the done callback
+    };
+
+    FixedRing<Span, kMaxSpans> spans;
+    size_t bytes = 0;
+};
+
+template <typename Done>
+void ChunkQueue::consume(size_t size, Done&& done)
+{
+    bytes -= std::min(size, bytes);
+    while (size > 0)
+    {
+        Span* span = spans.front();
+        if (!span)
+        {
+            break;
+        }
+        const size_t n = std::min(size, span->end - span->begin);
+        span->begin += n;
+        size -= n;
+        if (span->begin == span->end)
+        {
+            done(span->stamp, span->length);
+            spans.pop();
+        }
+    }
+}
@@ -1,26 +1,55 @@
+// Device fleet simulator: every address x port pair is one device (127.0.0.2-127.0.0.101 on
+// 9100 gives a hundred of them), all served by a few event loop threads. Each accepted
+// connection echoes what it receives, shaped by the device behaviours a bridge host meets in
+// the field:
+//   --latency-ms M[:J]     answer M ms (+- J ms jitter) after the request arrived
+//   --bandwidth B          send at most B bytes/s per connection
+//   --stall-every MS --stall-for MS
+//                          stop reading for a while, so the receive window fills up
+//   --mtbf-s S             drop the connection after an exponential time with mean S (--rst: abort it)
+//   --telemetry-ms MS [--telemetry-bytes N]
+//                          push an unsolicited line every MS, independent of requests
+// With none of them it is a plain echo fleet; a connection never waits for another.
+#include "event_loop.h"
+#include "net_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <random>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
-#include <cstring>
 
 #ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #pragma comment(lib, "ws2_32.lib")
-using socklen_arg = int;
 #else
 #include <arpa/inet.h>
+#include <cerrno>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <unistd.h>
-using SOCKET = int;
-constexpr SOCKET INVALID_SOCKET = -1;
-constexpr int SOCKET_ERROR = -1;
-using socklen_arg = socklen_t;
 #endif
 
 namespace {
 
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kReadSize = 16 * 1024;
+constexpr size_t kMaxBacklog = 256 * 1024; // a device stops reading with this much unanswered
+
+std::atomic<bool> gStop{false};
+
 bool initSockets()
 {
 #ifdef _WIN32
@@ -46,7 +75,7 @@ void cleanupSockets()
 #endif
 }
 
-void closeSocket(SOCKET s)
+void closeSocket(SOCKET_T s)
 {
 #ifdef _WIN32
     closesocket(s);
@@ -55,70 +84,621 @@ void closeSocket(SOCKET s)
 #endif
 }
 
-} // namespace
+bool wouldBlock()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
 
-int main()
+struct Options
 {
-    const int listenPort = 5000; // Match remotePort in the bridge config
-    if (!initSockets())
+    std::vector<std::string> addresses = {"0.0.0.0"};
+    std::vector<int> ports = {5000}; // matches remotePort in the default bridge config
+    unsigned threads = 1;
+    int latencyMs = 0;
+    int jitterMs = 0;
+    double bandwidth = 0; // bytes/s per connection, 0 = unlimited
+    int stallEveryMs = 0;
+    int stallForMs = 0;
+    double mtbfSeconds = 0;
+    bool reset = false;
+    int telemetryMs = 0;
+    size_t telemetryBytes = 64;
+    double durationSeconds = 0;
+    int reportSeconds = 5;
+    bool verbose = false;
+};
+
+struct FleetStats
+{
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> active{0};
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> dropped{0}; // connections cut by --mtbf-s
+    std::atomic<uint64_t> stalls{0};
+    std::atomic<uint64_t> telemetry{0};
+};
+
+// One event loop and the devices (listeners) and connections it owns
+class Worker
+{
+public:
+    Worker(const Options& opts, FleetStats& fleetStats, unsigned index)
+        : options(opts), stats(fleetStats), rng(std::random_device{}() + index)
     {
-        return 1;
     }
 
-    SOCKET server = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (server == INVALID_SOCKET)
+    bool listenOn(const std::string& address, int port)
     {
-        std::cerr << "Failed to create socket\n";
-        cleanupSockets();
-        return 1;
+        SOCKET_T sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == INVALID_SOCKET_T)
+        {
+            return false;
+        }
+        int one = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        inet_pton(AF_INET, address.c_str(), &addr.sin_addr);
+        if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(sock, 1024) != 0)
+        {
+            std::cerr << "cannot listen on " << address << ":" << port << "\n";
+            closeSocket(sock);
+            return false;
+        }
+        SetSocketNonBlocking(sock, true);
+        const std::string name = address + ":" + std::to_string(port);
+        loop.add(sock, [this, sock, name](uint32_t) { acceptAll(sock, name); });
+        listeners.push_back(sock);
+        return true;
     }
 
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(listenPort);
-    addr.sin_addr.s_addr = INADDR_ANY;
-    if (bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR)
+    void start()
     {
-        std::cerr << "bind failed\n";
-        closeSocket(server);
-        cleanupSockets();
-        return 1;
+        loop.startThread();
     }
 
-    if (listen(server, 2) == SOCKET_ERROR)
+    void stop()
+    {
+        loop.stop();
+        for (auto& entry : sessions)
+        {
+            closeSocket(entry.first);
+        }
+        for (SOCKET_T sock : listeners)
+        {
+            closeSocket(sock);
+        }
+    }
+
+private:
+    struct Reply
+    {
+        Clock::time_point due;
+        std::string data;
+    };
+
+    struct Session
+    {
+        SOCKET_T sock = INVALID_SOCKET_T;
+        std::string device;
+        std::deque<Reply> delayed;   // answers waiting out the response latency
+        std::string out;             // due bytes the socket has not taken yet
+        size_t outOffset = 0;
+        size_t backlog = 0;          // bytes received but not yet sent back
+        double tokens = 0;           // bandwidth bucket
+        Clock::time_point refilled;
+        bool stalled = false;
+        uint64_t telemetrySeq = 0;
+        EventLoop::TimerId replyTimer = 0;
+        EventLoop::TimerId paceTimer = 0;
+        EventLoop::TimerId stallTimer = 0;
+        EventLoop::TimerId dropTimer = 0;
+        EventLoop::TimerId telemetryTimer = 0;
+    };
+
+    const Options& options;
+    FleetStats& stats;
+    std::mt19937 rng;
+    EventLoop loop;
+    std::vector<SOCKET_T> listeners;
+    std::unordered_map<SOCKET_T, std::unique_ptr<Session>> sessions;
+
+    std::chrono::milliseconds randomMs(double meanMs)
+    {
+        return std::chrono::milliseconds(static_cast<int64_t>(std::exponential_distribution<double>(1.0 / meanMs)(rng)));
+    }
+
+    void acceptAll(SOCKET_T listener, const std::string& device)
+    {
+        while (true)
+        {
+            const SOCKET_T sock = accept(listener, nullptr, nullptr);
+            if (sock == INVALID_SOCKET_T)
+            {
+                return;
+            }
+            SetSocketNonBlocking(sock, true);
+            auto session = std::make_unique<Session>();
+            Session* s = session.get();
+            s->sock = sock;
+            s->device = device;
+            s->refilled = Clock::now();
+            s->tokens = burst();
+            sessions[sock] = std::move(session);
+            if (!loop.add(sock, [this, s](uint32_t events) { onEvent(*s, events); }))
+            {
+                sessions.erase(sock);
+                closeSocket(sock);
+                continue;
+            }
+            ++stats.accepted;
+            ++stats.active;
+            if (options.verbose)
+            {
+                std::cout << device << ": connected" << std::endl;
+            }
+            if (options.stallEveryMs > 0 && options.stallForMs > 0)
+            {
+                // Random phase, so the fleet does not stall in lockstep
+                const int phase = std::uniform_int_distribution<int>(0, options.stallEveryMs)(rng);
+                s->stallTimer = loop.runAfter(std::chrono::milliseconds(phase), [this, s] { beginStall(*s); });
+            }
+            if (options.mtbfSeconds > 0)
+            {
+                s->dropTimer = loop.runAfter(randomMs(options.mtbfSeconds * 1000), [this, s] {
+                    s->dropTimer = 0;
+                    ++stats.dropped;
+                    closeSession(*s, options.reset);
+                });
+            }
+            if (options.telemetryMs > 0)
+            {
+                s->telemetryTimer = loop.runAfter(std::chrono::milliseconds(options.telemetryMs), [this, s] { sendTelemetry(*s); });
+            }
+        }
+    }
+
+    void onEvent(Session& s, uint32_t events)
+    {
+        const SOCKET_T sock = s.sock;
+        if (events & EvWrite)
+        {
+            flush(s);
+        }
+        if (sessions.count(sock) && (events & (EvRead | EvClosed)))
+        {
+            readAll(s);
+        }
+    }
+
+    void readAll(Session& s)
+    {
+        const SOCKET_T sock = s.sock;
+        char buffer[kReadSize];
+        while (!s.stalled && s.backlog < kMaxBacklog)
+        {
+            const int n = ::recv(s.sock, buffer, static_cast<int>(sizeof(buffer)), 0);
+            if (n > 0)
+            {
+                stats.bytesIn += static_cast<uint64_t>(n);
+                if (options.verbose)
+                {
+                    std::cout << s.device << " recv: " << std::string(buffer, buffer + n) << std::endl;
+                }
+                respond(s, std::string(buffer, buffer + n));
+                if (!sessions.count(sock))
+                {
+                    return; // a failed send closed it
+                }
+                continue;
+            }
+            if (n < 0 && wouldBlock())
+            {
+                return;
+            }
+            closeSession(s, false);
+            return;
+        }
+    }
+
+    void respond(Session& s, std::string data)
+    {
+        s.backlog += data.size();
+        if (options.latencyMs <= 0 && options.jitterMs <= 0)
+        {
+            s.out += data;
+            flush(s);
+            return;
+        }
+        int delay = options.latencyMs;
+        if (options.jitterMs > 0)
+        {
+            delay += std::uniform_int_distribution<int>(-options.jitterMs, options.jitterMs)(rng);
+        }
+        // Never overtake an earlier answer, or the stream would be reordered
+        Clock::time_point due = Clock::now() + std::chrono::milliseconds(std::max(0, delay));
+        if (!s.delayed.empty())
+        {
+            due = std::max(due, s.delayed.back().due);
+        }
+        s.delayed.push_back(Reply{due, std::move(data)});
+        if (s.delayed.size() == 1)
+        {
+            armReply(s);
+        }
+    }
+
+    void armReply(Session& s)
+    {
+        const auto wait = std::chrono::ceil<std::chrono::milliseconds>(s.delayed.front().due - Clock::now());
+        s.replyTimer = loop.runAfter(std::max(wait, std::chrono::milliseconds(0)), [this, &s] {
+            s.replyTimer = 0;
+            const auto now = Clock::now();
+            while (!s.delayed.empty() && s.delayed.front().due <= now)
+            {
+                s.out += s.delayed.front().data;
+                s.delayed.pop_front();
+            }
+            if (!s.delayed.empty())
+            {
+                armReply(s);
+            }
+            flush(s);
+        });
+    }
+
+    double burst() const
+    {
+        // About 20 ms worth, and never less than one segment
+        return options.bandwidth > 0 ? std::max(options.bandwidth / 50, 1460.0) : 0;
+    }
+
+    void flush(Session& s)
+    {
+        if (s.paceTimer)
+        {
+            return; // the bandwidth cap resumes sending
+        }
+        while (s.outOffset < s.out.size())
+        {
+            size_t allowed = s.out.size() - s.outOffset;
+            if (options.bandwidth > 0)
+            {
+                const auto now = Clock::now();
+                s.tokens = std::min(burst(), s.tokens + options.bandwidth * std::chrono::duration<double>(now - s.refilled).count());
+                s.refilled = now;
+                if (s.tokens < 1)
+                {
+                    const auto wait = std::chrono::milliseconds(std::max(1, static_cast<int>(1000.0 * (1 - s.tokens) / options.bandwidth)));
+                    s.paceTimer = loop.runAfter(wait, [this, &s] {
+                        s.paceTimer = 0;
+                        flush(s);
+                    });
+                    return;
+                }
+                allowed = std::min(allowed, static_cast<size_t>(s.tokens));
+            }
+            const int n = ::send(s.sock, s.out.data() + s.outOffset, static_cast<int>(allowed), 0);
+            if (n > 0)
+            {
+                s.outOffset += static_cast<size_t>(n);
+                s.tokens -= options.bandwidth > 0 ? n : 0;
+                stats.bytesOut += static_cast<uint64_t>(n);
+                sent(s, static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && wouldBlock())
+            {
+                loop.watchWrite(s.sock, true);
+                return;
+            }
+            closeSession(s, false);
+            return;
+        }
+        s.out.clear();
+        s.outOffset = 0;
+        loop.watchWrite(s.sock, false);
+    }
+
+    void sent(Session& s, size_t bytes)
+    {
+        // Telemetry bytes are not part of the backlog; the counter only has to stay sane
+        const bool wasFull = s.backlog >= kMaxBacklog;
+        s.backlog -= std::min(bytes, s.backlog);
+        if (wasFull && s.backlog < kMaxBacklog)
+        {
+            loop.post([this, sock = s.sock] { resume(sock); });
+        }
+    }
+
+    void resume(SOCKET_T sock)
+    {
+        auto it = sessions.find(sock);
+        if (it != sessions.end())
+        {
+            readAll(*it->second);
+        }
+    }
+
+    void beginStall(Session& s)
+    {
+        s.stalled = true;
+        ++stats.stalls;
+        s.stallTimer = loop.runAfter(std::chrono::milliseconds(options.stallForMs), [this, &s] {
+            s.stalled = false;
+            s.stallTimer = loop.runAfter(std::chrono::milliseconds(options.stallEveryMs), [this, &s] { beginStall(s); });
+            // Edges that came in while stalled are gone; read what piled up
+            readAll(s);
+        });
+    }
+
+    void sendTelemetry(Session& s)
+    {
+        std::string line = "TELEMETRY " + s.device + " seq=" + std::to_string(s.telemetrySeq++);
+        if (line.size() + 1 < options.telemetryBytes)
+        {
+            line.append(options.telemetryBytes - line.size() - 1, ' ');
+        }
+        line += '\n';
+        s.out += line;
+        ++stats.telemetry;
+        s.telemetryTimer = loop.runAfter(std::chrono::milliseconds(options.telemetryMs), [this, &s] { sendTelemetry(s); });
+        flush(s);
+    }
+
+    void closeSession(Session& s, bool reset)
+    {
+        for (EventLoop::TimerId* timer : {&s.replyTimer, &s.paceTimer, &s.stallTimer, &s.dropTimer, &s.telemetryTimer})
+        {
+            loop.cancelTimer(*timer);
+        }
+#ifdef SO_LINGER
+        if (reset)
+        {
+            // Zero linger turns the close into an RST, like a device losing power mid-stream
+            linger abort{1, 0};
+            setsockopt(s.sock, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&abort), sizeof(abort));
+        }
+#endif
+        if (options.verbose)
+        {
+            std::cout << s.device << ": closed" << std::endl;
+        }
+        const SOCKET_T sock = s.sock;
+        loop.remove(sock);
+        closeSocket(sock);
+        --stats.active;
+        sessions.erase(sock);
+    }
+};
+
+std::vector<int> parsePorts(const std::string& spec)
+{
+    // "9100", "9100-9103" or "9100,9200"
+    std::vector<int> ports;
+    size_t begin = 0;
+    while (begin < spec.size())
+    {
+        size_t end = spec.find(',', begin);
+        end = end == std::string::npos ? spec.size() : end;
+        const std::string item = spec.substr(begin, end - begin);
+        const size_t dash = item.find('-');
+        const int first = std::atoi(item.c_str());
+        const int last = dash == std::string::npos ? first : std::atoi(item.c_str() + dash + 1);
+        for (int port = first; port <= last && port > 0; ++port)
+        {
+            ports.push_back(port);
+        }
+        begin = end + 1;
+    }
+    return ports;
+}
+
+std::vector<std::string> parseAddresses(const std::string& spec)
+{
+    // "127.0.0.2", "127.0.0.2-127.0.0.101" (last octet range) or a comma list of either
+    std::vector<std::string> addresses;
+    size_t begin = 0;
+    while (begin < spec.size())
+    {
+        size_t end = spec.find(',', begin);
+        end = end == std::string::npos ? spec.size() : end;
+        const std::string item = spec.substr(begin, end - begin);
+        const size_t dash = item.find('-');
+        if (dash == std::string::npos)
+        {
+            addresses.push_back(item);
+        }
+        else
+        {
+            const std::string first = item.substr(0, dash);
+            const std::string last = item.substr(dash + 1);
+            const size_t dot = first.rfind('.');
+            const int from = std::atoi(first.c_str() + dot + 1);
+            const int to = std::atoi(last.c_str() + last.rfind('.') + 1);
+            for (int octet = from; octet <= to && octet < 256; ++octet)
+            {
+                addresses.push_back(first.substr(0, dot + 1) + std::to_string(octet));
+            }
+        }
+        begin = end + 1;
+    }
+    return addresses;
+}
+
+void usage()
+{
+    std::cerr << "device_server [options]\n"
+                 "  --addrs A[-B][,C]       listen addresses, last-octet ranges allowed (default 0.0.0.0)\n"
+                 "  --ports P[-Q][,R]       listen ports (default 5000); every address x port is a device\n"
+                 "  --threads N             event loop threads (default 1)\n"
+                 "  --latency-ms M[:J]      answer after M ms, +- J ms jitter\n"
+                 "  --bandwidth B           per-connection send cap in bytes/s\n"
+                 "  --stall-every MS --stall-for MS  stop reading periodically\n"
+                 "  --mtbf-s S [--rst]      drop connections after exp(S) seconds, RST with --rst\n"
+                 "  --telemetry-ms MS [--telemetry-bytes N]  unsolicited push every MS\n"
+                 "  --duration S            exit after S seconds (default: until SIGINT)\n"
+                 "  --report-s S            fleet statistics every S seconds (default 5, 0 = off)\n"
+                 "  --verbose               print every message, like the single-client demo did\n";
+}
+
+bool parseArgs(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--addrs" && hasValue)
+        {
+            options.addresses = parseAddresses(argv[++i]);
+        }
+        else if (arg == "--ports" && hasValue)
+        {
+            options.ports = parsePorts(argv[++i]);
+        }
+        else if (arg == "--threads" && hasValue)
+        {
+            options.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--latency-ms" && hasValue)
+        {
+            const std::string value = argv[++i];
+            options.latencyMs = std::atoi(value.c_str());
+            const size_t colon = value.find(':');
+            options.jitterMs = colon == std::string::npos ? 0 : std::atoi(value.c_str() + colon + 1);
+        }
+        else if (arg == "--bandwidth" && hasValue)
+        {
+            options.bandwidth = std::atof(argv[++i]);
+        }
+        else if (arg == "--stall-every" && hasValue)
+        {
+            options.stallEveryMs = std::atoi(argv[++i]);
+        }
+        else if (arg == "--stall-for" && hasValue)
+        {
+            options.stallForMs = std::atoi(argv[++i]);
+        }
+        else if (arg == "--mtbf-s" && hasValue)
+        {
+            options.mtbfSeconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--rst")
+        {
+            options.reset = true;
+        }
+        else if (arg == "--telemetry-ms" && hasValue)
+        {
+            options.telemetryMs = std::atoi(argv[++i]);
+        }
+        else if (arg == "--telemetry-bytes" && hasValue)
+        {
+            options.telemetryBytes = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--duration" && hasValue)
+        {
+            options.durationSeconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--report-s" && hasValue)
+        {
+            options.reportSeconds = std::atoi(argv[++i]);
+        }
+        else if (arg == "--verbose")
+        {
+            options.verbose = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return !options.addresses.empty() && !options.ports.empty();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseArgs(argc, argv, options))
+    {
+        usage();
+        return 2;
+    }
+    if (!initSockets())
     {
-        std::cerr << "listen failed\n";
-        closeSocket(server);
-        cleanupSockets();
         return 1;
     }
+    std::signal(SIGINT, [](int) { gStop = true; });
+    std::signal(SIGTERM, [](int) { gStop = true; });
+#ifndef _WIN32
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
 
-    std::cout << "Device server listening on port " << listenPort << std::endl;
-    sockaddr_in clientAddr{};
-    socklen_arg len = sizeof(clientAddr);
-    SOCKET client = accept(server, reinterpret_cast<sockaddr*>(&clientAddr), &len);
-    if (client == INVALID_SOCKET)
+    FleetStats stats;
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (unsigned i = 0; i < options.threads; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>(options, stats, i));
+    }
+    size_t devices = 0;
+    for (const std::string& address : options.addresses)
+    {
+        for (int port : options.ports)
+        {
+            if (workers[devices % workers.size()]->listenOn(address, port))
+            {
+                ++devices;
+            }
+        }
+    }
+    if (devices == 0)
     {
-        std::cerr << "accept failed\n";
-        closeSocket(server);
         cleanupSockets();
         return 1;
     }
+    for (auto& worker : workers)
+    {
+        worker->start();
+    }
+    std::cerr << devices << " devices on " << options.addresses.size() << " address(es) x " << options.ports.size()
+              << " port(s), " << options.threads << " thread(s)" << std::endl;
 
-    std::vector<char> buf(4096);
-    for (;;)
+    const auto started = Clock::now();
+    auto nextReport = started + std::chrono::seconds(options.reportSeconds);
+    while (!gStop)
     {
-        int n = recv(client, buf.data(), static_cast<int>(buf.size()), 0);
-        if (n <= 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const auto now = Clock::now();
+        if (options.durationSeconds > 0 && now - started >= std::chrono::duration<double>(options.durationSeconds))
         {
             break;
         }
-        std::cout << "recv: " << std::string(buf.data(), buf.data() + n) << std::endl;
-        send(client, buf.data(), n, 0); // Echo back
+        if (options.reportSeconds > 0 && now >= nextReport)
+        {
+            nextReport += std::chrono::seconds(options.reportSeconds);
+            std::fprintf(stderr,
+                         "connections %llu active / %llu accepted, in %llu B, out %llu B, dropped %llu, stalls %llu, "
+                         "telemetry %llu\n",
+                         static_cast<unsigned long long>(stats.active.load()),
+                         static_cast<unsigned long long>(stats.accepted.load()),
+                         static_cast<unsigned long long>(stats.bytesIn.load()),
+                         static_cast<unsigned long long>(stats.bytesOut.load()),
+                         static_cast<unsigned long long>(stats.dropped.load()),
+                         static_cast<unsigned long long>(stats.stalls.load()),
+                         static_cast<unsigned long long>(stats.telemetry.load()));
+        }
+    }
+    for (auto& worker : workers)
+    {
+        worker->stop();
     }
-
-    closeSocket(client);
-    closeSocket(server);
     cleanupSockets();
     return 0;
 }
@@ -1,8 +1,39 @@
+// Load generator for bridge listen ports, standing in for the upper host. It opens many
+// non-blocking connections, spread round-robin over one or more bridge ports and over worker
+// event loops, and keeps them busy in one of two ways:
+//   closed loop (default) - every connection keeps --pipeline requests outstanding
+//   open loop (--rate R)  - R requests per second in total on a fixed schedule, whatever the
+//                           responses do; a request that finds its connection's pipeline full
+//                           waits, and the wait counts towards its latency
+// Responses are matched to requests by byte count in FIFO order, so the device behind the
+// bridge must echo. A plain bridge answers whichever client spoke last, so use one connection
+// per port there; with --modbus requests are MBAP frames and a bridge in modbus mode keeps any
+// number of connections apart.
+//
+// Latency is reported twice. "corrected" accounts for coordinated omission: in open loop it is
+// measured from each request's scheduled send time, in closed loop the recorded histogram is
+// backfilled HdrHistogram-style with the expected interval (--expected-interval-us, or the mean
+// round trip, since each pipeline slot sends again as soon as it is answered). "uncorrected"
+// runs from the actual send.
+#include "event_loop.h"
+#include "metrics.h"
+#include "net_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <random>
 #include <string>
+#include <thread>
 #include <vector>
-#include <cstring>
-#include <cstdlib>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -10,16 +41,21 @@
 #pragma comment(lib, "ws2_32.lib")
 #else
 #include <arpa/inet.h>
+#include <cerrno>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <unistd.h>
-using SOCKET = int;
-constexpr SOCKET INVALID_SOCKET = -1;
-constexpr int SOCKET_ERROR = -1;
 #endif
 
 namespace {
 
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kReadSize = 64 * 1024;
+constexpr size_t kModbusMin = 8;   // MBAP header plus function code
+constexpr size_t kModbusMax = 260; // largest Modbus TCP ADU
+
 bool initSockets()
 {
 #ifdef _WIN32
@@ -45,7 +81,7 @@ void cleanupSockets()
 #endif
 }
 
-void closeSocket(SOCKET s)
+void closeSocket(SOCKET_T s)
 {
 #ifdef _WIN32
     closesocket(s);
@@ -54,82 +90,780 @@ void closeSocket(SOCKET s)
 #endif
 }
 
-} // namespace
+bool wouldBlock()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
 
-int main(int argc, char** argv)
+uint64_t nowNanos()
 {
-    std::string bridgeHost = "127.0.0.1"; // Bridge listen address
-    int bridgePort = 15000;               // Match listenPort in the bridge config
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
 
-    if (argc >= 2)
+// Request sizes: "N" fixed, "A-B" uniform, "exp:MEAN" exponential, "S:W,S:W,..." weighted mix
+class SizeDistribution
+{
+public:
+    bool parse(const std::string& spec)
     {
-        bridgeHost = argv[1];
+        sizes.clear();
+        weights.clear();
+        if (spec.compare(0, 4, "exp:") == 0)
+        {
+            kind = Kind::Exponential;
+            mean = std::atof(spec.c_str() + 4);
+            return mean >= 1;
+        }
+        if (spec.find(':') != std::string::npos)
+        {
+            kind = Kind::Mix;
+            size_t begin = 0;
+            while (begin < spec.size())
+            {
+                size_t end = spec.find(',', begin);
+                end = end == std::string::npos ? spec.size() : end;
+                const std::string item = spec.substr(begin, end - begin);
+                const size_t colon = item.find(':');
+                if (colon == std::string::npos)
+                {
+                    return false;
+                }
+                sizes.push_back(static_cast<size_t>(std::atoll(item.c_str())));
+                weights.push_back(std::atof(item.c_str() + colon + 1));
+                begin = end + 1;
+            }
+            pick = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+            return !sizes.empty();
+        }
+        const size_t dash = spec.find('-');
+        low = static_cast<size_t>(std::atoll(spec.c_str()));
+        high = dash == std::string::npos ? low : static_cast<size_t>(std::atoll(spec.c_str() + dash + 1));
+        kind = low == high ? Kind::Fixed : Kind::Uniform;
+        return low > 0 && high >= low;
     }
-    if (argc >= 3)
+
+    size_t next(std::mt19937_64& rng)
     {
-        bridgePort = std::atoi(argv[2]);
+        switch (kind)
+        {
+        case Kind::Fixed:
+            return low;
+        case Kind::Uniform:
+            return std::uniform_int_distribution<size_t>(low, high)(rng);
+        case Kind::Exponential:
+            return std::max<size_t>(1, static_cast<size_t>(std::exponential_distribution<double>(1.0 / mean)(rng)));
+        case Kind::Mix:
+            return std::max<size_t>(1, sizes[pick(rng)]);
+        }
+        return low;
     }
-    if (!initSockets())
+
+private:
+    enum class Kind
     {
-        return 1;
+        Fixed,
+        Uniform,
+        Exponential,
+        Mix,
+    };
+    Kind kind = Kind::Fixed;
+    size_t low = 64;
+    size_t high = 64;
+    double mean = 0;
+    std::vector<size_t> sizes;
+    std::vector<double> weights;
+    std::discrete_distribution<size_t> pick;
+};
+
+// Bucket counts on the metrics histogram's log-linear scale (nanoseconds), mergeable and able
+// to take many samples of one value at once, which the coordinated-omission backfill needs
+class Histogram
+{
+public:
+    Histogram() : counts(LatencyHistogram::kBuckets, 0) {}
+
+    void add(uint64_t value, uint64_t count = 1)
+    {
+        counts[LatencyHistogram::bucketIndex(value)] += count;
+        total += count;
+        sum += static_cast<double>(value) * static_cast<double>(count);
+        maxValue = std::max(maxValue, value);
     }
 
-    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (sock == INVALID_SOCKET)
+    void merge(const Histogram& other)
     {
-        std::cerr << "socket creation failed\n";
-        cleanupSockets();
-        return 1;
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return maxValue; }
+    double mean() const { return total ? sum / static_cast<double>(total) : 0; }
+
+    uint64_t percentile(double q) const
+    {
+        if (total == 0)
+        {
+            return 0;
+        }
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(total))));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            seen += counts[i];
+            if (seen >= rank)
+            {
+                return std::min(LatencyHistogram::bucketUpperBound(i), maxValue);
+            }
+        }
+        return maxValue;
+    }
+
+    // HdrHistogram's copyCorrectedForCoordinatedOmission: a sample of value v stands for the
+    // samples v - interval, v - 2 * interval, ... that a stalled sender never took. The missing
+    // samples are counted per bucket in closed form, so a long stall costs no more than a short one.
+    Histogram corrected(uint64_t interval) const
+    {
+        Histogram out = *this;
+        if (interval == 0)
+        {
+            return out;
+        }
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            if (counts[i] == 0)
+            {
+                continue;
+            }
+            const uint64_t value = std::min(LatencyHistogram::bucketUpperBound(i), maxValue);
+            const uint64_t steps = value / interval; // k = 1 .. steps - 1 keeps value - k * interval >= interval
+            if (steps < 2)
+            {
+                continue;
+            }
+            for (size_t j = 0; j <= i; ++j)
+            {
+                const uint64_t lo = j == 0 ? 0 : LatencyHistogram::bucketUpperBound(j - 1) + 1;
+                const uint64_t hi = LatencyHistogram::bucketUpperBound(j);
+                if (lo > value)
+                {
+                    break;
+                }
+                // value - k * interval within [lo, hi]
+                const uint64_t kMin = std::max<uint64_t>(1, hi >= value ? 1 : (value - hi + interval - 1) / interval);
+                const uint64_t kMax = std::min<uint64_t>(steps - 1, (value - lo) / interval);
+                if (kMax >= kMin)
+                {
+                    const uint64_t n = (kMax - kMin + 1) * counts[i];
+                    out.counts[j] += n;
+                    out.total += n;
+                    out.sum += static_cast<double>(n) *
+                               static_cast<double>(value - (kMin + kMax) * interval / 2);
+                }
+            }
+        }
+        return out;
+    }
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    double sum = 0;
+    uint64_t maxValue = 0;
+};
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    std::vector<int> ports = {15000};
+    size_t connections = 1;
+    unsigned threads = 1;
+    size_t pipeline = 1;
+    double rate = 0; // requests per second over all connections, 0 = closed loop
+    double durationSeconds = 10;
+    double warmupSeconds = 1;
+    uint64_t expectedIntervalNanos = 0;
+    std::string sizeSpec = "64";
+    bool modbus = false;
+    std::string jsonPath;
+};
+
+struct Request
+{
+    uint64_t intendedNanos = 0; // scheduled send time (open loop) or actual send time
+    uint64_t sentNanos = 0;
+    size_t size = 0;
+};
+
+struct Connection
+{
+    SOCKET_T sock = INVALID_SOCKET_T;
+    std::string out;              // bytes not yet accepted by the socket
+    size_t outOffset = 0;
+    std::deque<Request> inFlight; // sent or being sent, oldest first
+    std::deque<Request> waiting;  // open loop: due, but the pipeline is full
+    size_t receivedOfFront = 0;
+    uint16_t transactionId = 0;
+    bool failed = false;
+};
+
+// One event loop thread and the connections it owns
+class Worker
+{
+public:
+    Worker(const Options& opts, const SizeDistribution& dist, unsigned index)
+        : options(opts), sizes(dist), rng(0x9e3779b97f4a7c15ull * (index + 1))
+    {
+    }
+
+    void attach(SOCKET_T sock)
+    {
+        auto conn = std::make_unique<Connection>();
+        conn->sock = sock;
+        Connection* raw = conn.get();
+        loop.add(sock, [this, raw](uint32_t events) { onEvent(*raw, events); });
+        connections.push_back(std::move(conn));
+    }
+
+    void start(uint64_t startNanos, uint64_t warmupEnd, uint64_t endNanos, double workerRate)
+    {
+        begin = startNanos;
+        measureFrom = warmupEnd;
+        stopAt = endNanos;
+        rate = workerRate;
+        loop.startThread();
+        loop.post([this] {
+            if (rate > 0)
+            {
+                tick();
+                return;
+            }
+            for (auto& conn : connections)
+            {
+                for (size_t i = 0; i < options.pipeline; ++i)
+                {
+                    issue(*conn, nowNanos());
+                }
+                flush(*conn);
+            }
+        });
+    }
+
+    // Wait (from outside) until every request has been answered or the grace period is over
+    void finish(uint64_t graceEnd)
+    {
+        while (nowNanos() < graceEnd && outstanding.load() > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        loop.stop();
+        abandoned = static_cast<uint64_t>(std::max<int64_t>(0, outstanding.load()));
+        for (auto& conn : connections)
+        {
+            closeSocket(conn->sock);
+        }
     }
 
+    Histogram corrected;   // open loop: from the scheduled send time
+    Histogram uncorrected; // from the actual send
+    uint64_t completed = 0;
+    uint64_t bytes = 0;
+    uint64_t failures = 0;
+    uint64_t lateStarts = 0; // open loop: requests that had to wait for a pipeline slot
+    uint64_t abandoned = 0;  // still unanswered when the grace period ran out
+
+private:
+    const Options& options;
+    SizeDistribution sizes; // a copy per thread: sampling advances distribution state
+    std::mt19937_64 rng;
+    EventLoop loop;
+    std::vector<std::unique_ptr<Connection>> connections;
+    std::atomic<int64_t> outstanding{0};
+    uint64_t begin = 0;
+    uint64_t measureFrom = 0;
+    uint64_t stopAt = 0;
+    double rate = 0;
+    uint64_t scheduled = 0; // open loop: requests scheduled so far
+    std::vector<uint8_t> fill;
+
+    void tick()
+    {
+        // Every request due by now goes out (or queues) with its scheduled time attached;
+        // request n belongs to connection n mod count, so the load is spread evenly
+        const uint64_t now = nowNanos();
+        const double interval = 1e9 / rate;
+        while (true)
+        {
+            const uint64_t due = begin + static_cast<uint64_t>(static_cast<double>(scheduled) * interval);
+            if (due > now || due >= stopAt)
+            {
+                break;
+            }
+            Connection& conn = *connections[scheduled % connections.size()];
+            ++scheduled;
+            if (conn.failed)
+            {
+                continue;
+            }
+            if (conn.inFlight.size() < options.pipeline)
+            {
+                issue(conn, due);
+            }
+            else
+            {
+                conn.waiting.push_back(Request{due, 0, sizes.next(rng)});
+                ++outstanding;
+                ++lateStarts;
+            }
+        }
+        for (auto& conn : connections)
+        {
+            flush(*conn);
+        }
+        if (now < stopAt)
+        {
+            loop.runAfter(std::chrono::milliseconds(1), [this] { tick(); });
+        }
+    }
+
+    void issue(Connection& conn, uint64_t intended)
+    {
+        Request request{intended, 0, sizes.next(rng)};
+        ++outstanding;
+        send(conn, request);
+    }
+
+    void send(Connection& conn, Request request)
+    {
+        if (options.modbus)
+        {
+            request.size = std::min(std::max(request.size, kModbusMin), kModbusMax);
+        }
+        if (fill.size() < request.size)
+        {
+            fill.resize(request.size);
+            for (size_t i = 0; i < fill.size(); ++i)
+            {
+                fill[i] = static_cast<uint8_t>('a' + i % 26);
+            }
+        }
+        const size_t at = conn.out.size();
+        conn.out.append(reinterpret_cast<const char*>(fill.data()), request.size);
+        if (options.modbus)
+        {
+            // MBAP: transaction, protocol 0, length of what follows, unit 1, function 0x17
+            const uint16_t tid = conn.transactionId++;
+            const size_t length = request.size - 6;
+            const uint8_t header[8] = {static_cast<uint8_t>(tid >> 8), static_cast<uint8_t>(tid), 0, 0,
+                                       static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length), 1, 0x17};
+            std::memcpy(&conn.out[at], header, sizeof(header));
+        }
+        request.sentNanos = nowNanos();
+        conn.inFlight.push_back(request);
+    }
+
+    void flush(Connection& conn)
+    {
+        while (conn.outOffset < conn.out.size())
+        {
+            const int n = ::send(conn.sock, conn.out.data() + conn.outOffset,
+                                 static_cast<int>(conn.out.size() - conn.outOffset), 0);
+            if (n > 0)
+            {
+                conn.outOffset += static_cast<size_t>(n);
+                continue;
+            }
+            if (n < 0 && wouldBlock())
+            {
+                loop.watchWrite(conn.sock, true);
+                return;
+            }
+            fail(conn);
+            return;
+        }
+        conn.out.clear();
+        conn.outOffset = 0;
+        loop.watchWrite(conn.sock, false);
+    }
+
+    void onEvent(Connection& conn, uint32_t events)
+    {
+        if (conn.failed)
+        {
+            return;
+        }
+        if (events & EvWrite)
+        {
+            flush(conn);
+        }
+        if (!(events & (EvRead | EvClosed)))
+        {
+            return;
+        }
+        char buffer[kReadSize];
+        while (!conn.failed)
+        {
+            const int n = ::recv(conn.sock, buffer, static_cast<int>(sizeof(buffer)), 0);
+            if (n > 0)
+            {
+                consume(conn, static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && wouldBlock())
+            {
+                break;
+            }
+            fail(conn);
+        }
+        flush(conn);
+    }
+
+    void consume(Connection& conn, size_t received)
+    {
+        while (received > 0 && !conn.inFlight.empty())
+        {
+            Request& front = conn.inFlight.front();
+            const size_t take = std::min(received, front.size - conn.receivedOfFront);
+            conn.receivedOfFront += take;
+            received -= take;
+            if (conn.receivedOfFront < front.size)
+            {
+                break;
+            }
+            const uint64_t now = nowNanos();
+            if (now >= measureFrom)
+            {
+                // Late answers still count towards latency, but throughput is for the window only
+                corrected.add(now - front.intendedNanos);
+                uncorrected.add(now - front.sentNanos);
+                if (now < stopAt)
+                {
+                    ++completed;
+                    bytes += front.size;
+                }
+            }
+            conn.inFlight.pop_front();
+            conn.receivedOfFront = 0;
+            --outstanding;
+            refill(conn, now);
+        }
+    }
+
+    void refill(Connection& conn, uint64_t now)
+    {
+        if (!conn.waiting.empty())
+        {
+            Request request = conn.waiting.front();
+            conn.waiting.pop_front();
+            send(conn, request);
+            return;
+        }
+        if (rate == 0 && now < stopAt)
+        {
+            issue(conn, now);
+        }
+    }
+
+    void fail(Connection& conn)
+    {
+        conn.failed = true;
+        ++failures;
+        outstanding -= static_cast<int64_t>(conn.inFlight.size() + conn.waiting.size());
+        conn.inFlight.clear();
+        conn.waiting.clear();
+        loop.remove(conn.sock);
+    }
+};
+
+SOCKET_T connectTo(const std::string& host, int port)
+{
+    SOCKET_T sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET_T)
+    {
+        return INVALID_SOCKET_T;
+    }
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(bridgePort);
-    inet_pton(AF_INET, bridgeHost.c_str(), &addr.sin_addr);
-    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR)
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
     {
-        std::cerr << "connect to bridge failed\n";
         closeSocket(sock);
-        cleanupSockets();
-        return 1;
+        return INVALID_SOCKET_T;
     }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+    SetSocketNonBlocking(sock, true);
+    return sock;
+}
 
-    std::cout << "Connected to bridge at " << bridgeHost << ":" << bridgePort << "\n";
-    std::cout << "Type messages to send, or 'exit' to quit.\n";
+std::vector<int> parsePorts(const std::string& spec)
+{
+    // "15000", "15000-15003" or "15000,15002"
+    std::vector<int> ports;
+    size_t begin = 0;
+    while (begin < spec.size())
+    {
+        size_t end = spec.find(',', begin);
+        end = end == std::string::npos ? spec.size() : end;
+        const std::string item = spec.substr(begin, end - begin);
+        const size_t dash = item.find('-');
+        const int first = std::atoi(item.c_str());
+        const int last = dash == std::string::npos ? first : std::atoi(item.c_str() + dash + 1);
+        for (int port = first; port <= last && port > 0; ++port)
+        {
+            ports.push_back(port);
+        }
+        begin = end + 1;
+    }
+    return ports;
+}
+
+std::string microsText(uint64_t nanos)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.1f", static_cast<double>(nanos) / 1e3);
+    return text;
+}
+
+void printLatency(const char* label, const Histogram& hist)
+{
+    std::printf("%-12s p50 %10s  p90 %10s  p99 %10s  p99.9 %10s  p99.99 %10s  max %10s us\n", label,
+                microsText(hist.percentile(0.5)).c_str(), microsText(hist.percentile(0.9)).c_str(),
+                microsText(hist.percentile(0.99)).c_str(), microsText(hist.percentile(0.999)).c_str(),
+                microsText(hist.percentile(0.9999)).c_str(), microsText(hist.max()).c_str());
+}
 
-    std::vector<char> buf(4096);
-    std::string line;
-    while (std::cout << "> " && std::getline(std::cin, line))
+std::string latencyJson(const Histogram& hist)
+{
+    char text[256];
+    std::snprintf(text, sizeof(text),
+                  "{\"mean\": %.1f, \"p50\": %s, \"p90\": %s, \"p99\": %s, \"p999\": %s, \"p9999\": %s, \"max\": %s}",
+                  hist.mean() / 1e3, microsText(hist.percentile(0.5)).c_str(), microsText(hist.percentile(0.9)).c_str(),
+                  microsText(hist.percentile(0.99)).c_str(), microsText(hist.percentile(0.999)).c_str(),
+                  microsText(hist.percentile(0.9999)).c_str(), microsText(hist.max()).c_str());
+    return text;
+}
+
+void usage()
+{
+    std::cerr << "upper_client [host] [port] [options]\n"
+                 "  --ports P[-Q][,R]      bridge listen ports, connections go round-robin\n"
+                 "  --connections N        connections in total (default 1)\n"
+                 "  --threads N            event loop threads (default 1)\n"
+                 "  --pipeline D           requests outstanding per connection (default 1)\n"
+                 "  --rate R               open loop: R requests/s in total (default closed loop)\n"
+                 "  --size SPEC            N, A-B, exp:MEAN or S:W,S:W,... bytes (default 64)\n"
+                 "  --duration S           measured seconds (default 10)\n"
+                 "  --warmup S             unmeasured seconds first (default 1)\n"
+                 "  --expected-interval-us closed loop: interval for the coordinated-omission backfill\n"
+                 "  --modbus               send Modbus TCP frames (8..260 bytes)\n"
+                 "  --json FILE            also write the results as JSON\n";
+}
+
+bool parseArgs(int argc, char** argv, Options& options)
+{
+    int positional = 0;
+    for (int i = 1; i < argc; ++i)
     {
-        if (line == "exit" || line == "quit")
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--ports" && hasValue)
         {
-            break;
+            options.ports = parsePorts(argv[++i]);
         }
-        if (line.empty())
+        else if (arg == "--connections" && hasValue)
         {
-            continue;
+            options.connections = static_cast<size_t>(std::atoll(argv[++i]));
         }
-
-        // Append CRLF to each line before sending
-        std::string payload = line + "\r\n";
-        if (send(sock, payload.data(), static_cast<int>(payload.size()), 0) <= 0)
+        else if (arg == "--threads" && hasValue)
         {
-            std::cerr << "send failed or connection closed\n";
-            break;
+            options.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
         }
-
-        int n = recv(sock, buf.data(), static_cast<int>(buf.size()), 0);
-        if (n > 0)
+        else if (arg == "--pipeline" && hasValue)
+        {
+            options.pipeline = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--rate" && hasValue)
+        {
+            options.rate = std::atof(argv[++i]);
+        }
+        else if (arg == "--size" && hasValue)
+        {
+            options.sizeSpec = argv[++i];
+        }
+        else if (arg == "--duration" && hasValue)
+        {
+            options.durationSeconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--warmup" && hasValue)
+        {
+            options.warmupSeconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--expected-interval-us" && hasValue)
         {
-            std::cout << "response: " << std::string(buf.data(), buf.data() + n) << "\n";
+            options.expectedIntervalNanos = static_cast<uint64_t>(std::atof(argv[++i]) * 1e3);
+        }
+        else if (arg == "--modbus")
+        {
+            options.modbus = true;
+        }
+        else if (arg == "--json" && hasValue)
+        {
+            options.jsonPath = argv[++i];
+        }
+        else if (arg.compare(0, 2, "--") != 0 && positional == 0)
+        {
+            options.host = arg;
+            ++positional;
+        }
+        else if (arg.compare(0, 2, "--") != 0 && positional == 1)
+        {
+            options.ports = parsePorts(arg);
+            ++positional;
         }
         else
         {
-            std::cerr << "no response or connection closed\n";
-            break;
+            return false;
+        }
+    }
+    return !options.ports.empty() && options.connections > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    SizeDistribution sizes;
+    if (!parseArgs(argc, argv, options) || !sizes.parse(options.sizeSpec))
+    {
+        usage();
+        return 2;
+    }
+    if (!initSockets())
+    {
+        return 1;
+    }
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (unsigned i = 0; i < options.threads; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>(options, sizes, i));
+    }
+    size_t connected = 0;
+    for (size_t i = 0; i < options.connections; ++i)
+    {
+        const int port = options.ports[i % options.ports.size()];
+        const SOCKET_T sock = connectTo(options.host, port);
+        if (sock == INVALID_SOCKET_T)
+        {
+            std::cerr << "connect to " << options.host << ":" << port << " failed\n";
+            continue;
+        }
+        workers[i % workers.size()]->attach(sock);
+        ++connected;
+    }
+    if (connected == 0)
+    {
+        cleanupSockets();
+        return 1;
+    }
+    std::cerr << connected << " connections to " << options.ports.size() << " port(s), "
+              << (options.rate > 0 ? "open loop at " + std::to_string(static_cast<long long>(options.rate)) + "/s"
+                                   : "closed loop")
+              << ", pipeline " << options.pipeline << "\n";
+
+    const uint64_t start = nowNanos();
+    const uint64_t warmupEnd = start + static_cast<uint64_t>(options.warmupSeconds * 1e9);
+    const uint64_t end = warmupEnd + static_cast<uint64_t>(options.durationSeconds * 1e9);
+    for (auto& worker : workers)
+    {
+        worker->start(start, warmupEnd, end, options.rate / static_cast<double>(workers.size()));
+    }
+    std::this_thread::sleep_for(std::chrono::nanoseconds(end - nowNanos()));
+    for (auto& worker : workers)
+    {
+        worker->finish(nowNanos() + 2000000000ull);
+    }
+
+    Histogram corrected;
+    Histogram uncorrected;
+    uint64_t completed = 0;
+    uint64_t bytes = 0;
+    uint64_t failures = options.connections - connected;
+    uint64_t lateStarts = 0;
+    uint64_t abandoned = 0;
+    for (const auto& worker : workers)
+    {
+        corrected.merge(worker->corrected);
+        uncorrected.merge(worker->uncorrected);
+        completed += worker->completed;
+        bytes += worker->bytes;
+        failures += worker->failures;
+        lateStarts += worker->lateStarts;
+        abandoned += worker->abandoned;
+    }
+    if (options.rate == 0)
+    {
+        // Closed loop never lags its own schedule, so backfill what a stall kept from being sent
+        const uint64_t interval = options.expectedIntervalNanos ? options.expectedIntervalNanos
+                                                                : static_cast<uint64_t>(uncorrected.mean());
+        corrected = uncorrected.corrected(interval);
+    }
+
+    const double seconds = options.durationSeconds;
+    std::printf("%llu requests in %.1f s: %.1f req/s, %.2f MB/s each way, %llu failed connections",
+                static_cast<unsigned long long>(completed), seconds, static_cast<double>(completed) / seconds,
+                static_cast<double>(bytes) / seconds / 1e6, static_cast<unsigned long long>(failures));
+    if (options.rate > 0)
+    {
+        std::printf(", %llu waited for a pipeline slot", static_cast<unsigned long long>(lateStarts));
+    }
+    if (abandoned > 0)
+    {
+        std::printf(", %llu never answered", static_cast<unsigned long long>(abandoned));
+    }
+    std::printf("\n");
+    printLatency("corrected", corrected);
+    printLatency("uncorrected", uncorrected);
+
+    if (!options.jsonPath.empty())
+    {
+        FILE* file = std::fopen(options.jsonPath.c_str(), "w");
+        if (!file)
+        {
+            std::perror(options.jsonPath.c_str());
+            cleanupSockets();
+            return 1;
         }
+        std::fprintf(file,
+                     "{\"mode\": \"%s\", \"connections\": %zu, \"ports\": %zu, \"pipeline\": %zu, \"rate\": %.1f, "
+                     "\"size\": \"%s\", \"modbus\": %s, \"seconds\": %.3f, \"requests\": %llu, \"req_per_s\": %.1f, "
+                     "\"mb_per_s\": %.3f, \"failed_connections\": %llu, \"late_starts\": %llu, \"abandoned\": %llu,\n"
+                     " \"latency_us\": {\"corrected\": %s,\n                \"uncorrected\": %s}}\n",
+                     options.rate > 0 ? "open" : "closed", connected, options.ports.size(), options.pipeline,
+                     options.rate, options.sizeSpec.c_str(), options.modbus ? "true" : "false", seconds,
+                     static_cast<unsigned long long>(completed), static_cast<double>(completed) / seconds,
+                     static_cast<double>(bytes) / seconds / 1e6, static_cast<unsigned long long>(failures),
+                     static_cast<unsigned long long>(lateStarts), static_cast<unsigned long long>(abandoned),
+                     latencyJson(corrected).c_str(),
+                     latencyJson(uncorrected).c_str());
+        std::fclose(file);
     }
-    closeSocket(sock);
     cleanupSockets();
     return 0;
 }
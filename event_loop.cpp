@@ -0,0 +1,312 @@
+#include "event_loop.h"
+#include "uring_io.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#elif __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#else
+#include <poll.h>
+#endif
+
+EventLoop::EventLoop()
+{
+#ifdef __linux__
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // The wake fd stays level-triggered; it is drained on every wakeup
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+#endif
+}
+
+EventLoop::~EventLoop()
+{
+    stop();
+#ifdef __linux__
+    close(wakeFd);
+    close(epollFd);
+#endif
+}
+
+bool EventLoop::add(SOCKET_T fd, Handler handler)
+{
+#ifdef __linux__
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        return false;
+    }
+#endif
+    handlers[fd] = std::make_shared<Handler>(std::move(handler));
+    return true;
+}
+
+void EventLoop::remove(SOCKET_T fd)
+{
+    if (handlers.erase(fd) == 0)
+    {
+        return;
+    }
+    writeWatch.erase(fd);
+#ifdef __linux__
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+}
+
+void EventLoop::watchWrite(SOCKET_T fd, bool enable)
+{
+#ifndef __linux__
+    if (enable)
+    {
+        writeWatch.insert(fd);
+    }
+    else
+    {
+        writeWatch.erase(fd);
+    }
+#else
+    (void)fd;
+    (void)enable;
+#endif
+}
+
+void EventLoop::post(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        tasks.push_back(std::move(task));
+    }
+    wakeup();
+}
+
+EventLoop::TimerId EventLoop::runAfter(std::chrono::milliseconds delay, Task task)
+{
+    // Rounded up, and one past the tick in progress, so the full delay always elapses
+    const auto fromEpoch = Clock::now() - timerEpoch + std::max(delay, std::chrono::milliseconds(0));
+    const auto expiry = std::chrono::ceil<std::chrono::milliseconds>(fromEpoch).count();
+    return timers.schedule(static_cast<uint64_t>(expiry), std::move(task));
+}
+
+void EventLoop::cancelTimer(TimerId id)
+{
+    timers.cancel(id);
+}
+
+uint64_t EventLoop::ticksAt(Clock::time_point time) const
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(time - timerEpoch).count());
+}
+
+void EventLoop::runTimers()
+{
+    timers.advance(ticksAt(Clock::now()));
+}
+
+int EventLoop::nextTimeout() const
+{
+    const uint64_t due = timers.nextDue();
+    if (due == TimerWheel::kNever)
+    {
+        return -1;
+    }
+    const auto wait = timerEpoch + std::chrono::milliseconds(due) - Clock::now();
+    if (wait <= Clock::duration::zero())
+    {
+        return 0;
+    }
+    // Round up so the loop never wakes just before the deadline
+    const auto ms = std::chrono::ceil<std::chrono::milliseconds>(wait).count();
+    return static_cast<int>(std::min<int64_t>(ms, 60 * 1000));
+}
+
+void EventLoop::wakeup()
+{
+    // Collapse bursts of posts into a single eventfd write
+    if (wakePending.exchange(true))
+    {
+        return;
+    }
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+#endif
+}
+
+void EventLoop::runTasks()
+{
+    wakePending = false;
+    std::vector<Task> ready;
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        ready.swap(tasks);
+    }
+    for (auto& task : ready)
+    {
+        task();
+    }
+}
+
+void EventLoop::dispatch(SOCKET_T fd, uint32_t events)
+{
+    auto it = handlers.find(fd);
+    if (it == handlers.end())
+    {
+        return;
+    }
+    // Hold a reference so the handler may remove itself
+    std::shared_ptr<Handler> handler = it->second;
+    (*handler)(events);
+}
+
+void EventLoop::run()
+{
+    loopThreadId = std::this_thread::get_id();
+    UringIO::beginBatch();
+    runTasks();
+    UringIO::endBatch();
+#ifdef __linux__
+    std::vector<epoll_event> events(256);
+    while (!stopping)
+    {
+        int n = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), nextTimeout());
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        // io_uring work queued by handlers this round goes out in one submission per ring
+        UringIO::beginBatch();
+        for (int i = 0; i < n; ++i)
+        {
+            const int fd = events[i].data.fd;
+            if (fd == wakeFd)
+            {
+                uint64_t count = 0;
+                ssize_t ignored = read(wakeFd, &count, sizeof(count));
+                (void)ignored;
+                continue;
+            }
+            uint32_t mask = 0;
+            if (events[i].events & (EPOLLIN | EPOLLPRI))
+            {
+                mask |= EvRead;
+            }
+            if (events[i].events & EPOLLOUT)
+            {
+                mask |= EvWrite;
+            }
+            if (events[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP))
+            {
+                mask |= EvClosed;
+            }
+            dispatch(fd, mask);
+        }
+        runTasks();
+        runTimers();
+        UringIO::endBatch();
+    }
+#else
+    // Portable fallback: rebuild the poll set every pass and tick at least every 100 ms so
+    // posted tasks are picked up without a wake socket
+#ifdef _WIN32
+    using PollFd = WSAPOLLFD;
+#else
+    using PollFd = pollfd;
+#endif
+    std::vector<PollFd> fds;
+    while (!stopping)
+    {
+        fds.clear();
+        for (const auto& entry : handlers)
+        {
+            PollFd p{};
+            p.fd = entry.first;
+            p.events = POLLIN;
+            if (writeWatch.count(entry.first))
+            {
+                p.events |= POLLOUT;
+            }
+            fds.push_back(p);
+        }
+        const int timeout = nextTimeout() < 0 ? 100 : std::min(nextTimeout(), 100);
+#ifdef _WIN32
+        int n = fds.empty() ? (Sleep(timeout), 0) : WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeout);
+#else
+        int n = poll(fds.data(), fds.size(), timeout);
+#endif
+        for (size_t i = 0; n > 0 && i < fds.size(); ++i)
+        {
+            uint32_t mask = 0;
+            if (fds[i].revents & POLLIN)
+            {
+                mask |= EvRead;
+            }
+            if (fds[i].revents & POLLOUT)
+            {
+                mask |= EvWrite;
+            }
+            if (fds[i].revents & (POLLHUP | POLLERR))
+            {
+                mask |= EvClosed;
+            }
+            if (mask)
+            {
+                dispatch(static_cast<SOCKET_T>(fds[i].fd), mask);
+            }
+        }
+        runTasks();
+        runTimers();
+    }
+#endif
+    loopThreadId = std::thread::id();
+}
+
+void EventLoop::startThread(int cpu)
+{
+    thread = std::thread([this]() { run(); });
+#ifdef __linux__
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    }
+#else
+    (void)cpu;
+#endif
+}
+
+void EventLoop::stop()
+{
+    stopping = true;
+    wakePending = false;
+    wakeup();
+    if (thread.joinable() && !inLoopThread())
+    {
+        thread.join();
+    }
+}
+
+bool EventLoop::inLoopThread() const
+{
+    return loopThreadId.load() == std::this_thread::get_id();
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "net_io.h"
+#include "timer_wheel.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Readiness flags delivered to event handlers
+enum : uint32_t
+{
+    EvRead = 0x1,
+    EvWrite = 0x2,
+    EvClosed = 0x4, // hangup or socket error; a read reports the details
+};
+
+// Single-threaded readiness reactor. On Linux every socket is armed once for read and
+// write edges in an edge-triggered epoll set, so an idle socket costs no wakeups and
+// handlers must keep reading/writing until the call would block. Other platforms fall
+// back to a level-triggered poll() loop with the same handler contract.
+class EventLoop
+{
+public:
+    using Handler = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+    using TimerId = TimerWheel::TimerId;
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Register a non-blocking socket; the handler runs on the loop thread.
+    // Handlers must tolerate spurious events (e.g. after fd reuse within one batch).
+    bool add(SOCKET_T fd, Handler handler);
+
+    // Unregister a socket; call before closing it
+    void remove(SOCKET_T fd);
+
+    // Ask for write-ready events while output is queued. Write edges are always armed
+    // under epoll, so this only matters for the poll() fallback.
+    void watchWrite(SOCKET_T fd, bool enable);
+
+    // Queue a task for the loop thread; safe to call from any thread
+    void post(Task task);
+
+    // Run task on the loop thread once delay has passed (millisecond ticks, never early);
+    // loop thread only. Constant time, as is cancelTimer().
+    TimerId runAfter(std::chrono::milliseconds delay, Task task);
+
+    // Drop a timer that has not fired yet; unknown or expired IDs are ignored
+    void cancelTimer(TimerId id);
+
+    // Dispatch events on the calling thread until stop()
+    void run();
+
+    // Run the loop on an owned background thread, optionally pinned to one CPU (Linux)
+    void startThread(int cpu = -1);
+
+    // Stop dispatching; joins the owned thread when called from outside the loop
+    void stop();
+
+    bool inLoopThread() const;
+
+private:
+    std::unordered_map<SOCKET_T, std::shared_ptr<Handler>> handlers;
+    std::unordered_set<SOCKET_T> writeWatch;
+    std::atomic<bool> stopping{false};
+    std::atomic<std::thread::id> loopThreadId{};
+    std::thread thread;
+
+    std::mutex taskMutex;
+    std::vector<Task> tasks;
+    std::atomic<bool> wakePending{false};
+
+    // One tick per millisecond since the loop was created
+    const Clock::time_point timerEpoch = Clock::now();
+    TimerWheel timers;
+
+#ifdef __linux__
+    int epollFd = -1;
+    int wakeFd = -1;
+#endif
+
+    void wakeup();
+    void runTasks();
+    void runTimers();
+    // Ticks elapsed by now, rounded down; a deadline rounds up, so timers never fire early
+    uint64_t ticksAt(Clock::time_point time) const;
+    // Milliseconds until the next timer is due, -1 when none is pending
+    int nextTimeout() const;
+    void dispatch(SOCKET_T fd, uint32_t events);
+};
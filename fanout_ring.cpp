@@ -0,0 +1,37 @@
+#include "fanout_ring.h"
+
+#include <algorithm>
+
+FanoutRing::FanoutRing(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    buffer.resize(size);
+}
+
+uint8_t* FanoutRing::writeSpan(size_t& size)
+{
+    const size_t offset = static_cast<size_t>(writePos & (buffer.size() - 1));
+    size = std::min(size, buffer.size() - offset);
+    return buffer.data() + offset;
+}
+
+void FanoutRing::commit(size_t size)
+{
+    writePos += size;
+}
+
+const uint8_t* FanoutRing::readSpan(uint64_t cursor, size_t& size) const
+{
+    if (cursor >= writePos || cursor < tail())
+    {
+        size = 0;
+        return nullptr;
+    }
+    const size_t offset = static_cast<size_t>(cursor & (buffer.size() - 1));
+    size = std::min<size_t>(static_cast<size_t>(writePos - cursor), buffer.size() - offset);
+    return buffer.data() + offset;
+}
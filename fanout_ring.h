@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Single-writer byte ring read by many consumers at their own pace. Positions are absolute
+// stream offsets, so each reader only keeps a cursor; a reader whose cursor falls more than
+// capacity() behind head() has lost data and must be dropped by the owner.
+class FanoutRing
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit FanoutRing(size_t capacity);
+
+    size_t capacity() const { return buffer.size(); }
+
+    // Total bytes ever written; the position the next write lands on
+    uint64_t head() const { return writePos; }
+
+    // Oldest position still held in the ring
+    uint64_t tail() const { return writePos > buffer.size() ? writePos - buffer.size() : 0; }
+
+    // Contiguous space at the head, at most size bytes (size is updated). Writing there
+    // overwrites the oldest data once the ring has wrapped.
+    uint8_t* writeSpan(size_t& size);
+
+    // Publish size bytes written into the last writeSpan()
+    void commit(size_t size);
+
+    // Contiguous bytes readable from cursor (size is updated, 0 when caught up or overrun)
+    const uint8_t* readSpan(uint64_t cursor, size_t& size) const;
+
+private:
+    std::vector<uint8_t> buffer;
+    uint64_t writePos = 0;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+// Bounded FIFO over a fixed array for a single thread: no atomics, and the newest element may
+// be changed in place. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class FixedRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    static constexpr size_t capacity() { return Capacity; }
+
+    // false when the ring is full (value is left untouched)
+    bool push(T&& value)
+    {
+        if (tail - head == Capacity)
+        {
+            return false;
+        }
+        slots[tail & (Capacity - 1)] = std::move(value);
+        ++tail;
+        return true;
+    }
+
+    // The newest element, nullptr when the ring is empty
+    T* back()
+    {
+        return tail == head ? nullptr : &slots[(tail - 1) & (Capacity - 1)];
+    }
+
+    // The oldest element, nullptr when empty
+    T* front()
+    {
+        return tail == head ? nullptr : &slots[head & (Capacity - 1)];
+    }
+
+    // The index-th oldest element, nullptr past the newest
+    T* peek(size_t index)
+    {
+        return tail - head <= index ? nullptr : &slots[(head + index) & (Capacity - 1)];
+    }
+
+    // Drop the oldest element, releasing what it holds
+    void pop()
+    {
+        slots[head & (Capacity - 1)] = T{};
+        ++head;
+    }
+
+    size_t size() const { return tail - head; }
+
+private:
+    size_t head = 0;
+    size_t tail = 0;
+    T slots[Capacity];
+};
@@ -0,0 +1,389 @@
+#include "framer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define FRAMER_SSE2 1
+#if defined(__GNUC__) || defined(__clang__)
+#define FRAMER_AVX2 1
+#endif
+#endif
+
+namespace {
+
+size_t findLastByteScalar(const uint8_t* data, size_t size, uint8_t byte)
+{
+    for (size_t i = size; i > 0; --i)
+    {
+        if (data[i - 1] == byte)
+        {
+            return i - 1;
+        }
+    }
+    return size;
+}
+
+unsigned highestBit(uint32_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 31u - static_cast<unsigned>(__builtin_clz(mask));
+#else
+    unsigned index = 0;
+    while (mask >>= 1)
+    {
+        ++index;
+    }
+    return index;
+#endif
+}
+
+#ifdef FRAMER_SSE2
+size_t findLastByteSse2(const uint8_t* data, size_t size, uint8_t byte)
+{
+    // Walk 16-byte blocks back from the end; the unaligned head is left to the scalar loop
+    const __m128i needle = _mm_set1_epi8(static_cast<char>(byte));
+    size_t end = size;
+    while (end >= 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + end - 16));
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+        if (mask)
+        {
+            return end - 16 + highestBit(mask);
+        }
+        end -= 16;
+    }
+    const size_t found = findLastByteScalar(data, end, byte);
+    return found == end ? size : found;
+}
+#endif
+
+#ifdef FRAMER_AVX2
+__attribute__((target("avx2"))) size_t findLastByteAvx2(const uint8_t* data, size_t size, uint8_t byte)
+{
+    const __m256i needle = _mm256_set1_epi8(static_cast<char>(byte));
+    size_t end = size;
+    while (end >= 32)
+    {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + end - 32));
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+        if (mask)
+        {
+            return end - 32 + highestBit(mask);
+        }
+        end -= 32;
+    }
+    const size_t found = findLastByteSse2(data, end, byte);
+    return found == end ? size : found;
+}
+#endif
+
+using FindLast = size_t (*)(const uint8_t*, size_t, uint8_t);
+
+FindLast pickFindLast()
+{
+#ifdef FRAMER_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return findLastByteAvx2;
+    }
+#endif
+#ifdef FRAMER_SSE2
+    return findLastByteSse2;
+#else
+    return findLastByteScalar;
+#endif
+}
+
+const FindLast gFindLast = pickFindLast();
+
+// Only the end of the last whole frame matters to the bridge, so the scan runs backwards from
+// the newest byte and usually stops within the last frame. Single-byte delimiters skip the
+// candidate check.
+template <bool SingleByte>
+class DelimiterFramer : public Framer
+{
+public:
+    DelimiterFramer(std::string delim, size_t limit) : delimiter(std::move(delim)), maxFrame(limit) {}
+
+    size_t split(const uint8_t* data, size_t size) override
+    {
+        const size_t length = delimiter.size();
+        const uint8_t last = static_cast<uint8_t>(delimiter.back());
+        // The earliest position a delimiter could end at that has not been ruled out
+        const size_t from = std::max(scanned, length - 1);
+        size_t end = size;
+        while (end > from)
+        {
+            const size_t at = from + findLastByte(data + from, end - from, last);
+            if (at == end)
+            {
+                break;
+            }
+            if (SingleByte || std::memcmp(data + at + 1 - length, delimiter.data(), length) == 0)
+            {
+                scanned = size - (at + 1);
+                return at + 1;
+            }
+            end = at;
+        }
+        if (size > maxFrame)
+        {
+            return kMalformed;
+        }
+        scanned = size;
+        return 0;
+    }
+
+private:
+    std::string delimiter;
+    size_t maxFrame;
+    size_t scanned = 0; // leading bytes known not to end a delimiter
+};
+
+class FixedFramer : public Framer
+{
+public:
+    explicit FixedFramer(size_t size) : frameSize(size) {}
+
+    size_t split(const uint8_t*, size_t size) override
+    {
+        return size - size % frameSize;
+    }
+
+private:
+    size_t frameSize;
+};
+
+// Walks the headers one frame at a time. The next header's address depends on this one's
+// value, so the loop is as short as that chain allows: a load, an add, one unsigned compare.
+template <unsigned Width, bool BigEndian>
+class LengthPrefixFramer : public Framer
+{
+public:
+    LengthPrefixFramer(size_t offset, int64_t adjust, size_t limit)
+        : lengthOffset(offset), header(offset + Width), base(static_cast<uint64_t>(static_cast<int64_t>(header) + adjust)),
+          maxFrame(std::max(limit, header))
+    {
+    }
+
+    size_t split(const uint8_t* data, size_t size) override
+    {
+        size_t offset = 0;
+        while (size - offset >= header)
+        {
+            // Modular arithmetic: a negative adjust that undercuts the header wraps to a huge size
+            const uint64_t field = readField(data + offset + lengthOffset);
+            const uint64_t total = base + field;
+            if (total - header > maxFrame - header || (Width == 8 && field > maxFrame))
+            {
+                return kMalformed;
+            }
+            if (size - offset < total)
+            {
+                break;
+            }
+            offset += static_cast<size_t>(total);
+        }
+        return offset;
+    }
+
+private:
+    size_t lengthOffset;
+    size_t header;
+    uint64_t base; // frame size minus the field's value
+    size_t maxFrame;
+
+    static uint64_t readField(const uint8_t* p)
+    {
+        // Width is a constant, so this unrolls into a load and at most a byte swap
+        uint64_t value = 0;
+        for (unsigned i = 0; i < Width; ++i)
+        {
+            value |= static_cast<uint64_t>(p[i]) << (8 * (BigEndian ? Width - 1 - i : i));
+        }
+        return value;
+    }
+};
+
+template <unsigned Width>
+std::unique_ptr<Framer> makeLengthPrefix(const FramingConfig& config)
+{
+    if (config.bigEndian)
+    {
+        return std::make_unique<LengthPrefixFramer<Width, true>>(config.lengthOffset, config.lengthAdjust,
+                                                                 config.maxFrame);
+    }
+    return std::make_unique<LengthPrefixFramer<Width, false>>(config.lengthOffset, config.lengthAdjust,
+                                                              config.maxFrame);
+}
+
+auto fields(const FramingConfig& c)
+{
+    return std::tie(c.kind, c.delimiter, c.frameSize, c.lengthOffset, c.lengthWidth, c.bigEndian, c.lengthAdjust,
+                    c.maxFrame);
+}
+
+bool parseSize(const std::string& text, size_t& value)
+{
+    char* end = nullptr;
+    const long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || parsed < 0)
+    {
+        return false;
+    }
+    value = static_cast<size_t>(parsed);
+    return true;
+}
+
+} // namespace
+
+bool operator==(const FramingConfig& a, const FramingConfig& b)
+{
+    return fields(a) == fields(b);
+}
+
+bool operator!=(const FramingConfig& a, const FramingConfig& b)
+{
+    return !(a == b);
+}
+
+size_t findLastByte(const uint8_t* data, size_t size, uint8_t byte)
+{
+    return gFindLast(data, size, byte);
+}
+
+std::unique_ptr<Framer> makeFramer(const FramingConfig& config)
+{
+    switch (config.kind)
+    {
+    case FramingConfig::Kind::None:
+        return nullptr;
+    case FramingConfig::Kind::Delimiter:
+        if (config.delimiter.size() == 1)
+        {
+            return std::make_unique<DelimiterFramer<true>>(config.delimiter, config.maxFrame);
+        }
+        return std::make_unique<DelimiterFramer<false>>(config.delimiter, config.maxFrame);
+    case FramingConfig::Kind::Fixed:
+        return std::make_unique<FixedFramer>(config.frameSize);
+    case FramingConfig::Kind::LengthPrefix:
+        switch (config.lengthWidth)
+        {
+        case 1:
+            return makeLengthPrefix<1>(config);
+        case 2:
+            return makeLengthPrefix<2>(config);
+        case 4:
+            return makeLengthPrefix<4>(config);
+        default:
+            return makeLengthPrefix<8>(config);
+        }
+    }
+    return nullptr;
+}
+
+bool parseFraming(const std::string& spec, FramingConfig& config)
+{
+    FramingConfig parsed;
+    std::string kind = spec;
+    const size_t comma = spec.find(',');
+    if (comma != std::string::npos)
+    {
+        kind = spec.substr(0, comma);
+        const std::string option = spec.substr(comma + 1);
+        if (option.compare(0, 4, "max=") != 0 || !parseSize(option.substr(4), parsed.maxFrame) || parsed.maxFrame == 0)
+        {
+            return false;
+        }
+    }
+
+    // Split "name:a:b:..." into its parts
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    while (true)
+    {
+        const size_t colon = kind.find(':', begin);
+        parts.push_back(kind.substr(begin, colon - begin));
+        if (colon == std::string::npos)
+        {
+            break;
+        }
+        begin = colon + 1;
+    }
+
+    const std::string& name = parts[0];
+    if (name == "none" && parts.size() == 1)
+    {
+        parsed.kind = FramingConfig::Kind::None;
+    }
+    else if (name == "line" && parts.size() == 1)
+    {
+        parsed.kind = FramingConfig::Kind::Delimiter;
+        parsed.delimiter = "\n";
+    }
+    else if (name == "delim" && parts.size() == 2)
+    {
+        parsed.kind = FramingConfig::Kind::Delimiter;
+        for (size_t i = 0; i + 1 < parts[1].size(); i += 2)
+        {
+            char* end = nullptr;
+            const std::string pair = parts[1].substr(i, 2);
+            const long value = std::strtol(pair.c_str(), &end, 16);
+            if (*end != '\0')
+            {
+                return false;
+            }
+            parsed.delimiter.push_back(static_cast<char>(value));
+        }
+        if (parsed.delimiter.empty() || parsed.delimiter.size() * 2 != parts[1].size() || parsed.delimiter.size() > 16)
+        {
+            return false;
+        }
+    }
+    else if (name == "fixed" && parts.size() == 2)
+    {
+        parsed.kind = FramingConfig::Kind::Fixed;
+        if (!parseSize(parts[1], parsed.frameSize) || parsed.frameSize == 0)
+        {
+            return false;
+        }
+    }
+    else if (name == "length" && parts.size() >= 3 && parts.size() <= 5)
+    {
+        parsed.kind = FramingConfig::Kind::LengthPrefix;
+        size_t width = 0;
+        if (!parseSize(parts[1], parsed.lengthOffset) || !parseSize(parts[2], width) ||
+            (width != 1 && width != 2 && width != 4 && width != 8))
+        {
+            return false;
+        }
+        parsed.lengthWidth = static_cast<unsigned>(width);
+        for (size_t i = 3; i < parts.size(); ++i)
+        {
+            if (parts[i] == "be" || parts[i] == "le")
+            {
+                parsed.bigEndian = parts[i] == "be";
+                continue;
+            }
+            char* end = nullptr;
+            parsed.lengthAdjust = std::strtoll(parts[i].c_str(), &end, 10);
+            if (parts[i].empty() || *end != '\0')
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        return false;
+    }
+    config = parsed;
+    return true;
+}
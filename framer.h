@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// How a byte stream divides into messages
+struct FramingConfig
+{
+    enum class Kind
+    {
+        None,         // opaque stream, forwarded as read
+        Delimiter,    // a frame ends with delimiter (CRLF lines, NUL-terminated records, ...)
+        Fixed,        // every frame is frameSize bytes
+        LengthPrefix, // a header carries the length of the rest of the frame
+    };
+
+    Kind kind = Kind::None;
+    std::string delimiter;
+    size_t frameSize = 0;
+    // LengthPrefix: the field is lengthWidth (1, 2, 4 or 8) bytes at lengthOffset, and a frame
+    // is lengthOffset + lengthWidth + field + lengthAdjust bytes long
+    size_t lengthOffset = 0;
+    unsigned lengthWidth = 2;
+    bool bigEndian = true;
+    int64_t lengthAdjust = 0;
+    // Longer frames, and delimiter runs without a delimiter, are treated as a broken stream
+    size_t maxFrame = 64 * 1024;
+};
+
+bool operator==(const FramingConfig& a, const FramingConfig& b);
+bool operator!=(const FramingConfig& a, const FramingConfig& b);
+
+// One direction of one connection. split() finds where the whole frames at the front of the
+// buffered bytes end; the caller takes exactly that many, keeps the rest and calls again with
+// it plus whatever arrives next. A delimiter framer remembers how far it has looked, so no
+// byte is scanned twice.
+class Framer
+{
+public:
+    static constexpr size_t kMalformed = ~size_t(0);
+
+    virtual ~Framer() = default;
+
+    // Length of the whole frames that data starts with (0 if none), or kMalformed
+    virtual size_t split(const uint8_t* data, size_t size) = 0;
+};
+
+// A framer specialized for config's protocol; nullptr for Kind::None
+std::unique_ptr<Framer> makeFramer(const FramingConfig& config);
+
+// "none", "line" (LF, which also ends CRLF lines), "delim:HEX", "fixed:N",
+// "length:OFFSET:WIDTH[:be|le][:ADJUST]", optionally followed by ",max=N"
+bool parseFraming(const std::string& spec, FramingConfig& config);
+
+// Index of the last byte in [data, data + size) equal to byte, or size when there is none.
+// SSE2 or AVX2 where the CPU has them, a plain loop otherwise.
+size_t findLastByte(const uint8_t* data, size_t size, uint8_t byte);
@@ -0,0 +1,304 @@
+#include "logger.h"
+
+#include "spsc_ring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t kRingRecords = 4096; // per logging thread, 1 MiB
+constexpr auto kDrainInterval = std::chrono::milliseconds(10);
+
+struct ThreadLog
+{
+    SpscRing<LogRecord, kRingRecords> ring;
+    std::atomic<uint64_t> dropped{0}; // written by the owning thread only
+    std::atomic<bool> exited{false};
+    unsigned id = 0;
+    uint64_t reported = 0; // log thread only: drops already written out
+};
+
+// Gives the owning thread's ring up to the log thread once the thread is gone
+struct ThreadSlot
+{
+    std::shared_ptr<ThreadLog> log;
+
+    ~ThreadSlot()
+    {
+        if (log)
+        {
+            log->exited = true;
+        }
+    }
+};
+
+thread_local ThreadSlot tSlot;
+
+const char* levelName(LogLevel level)
+{
+    switch (level)
+    {
+    case LogLevel::Debug:
+        return "debug";
+    case LogLevel::Info:
+        return "info";
+    case LogLevel::Warn:
+        return "warn";
+    case LogLevel::Error:
+        return "error";
+    }
+    return "?";
+}
+
+// Local time with microseconds: 2024-05-01 12:00:00.123456
+void appendTime(std::string& out, int64_t nanos)
+{
+    const std::time_t seconds = static_cast<std::time_t>(nanos / 1000000000);
+    std::tm parts{};
+#ifdef _WIN32
+    localtime_s(&parts, &seconds);
+#else
+    localtime_r(&seconds, &parts);
+#endif
+    char text[40];
+    const size_t length = std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &parts);
+    std::snprintf(text + length, sizeof(text) - length, ".%06d", static_cast<int>(nanos % 1000000000 / 1000));
+    out += text;
+}
+
+// The argument at args[offset], advancing offset past it; false when the record has no more
+bool appendArg(std::string& out, const LogRecord& record, size_t& offset)
+{
+    if (offset >= record.used)
+    {
+        return false;
+    }
+    const uint8_t* arg = record.args + offset + 1;
+    char text[32];
+    switch (record.args[offset])
+    {
+    case LogRecord::Signed:
+    {
+        int64_t value = 0;
+        std::memcpy(&value, arg, sizeof(value));
+        out += std::to_string(value);
+        offset += 1 + sizeof(value);
+        return true;
+    }
+    case LogRecord::Unsigned:
+    {
+        uint64_t value = 0;
+        std::memcpy(&value, arg, sizeof(value));
+        out += std::to_string(value);
+        offset += 1 + sizeof(value);
+        return true;
+    }
+    case LogRecord::Real:
+    {
+        double value = 0;
+        std::memcpy(&value, arg, sizeof(value));
+        std::snprintf(text, sizeof(text), "%g", value);
+        out += text;
+        offset += 1 + sizeof(value);
+        return true;
+    }
+    case LogRecord::Bool:
+        out += *arg ? "true" : "false";
+        offset += 2;
+        return true;
+    case LogRecord::Text:
+    {
+        uint16_t size = 0;
+        std::memcpy(&size, arg, sizeof(size));
+        out.append(reinterpret_cast<const char*>(arg + sizeof(size)), size);
+        offset += 1 + sizeof(size) + size;
+        return true;
+    }
+    }
+    return false;
+}
+
+void appendRecord(std::string& out, const LogRecord& record, unsigned thread)
+{
+    appendTime(out, record.nanos);
+    out += ' ';
+    out += levelName(record.level);
+    out += " [";
+    out += std::to_string(thread);
+    out += "] ";
+    size_t offset = 0;
+    for (const char* p = record.format; *p; ++p)
+    {
+        if (p[0] == '{' && p[1] == '}' && appendArg(out, record, offset))
+        {
+            ++p;
+            continue;
+        }
+        out += *p;
+    }
+    out += '\n';
+}
+
+class LogThread
+{
+public:
+    static LogThread& instance()
+    {
+        // Never destroyed: threads may still log while static objects are torn down
+        static LogThread* log = [] {
+            auto* created = new LogThread;
+            std::atexit([] { instance().stop(); });
+            return created;
+        }();
+        return *log;
+    }
+
+    std::shared_ptr<ThreadLog> attach()
+    {
+        auto log = std::make_shared<ThreadLog>();
+        std::lock_guard<std::mutex> lock(mutex);
+        log->id = nextId++;
+        logs.push_back(log);
+        if (!thread.joinable() && !stopping)
+        {
+            thread = std::thread([this] { run(); });
+        }
+        return log;
+    }
+
+    // Write out what is queued and end the log thread; later records are never written
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+private:
+    struct Pending
+    {
+        LogRecord record;
+        unsigned thread;
+    };
+
+    std::mutex mutex; // guards logs, nextId, stopping and thread
+    std::condition_variable wake;
+    std::vector<std::shared_ptr<ThreadLog>> logs;
+    unsigned nextId = 0;
+    bool stopping = false;
+    std::thread thread;
+
+    // Log thread only
+    std::vector<Pending> batch;
+    std::string out;
+    std::string err;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            const bool last = stopping;
+            const std::vector<std::shared_ptr<ThreadLog>> current = logs;
+            lock.unlock();
+            for (const auto& log : current)
+            {
+                collect(*log);
+            }
+            write();
+            lock.lock();
+            logs.erase(std::remove_if(logs.begin(), logs.end(),
+                                      [](const std::shared_ptr<ThreadLog>& log) {
+                                          return log->exited && log->ring.size() == 0;
+                                      }),
+                       logs.end());
+            if (last)
+            {
+                break;
+            }
+            wake.wait_for(lock, kDrainInterval, [this] { return stopping; });
+        }
+    }
+
+    void collect(ThreadLog& log)
+    {
+        while (LogRecord* record = log.ring.front())
+        {
+            batch.push_back(Pending{*record, log.id});
+            log.ring.pop();
+        }
+        const uint64_t dropped = log.dropped.load(std::memory_order_relaxed);
+        if (dropped != log.reported)
+        {
+            LogRecord note;
+            note.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+            note.format = "{} log records lost, the thread's ring was full";
+            note.level = LogLevel::Warn;
+            note.putArg(dropped - log.reported);
+            batch.push_back(Pending{note, log.id});
+            log.reported = dropped;
+        }
+    }
+
+    // Rings are drained one after the other, so records are only in time order within a batch
+    void write()
+    {
+        if (batch.empty())
+        {
+            return;
+        }
+        std::stable_sort(batch.begin(), batch.end(),
+                         [](const Pending& a, const Pending& b) { return a.record.nanos < b.record.nanos; });
+        for (const Pending& pending : batch)
+        {
+            appendRecord(pending.record.level >= LogLevel::Warn ? err : out, pending.record, pending.thread);
+        }
+        batch.clear();
+        if (!out.empty())
+        {
+            std::fwrite(out.data(), 1, out.size(), stdout);
+            std::fflush(stdout);
+            out.clear();
+        }
+        if (!err.empty())
+        {
+            std::fwrite(err.data(), 1, err.size(), stderr);
+            err.clear();
+        }
+    }
+};
+
+} // namespace
+
+void Logger::submit(LogRecord& record)
+{
+    if (!tSlot.log)
+    {
+        tSlot.log = LogThread::instance().attach();
+    }
+    record.nanos =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    ThreadLog& log = *tSlot.log;
+    if (!log.ring.push(std::move(record)))
+    {
+        log.dropped.store(log.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Levels below this are compiled out entirely: 0 debug, 1 info, 2 warn, 3 error
+#ifndef TCP_BRIDGE_LOG_LEVEL
+#define TCP_BRIDGE_LOG_LEVEL 0
+#endif
+
+enum class LogLevel : uint8_t
+{
+    Debug,
+    Info,
+    Warn,
+    Error,
+};
+
+// One log call as it travels from the calling thread to the log thread: the format string
+// (never copied, so it must be a literal) and the arguments in binary. Nothing is formatted
+// on the calling thread. Strings are copied; whatever does not fit is cut off.
+struct LogRecord
+{
+    static constexpr size_t kArgBytes = 224;
+
+    enum ArgType : uint8_t
+    {
+        Signed,
+        Unsigned,
+        Real,
+        Bool,
+        Text,
+    };
+
+    int64_t nanos = 0; // system_clock time of the call
+    const char* format = nullptr;
+    LogLevel level = LogLevel::Debug;
+    uint16_t used = 0; // bytes of args taken
+    uint8_t args[kArgBytes];
+
+    void put(ArgType type, const void* value, size_t size)
+    {
+        if (used + 1 + size <= kArgBytes)
+        {
+            args[used] = type;
+            std::memcpy(args + used + 1, value, size);
+            used = static_cast<uint16_t>(used + 1 + size);
+        }
+    }
+
+    void putText(std::string_view text)
+    {
+        if (static_cast<size_t>(used) + 3 > kArgBytes)
+        {
+            return;
+        }
+        const uint16_t size = static_cast<uint16_t>(std::min(text.size(), kArgBytes - used - 3));
+        args[used] = Text;
+        std::memcpy(args + used + 1, &size, sizeof(size));
+        std::memcpy(args + used + 3, text.data(), size);
+        used = static_cast<uint16_t>(used + 3 + size);
+    }
+
+    template <typename T>
+    void putArg(const T& value)
+    {
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            const uint8_t flag = value ? 1 : 0;
+            put(Bool, &flag, 1);
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            putArg(static_cast<std::underlying_type_t<T>>(value));
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        {
+            const int64_t number = value;
+            put(Signed, &number, sizeof(number));
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            const uint64_t number = value;
+            put(Unsigned, &number, sizeof(number));
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            const double number = value;
+            put(Real, &number, sizeof(number));
+        }
+        else
+        {
+            static_assert(std::is_convertible_v<const T&, std::string_view>, "unsupported log argument type");
+            putText(value);
+        }
+    }
+};
+
+// Asynchronous log: every thread that logs gets its own lock-free ring of LogRecords, and one
+// background thread drains them all every few milliseconds, formats the records and writes
+// each batch in time order (debug and info to stdout, warnings and errors to stderr). A thread
+// whose ring is full loses the record instead of waiting; the log thread reports how many were
+// lost.
+class Logger
+{
+public:
+    static void setLevel(LogLevel level) { threshold.store(level, std::memory_order_relaxed); }
+
+    static bool enabled(LogLevel level) { return level >= threshold.load(std::memory_order_relaxed); }
+
+    // Hand a record to the calling thread's ring, starting the log thread on first use
+    static void submit(LogRecord& record);
+
+private:
+    static inline std::atomic<LogLevel> threshold{LogLevel::Info};
+};
+
+// Log format with each "{}" replaced by the next argument, e.g.
+//   logDebug("connect failed {}:{}", ip, port);
+// Integers, floating point, bool, enums and strings are accepted.
+template <LogLevel Level, typename... Args>
+void logAt(const char* format, const Args&... args)
+{
+    if constexpr (static_cast<int>(Level) >= TCP_BRIDGE_LOG_LEVEL)
+    {
+        if (Logger::enabled(Level))
+        {
+            LogRecord record;
+            record.format = format;
+            record.level = Level;
+            (record.putArg(args), ...);
+            Logger::submit(record);
+        }
+    }
+}
+
+template <typename... Args>
+void logDebug(const char* format, const Args&... args)
+{
+    logAt<LogLevel::Debug>(format, args...);
+}
+
+template <typename... Args>
+void logInfo(const char* format, const Args&... args)
+{
+    logAt<LogLevel::Info>(format, args...);
+}
+
+template <typename... Args>
+void logWarn(const char* format, const Args&... args)
+{
+    logAt<LogLevel::Warn>(format, args...);
+}
+
+template <typename... Args>
+void logError(const char* format, const Args&... args)
+{
+    logAt<LogLevel::Error>(format, args...);
+}
@@ -1,340 +1,288 @@
-#include "net_io.h"
+#include "tcp_bridge.h"
 
+#include "logger.h"
+
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <climits>
+#include <csignal>
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
-#include <mutex>
 #include <string>
 #include <thread>
 #include <utility>
 #include <vector>
 
-#ifdef _WIN32
-#include <winsock2.h>
-#else
-#include <sys/socket.h>
-#include <unistd.h>
-#endif
-
 namespace {
 
-// Simple toggleable debug logger controlled via env BRIDGE_DEBUG=1 or --debug flag
-std::atomic<bool> gDebug{false};
+std::atomic<bool> gReloadRequested{false};
 
-void debugLog(const std::string& msg)
+constexpr long long kMaxWorkersPerCore = 4;
+
+// Numeric flag value into field, in units; complains and returns false when it is not a whole
+// number of at most max
+template <typename T>
+bool numberFlag(const char* flag, const char* text, long long max, T& field, long long unit = 1)
 {
-    if (gDebug)
+    long long value = 0;
+    if (!parseConfigNumber(text, max, value))
     {
-        std::cout << "[debug] " << msg << std::endl;
+        std::cerr << "bad " << flag << " " << text << std::endl;
+        return false;
     }
+    field = static_cast<T>(value * unit);
+    return true;
 }
 
 } // namespace
 
-// Per-bridge configuration: target external endpoint and the local listening port paired to it
-struct BridgeConfig
-{
-    std::string remoteIp;
-    int remotePort = 0;
-    int listenPort = 0;
-};
-
-// Represents one bidirectional bridge: maintains a long-lived client link to the remote
-// device and accepts upstream connections from the local host for forwarding.
-class TcpBridgeInstance
+int main(int argc, char** argv)
 {
-public:
-    explicit TcpBridgeInstance(BridgeConfig cfg) : config(std::move(cfg)) {}
+    unsigned workers = 1;
+    int statusPort = 16000;
+    std::string configPath;
+    BridgeConfig defaults; // command line options apply to every bridge, the config file may override them
 
-    void start()
-    {
-        setupRemote();
-        setupServer();
-        debugLog("bridge started: remote " + config.remoteIp + ":" + std::to_string(config.remotePort) +
-                 " <-> listen " + std::to_string(config.listenPort));
-    }
-
-    bool isRemoteConnected() const
-    {
-        return remote.CheckLinkOk();
-    }
-
-    const BridgeConfig& getConfig() const
+    // Enable debug when BRIDGE_DEBUG=1 or --debug flag is provided
+    if (const char* env = std::getenv("BRIDGE_DEBUG"))
     {
-        return config;
+        if (std::string(env) == "1")
+        {
+            Logger::setLevel(LogLevel::Debug);
+        }
     }
-
-private:
-    BridgeConfig config;
-    NetTcpIO remote;
-    NetTcpIO server;
-    std::atomic<bool> running{true};
-    std::thread maintainThread;
-    std::mutex remoteReadMutex;
-    std::mutex remoteWriteMutex;
-
-    void setupRemote()
+    // Usage errors go straight to stderr: nothing runs yet and the process exits right after
+    for (int i = 1; i < argc; ++i)
     {
-        // Configure the always-on client socket to the external device
-        NetTcpPARAM param{};
-        param.bServer = 0;
-        param.RemoteIp = config.remoteIp;
-        param.RemotePort = config.remotePort;
-        param.bRefRecvTimeout = 1;
-        param.RecvTimeout = 200;
-        param.bRefConnectTimeout = 0; // use blocking connect for local demo stability
-        param.bNoDelay = 1;
-        remote.SetParam(param);
-        if (!remote.Open())
+        if (std::string(argv[i]) == "--debug")
         {
-            debugLog("initial remote connect failed: " + config.remoteIp + ":" + std::to_string(config.remotePort));
+            Logger::setLevel(LogLevel::Debug);
         }
-        else
+        else if (std::string(argv[i]) == "--splice")
         {
-            debugLog("connected to remote " + config.remoteIp + ":" + std::to_string(config.remotePort));
+            // Zero-copy forwarding through kernel pipes (Linux only, copy path elsewhere)
+            defaults.spliceForward = true;
         }
-
-        // Separate maintenance thread keeps the remote link alive
-        maintainThread = std::thread([this]() { maintainRemoteConnection(); });
-    }
-
-    void setupServer()
-    {
-        // Start a local TCP server so the upstream host can connect
-        NetTcpPARAM param{};
-        param.bServer = 1;
-        param.bRefLocalPort = 1;
-        param.LocalPort = config.listenPort;
-        param.ServerFunc = [this](SOCKET_T clientSock) {
-            std::thread(&TcpBridgeInstance::handleConnection, this, clientSock).detach();
-        };
-
-        server.SetParam(param);
-        server.Open();
-    }
-
-    void maintainRemoteConnection()
-    {
-        // Periodically check and reconnect the remote side if necessary
-        while (running)
+        else if (std::string(argv[i]) == "--io-uring")
+        {
+            // io_uring backend for device links and listeners, plain sockets if unsupported
+            defaults.ioUring = true;
+        }
+        else if (std::string(argv[i]) == "--broadcast")
         {
-            if (!remote.CheckLinkOk())
+            // Fan every device byte out to all clients attached to a bridge
+            defaults.broadcast = true;
+        }
+        else if (std::string(argv[i]) == "--modbus")
+        {
+            // Many Modbus TCP masters per device, matched to their responses by transaction ID
+            defaults.modbusMux = true;
+        }
+        else if (std::string(argv[i]) == "--high-water" && i + 1 < argc)
+        {
+            // Queue backlog (bytes) at which reading the faster side pauses
+            if (!numberFlag("--high-water", argv[++i], kMaxConfigBytes, defaults.highWatermark))
             {
-                remote.Close();
-                remote.Open();
-                if (remote.CheckLinkOk())
-                {
-                    debugLog("reconnected to remote " + config.remoteIp + ":" + std::to_string(config.remotePort));
-                }
-                else
-                {
-                    debugLog("reconnect failed " + config.remoteIp + ":" + std::to_string(config.remotePort));
-                }
+                return 2;
             }
-            std::this_thread::sleep_for(std::chrono::seconds(1));
         }
-    }
-
-    bool ensureRemoteConnected()
-    {
-        if (!remote.CheckLinkOk())
+        else if (std::string(argv[i]) == "--low-water" && i + 1 < argc)
         {
-            remote.Close();
-            remote.Open();
+            // Backlog (bytes) at which a paused side is read again
+            if (!numberFlag("--low-water", argv[++i], kMaxConfigBytes, defaults.lowWatermark))
+            {
+                return 2;
+            }
         }
-        return remote.CheckLinkOk();
-    }
-
-    void handleConnection(SOCKET_T clientSock)
-    {
-        // Bridge one upstream client with the persistent remote connection
-        std::atomic<bool> active{true};
-        debugLog("client connected on port " + std::to_string(config.listenPort));
-
-        auto closeClient = [clientSock]() {
-            if (clientSock != INVALID_SOCKET_T)
+        else if (std::string(argv[i]) == "--sockbuf" && i + 1 < argc)
+        {
+            // Cap kernel socket buffers so queueing happens in the bridge's bounded queues
+            if (!numberFlag("--sockbuf", argv[++i], INT_MAX, defaults.socketBufferBytes))
             {
-#ifdef _WIN32
-                closesocket(clientSock);
-#else
-                close(clientSock);
-#endif
+                return 2;
             }
-        };
-
-        std::thread upstream([&]() {
-            std::vector<uint8_t> buffer(4096);
-            while (active)
+        }
+        else if (std::string(argv[i]) == "--connect-timeout" && i + 1 < argc)
+        {
+            // Give up on an unanswered device connect after this many ms and retry later
+            if (!numberFlag("--connect-timeout", argv[++i], INT_MAX, defaults.connectTimeoutMs))
             {
-                // Read from upstream host and push to remote device
-                int received = ::recv(clientSock, reinterpret_cast<char*>(buffer.data()), static_cast<int>(buffer.size()), 0);
-                if (received <= 0)
-                {
-                    active = false;
-                    break;
-                }
-
-                if (!ensureRemoteConnected())
-                {
-                    continue;
-                }
-
-                std::lock_guard<std::mutex> lock(remoteWriteMutex);
-                if (!remote.sendData(buffer.data(), received))
-                {
-                    debugLog("send to remote failed, closing remote");
-                    remote.Close();
-                }
+                return 2;
             }
-        });
-
-        std::thread downstream([&]() {
-            std::vector<uint8_t> buffer(4096);
-            while (active)
+        }
+        else if (std::string(argv[i]) == "--heartbeat" && i + 1 < argc)
+        {
+            // Probe idle device links every N ms and report their RTT
+            if (!numberFlag("--heartbeat", argv[++i], INT_MAX, defaults.heartbeatIntervalMs))
             {
-                // Pull data from remote device and forward to upstream host
-                if (!ensureRemoteConnected())
-                {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(200));
-                    continue;
-                }
-
-                int readSize = 0;
-                {
-                    std::lock_guard<std::mutex> lock(remoteReadMutex);
-                    if (!remote.Read(buffer.data(), static_cast<int>(buffer.size()), &readSize))
-                    {
-                        continue;
-                    }
-                }
-
-                if (readSize <= 0)
-                {
-                    continue;
-                }
-
-                int written = ::send(clientSock, reinterpret_cast<const char*>(buffer.data()), readSize, 0);
-                if (written <= 0)
-                {
-                    debugLog("send to client failed, closing client");
-                    active = false;
-                    break;
-                }
+                return 2;
             }
-        });
-
-        while (active)
+        }
+        else if (std::string(argv[i]) == "--heartbeat-timeout" && i + 1 < argc)
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            // A link that leaves a probe unanswered this long (ms) is reconnected
+            if (!numberFlag("--heartbeat-timeout", argv[++i], INT_MAX, defaults.heartbeatTimeoutMs))
+            {
+                return 2;
+            }
         }
-
-        closeClient();
-        if (upstream.joinable())
+        else if (std::string(argv[i]) == "--heartbeat-probe" && i + 1 < argc)
         {
-            upstream.join();
+            // Modbus probe frame as hex; without one the heartbeat relies on TCP keepalive
+            defaults.heartbeatProbe = parseHexBytes(argv[++i]);
         }
-        if (downstream.joinable())
+        else if (std::string(argv[i]) == "--dwell-outlier-us" && i + 1 < argc)
         {
-            downstream.join();
+            // Log chunks held in the bridge longer than N us (status command "outliers"), 0 = off
+            if (!numberFlag("--dwell-outlier-us", argv[++i], INT_MAX, defaults.dwellOutlierUs))
+            {
+                return 2;
+            }
         }
-        debugLog("client disconnected on port " + std::to_string(config.listenPort));
-    }
-};
-
-class TcpBridgeManager
-{
-public:
-    TcpBridgeManager(std::vector<BridgeConfig> cfgs, int statusPort)
-        : configs(std::move(cfgs)), statusListenPort(statusPort) {}
-
-    void start()
-    {
-        // Instantiate all bridges and launch their loops
-        for (const auto& cfg : configs)
+        else if (std::string(argv[i]) == "--framing" && i + 1 < argc)
+        {
+            // Forward client data to the device in whole frames only: line, delim:HEX, fixed:N,
+            // length:OFFSET:WIDTH[:be|le][:ADJUST]
+            if (!parseFraming(argv[++i], defaults.framing))
+            {
+                std::cerr << "bad --framing " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (std::string(argv[i]) == "--client-idle-timeout" && i + 1 < argc)
+        {
+            // Close clients that have been silent both ways for N ms, 0 = never
+            if (!numberFlag("--client-idle-timeout", argv[++i], INT_MAX, defaults.clientIdleTimeoutMs))
+            {
+                return 2;
+            }
+        }
+        else if (std::string(argv[i]) == "--cache-ttl" && i + 1 < argc)
+        {
+            // Modbus mode: answer repeated polls from the device's last answer for N ms, 0 = off
+            if (!numberFlag("--cache-ttl", argv[++i], INT_MAX, defaults.cache.ttlMs))
+            {
+                return 2;
+            }
+        }
+        else if (std::string(argv[i]) == "--cache-rules" && i + 1 < argc)
+        {
+            // Which requests may be cached: FUNCTION[@UNIT][:FIRST-LAST],... (default 1,2,3,4)
+            if (!parseCacheRules(argv[++i], defaults.cache.rules))
+            {
+                std::cerr << "bad --cache-rules " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (std::string(argv[i]) == "--coalesce")
+        {
+            // Modbus mode: clients asking what is already being asked share the device's answer
+            defaults.coalesceRequests = true;
+        }
+        else if (std::string(argv[i]) == "--capture" && i + 1 < argc)
+        {
+            // Record each bridge's traffic into a ring file in DIR, for bench/capture_replay
+            defaults.captureDir = argv[++i];
+        }
+        else if (std::string(argv[i]) == "--capture-mb" && i + 1 < argc)
+        {
+            // Ring size per bridge; the oldest records are overwritten
+            if (!numberFlag("--capture-mb", argv[++i], kMaxConfigBytes / (1024 * 1024), defaults.captureBytes, 1024 * 1024))
+            {
+                return 2;
+            }
+        }
+        else if (std::string(argv[i]) == "--config" && i + 1 < argc)
+        {
+            // Bridge topology file, read again on SIGHUP or the status command "reload"
+            configPath = argv[++i];
+        }
+        else if (std::string(argv[i]) == "--status-port" && i + 1 < argc)
         {
-            bridges.emplace_back(std::make_unique<TcpBridgeInstance>(cfg));
-            bridges.back()->start();
+            if (!numberFlag("--status-port", argv[++i], 65535, statusPort))
+            {
+                return 2;
+            }
+        }
+        else if (std::string(argv[i]) == "--workers" && i + 1 < argc)
+        {
+            // Shard bridges over N pinned event loop threads, 0 = one per core; more loops than
+            // kMaxWorkersPerCore per core only add threads
+            const long long cores = std::max(1u, std::thread::hardware_concurrency());
+            if (!numberFlag("--workers", argv[++i], cores * kMaxWorkersPerCore, workers))
+            {
+                return 2;
+            }
         }
-        startStatusServer();
     }
 
-private:
-    std::vector<BridgeConfig> configs;
-    std::vector<std::unique_ptr<TcpBridgeInstance>> bridges;
-    int statusListenPort = 0;
-    NetTcpIO statusServer;
-
-    void startStatusServer()
-    {
-        // Lightweight status server for the upper host to query bridge health
-        NetTcpPARAM statusParam{};
-        statusParam.bServer = 1;
-        statusParam.bRefLocalPort = 1;
-        statusParam.LocalPort = statusListenPort;
-        statusParam.ServerFunc = [this](SOCKET_T clientSock) {
-            const std::string report = buildStatusReport();
-            ::send(clientSock, report.c_str(), static_cast<int>(report.size()), 0);
-#ifdef _WIN32
-            closesocket(clientSock);
-#else
-            close(clientSock);
+#ifndef _WIN32
+    // A peer that vanishes mid-send must surface as a send error, not kill the process
+    std::signal(SIGPIPE, SIG_IGN);
 #endif
-        };
 
-        statusServer.SetParam(statusParam);
-        statusServer.Open();
-        debugLog("status server listening on port " + std::to_string(statusListenPort));
-    }
+#ifdef SIGHUP
+    std::signal(SIGHUP, [](int) { gReloadRequested = true; });
+#endif
 
-    std::string buildStatusReport() const
+    std::vector<BridgeConfig> configs;
+    if (!configPath.empty())
     {
-        // Build plain-text status lines for each bridge
-        std::string report;
-        for (const auto& bridge : bridges)
+        std::string error;
+        if (!loadBridgeConfigs(configPath, defaults, configs, error))
         {
-            const auto& cfg = bridge->getConfig();
-            report += "remote " + cfg.remoteIp + ":" + std::to_string(cfg.remotePort);
-            report += " -> listen " + std::to_string(cfg.listenPort);
-            report += " connected=" + std::string(bridge->isRemoteConnected() ? "1" : "0") + "\n";
+            std::cerr << error << std::endl;
+            return 1;
         }
-        return report;
     }
-};
-
-int main(int argc, char** argv)
-{
-    // Enable debug when BRIDGE_DEBUG=1 or --debug flag is provided
-    if (const char* env = std::getenv("BRIDGE_DEBUG"))
+    else
     {
-        if (std::string(env) == "1")
+        // Example configuration: four remote endpoints and one status port
+        const struct
         {
-            gDebug = true;
-        }
-    }
-    for (int i = 1; i < argc; ++i)
-    {
-        if (std::string(argv[i]) == "--debug")
+            const char* ip;
+            int port;
+            int listenPort;
+        } examples[] = {
+            {"192.168.200.112", 9100, 15000},
+            {"192.168.200.113", 9100, 15001},
+            {"192.168.200.114", 9100, 15002},
+            {"192.168.200.115", 9100, 15003},
+        };
+        for (const auto& example : examples)
         {
-            gDebug = true;
+            BridgeConfig cfg = defaults;
+            cfg.remoteIp = example.ip;
+            cfg.remotePort = example.port;
+            cfg.listenPort = example.listenPort;
+            configs.push_back(std::move(cfg));
         }
     }
 
-    // Example configuration: two remote endpoints and one status port
-    std::vector<BridgeConfig> configs = {
-        {"192.168.200.112", 9100, 15000},
-        {"192.168.200.113", 9100, 15001},
-        {"192.168.200.114", 9100, 15002},
-        {"192.168.200.115", 9100, 15003}
-    };
-
-    TcpBridgeManager manager(std::move(configs), 16000);
+    TcpBridgeManager manager(std::move(configs), statusPort, workers);
+    if (!configPath.empty())
+    {
+        manager.setConfigLoader([configPath, defaults](std::vector<BridgeConfig>& cfgs, std::string& error) {
+            return loadBridgeConfigs(configPath, defaults, cfgs, error);
+        });
+    }
     manager.start();
 
     while (true)
     {
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+        // The signal handler only raises the flag; the reload itself runs here
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (gReloadRequested.exchange(false))
+        {
+            std::string summary = manager.reload();
+            if (!summary.empty() && summary.back() == '\n')
+            {
+                summary.pop_back(); // the log adds its own line end
+            }
+            logInfo("{}", summary);
+        }
     }
 
     return 0;
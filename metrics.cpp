@@ -0,0 +1,465 @@
+#include "metrics.h"
+
+#include "trace_clock.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+unsigned bitWidth(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return value ? 64u - static_cast<unsigned>(__builtin_clzll(value)) : 0u;
+#else
+    unsigned width = 0;
+    while (value)
+    {
+        ++width;
+        value >>= 1;
+    }
+    return width;
+#endif
+}
+
+std::string seconds(uint64_t value, double perSecond)
+{
+    // %g keeps nanosecond bounds from rounding to zero
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", static_cast<double>(value) / perSecond);
+    return text;
+}
+
+std::string bridgeLabels(const BridgeMetrics& bridge)
+{
+    return "bridge=\"" + std::to_string(bridge.listenPort) + "\",remote=\"" + bridge.remoteIp + ":" +
+           std::to_string(bridge.remotePort) + "\"";
+}
+
+void appendFamily(std::string& out, const char* name, const char* type, const char* help)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void appendSample(std::string& out, const char* name, const std::string& labels, const std::string& value)
+{
+    out += name;
+    out += '{';
+    out += labels;
+    out += "} ";
+    out += value;
+    out += '\n';
+}
+
+void appendHistogram(std::string& out, const char* name, const std::string& labels, const LatencyHistogram& hist,
+                     double perSecond)
+{
+    // Cumulative buckets at power-of-two bounds keep the exposition short; the fine buckets
+    // are in the binary form
+    const std::string bucketName = std::string(name) + "_bucket";
+    uint64_t cumulative = 0;
+    size_t index = 0;
+    const size_t last = LatencyHistogram::bucketIndex(hist.max());
+    for (unsigned bits = 1; bits <= LatencyHistogram::kMaxBits && index <= last; ++bits)
+    {
+        const uint64_t bound = (uint64_t(1) << bits) - 1;
+        while (index < LatencyHistogram::kBuckets && LatencyHistogram::bucketUpperBound(index) <= bound)
+        {
+            cumulative += hist.bucket(index++);
+        }
+        appendSample(out, bucketName.c_str(), labels + ",le=\"" + seconds(bound + 1, perSecond) + "\"", std::to_string(cumulative));
+    }
+    appendSample(out, bucketName.c_str(), labels + ",le=\"+Inf\"", std::to_string(hist.count()));
+    appendSample(out, (std::string(name) + "_sum").c_str(), labels, seconds(hist.sum(), perSecond));
+    appendSample(out, (std::string(name) + "_count").c_str(), labels, std::to_string(hist.count()));
+}
+
+void appendVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void appendString(std::string& out, const std::string& text)
+{
+    appendVarint(out, text.size());
+    out += text;
+}
+
+void appendBinaryHistogram(std::string& out, const LatencyHistogram& hist)
+{
+    appendVarint(out, hist.count());
+    appendVarint(out, hist.sum());
+    appendVarint(out, hist.max());
+    std::vector<std::pair<size_t, uint64_t>> used;
+    for (size_t i = 0; i < LatencyHistogram::kBuckets; ++i)
+    {
+        if (const uint64_t n = hist.bucket(i))
+        {
+            used.emplace_back(i, n);
+        }
+    }
+    appendVarint(out, used.size());
+    size_t previous = 0;
+    for (const auto& entry : used)
+    {
+        appendVarint(out, entry.first - previous);
+        appendVarint(out, entry.second);
+        previous = entry.first;
+    }
+}
+
+} // namespace
+
+void LatencyHistogram::record(uint64_t micros)
+{
+    buckets[bucketIndex(micros)].add();
+    total.add();
+    sumUs.add(micros);
+    if (micros > maxUs.load(std::memory_order_relaxed))
+    {
+        maxUs.store(micros, std::memory_order_relaxed);
+    }
+}
+
+uint64_t LatencyHistogram::quantile(double q) const
+{
+    const uint64_t samples = count();
+    if (samples == 0)
+    {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(samples) + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i)
+    {
+        seen += bucket(i);
+        if (seen >= rank)
+        {
+            return std::min(bucketUpperBound(i), max());
+        }
+    }
+    return max();
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t micros)
+{
+    const uint64_t linear = uint64_t(1) << (kSubBits + 1);
+    if (micros < linear)
+    {
+        return static_cast<size_t>(micros);
+    }
+    const unsigned width = bitWidth(micros);
+    if (width > kMaxBits)
+    {
+        return kBuckets - 1;
+    }
+    // The top kSubBits bits below the leading one pick the bucket within its power of two
+    const unsigned shift = width - 1 - kSubBits;
+    return (static_cast<size_t>(shift + 1) << kSubBits) + static_cast<size_t>((micros >> shift) - (uint64_t(1) << kSubBits));
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index)
+{
+    const size_t linear = size_t(1) << (kSubBits + 1);
+    if (index < linear)
+    {
+        return index;
+    }
+    const unsigned shift = static_cast<unsigned>(index >> kSubBits) - 1;
+    const uint64_t lower = ((uint64_t(1) << kSubBits) + (index & ((size_t(1) << kSubBits) - 1))) << shift;
+    return lower + (uint64_t(1) << shift) - 1;
+}
+
+void OutlierRing::push(const DwellOutlier& outlier)
+{
+    const uint64_t index = written.load(std::memory_order_relaxed);
+    Slot& slot = slots[index % kCapacity];
+    const uint64_t generation = index / kCapacity;
+    slot.seq.store(2 * generation + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    const uint64_t words[kWords] = {outlier.up ? 1u : 0u, outlier.client, outlier.bytes, outlier.dwellNanos,
+                                    outlier.egressTicks};
+    for (size_t i = 0; i < kWords; ++i)
+    {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.seq.store(2 * generation + 2, std::memory_order_release);
+    written.store(index + 1, std::memory_order_release);
+}
+
+std::vector<DwellOutlier> OutlierRing::snapshot() const
+{
+    std::vector<DwellOutlier> out;
+    const uint64_t end = total();
+    const uint64_t begin = end > kCapacity ? end - kCapacity : 0;
+    for (uint64_t index = begin; index < end; ++index)
+    {
+        const Slot& slot = slots[index % kCapacity];
+        const uint64_t expected = 2 * (index / kCapacity) + 2;
+        if (slot.seq.load(std::memory_order_acquire) != expected)
+        {
+            continue; // overwritten since, or being overwritten
+        }
+        uint64_t words[kWords];
+        for (size_t i = 0; i < kWords; ++i)
+        {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != expected)
+        {
+            continue;
+        }
+        DwellOutlier outlier;
+        outlier.up = words[0] != 0;
+        outlier.client = words[1];
+        outlier.bytes = words[2];
+        outlier.dwellNanos = words[3];
+        outlier.egressTicks = words[4];
+        out.push_back(outlier);
+    }
+    return out;
+}
+
+std::shared_ptr<ClientMetrics> BridgeMetrics::addClient(uint64_t id, std::string peer)
+{
+    auto client = std::make_shared<ClientMetrics>();
+    client->id = id;
+    client->peer = std::move(peer);
+    std::lock_guard<std::mutex> lock(clientMutex);
+    clients.push_back(client);
+    return client;
+}
+
+void BridgeMetrics::removeClient(const std::shared_ptr<ClientMetrics>& client)
+{
+    std::lock_guard<std::mutex> lock(clientMutex);
+    clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+}
+
+std::vector<std::shared_ptr<ClientMetrics>> BridgeMetrics::clientList() const
+{
+    std::lock_guard<std::mutex> lock(clientMutex);
+    return clients;
+}
+
+std::string formatPrometheus(const std::vector<const BridgeMetrics*>& bridges)
+{
+    std::string out;
+    struct DirectionFamily
+    {
+        const char* name;
+        const char* help;
+        const MetricCounter DirectionMetrics::*counter;
+    };
+    const DirectionFamily directionFamilies[] = {
+        {"tcp_bridge_bytes_total", "Payload bytes forwarded.", &DirectionMetrics::bytes},
+        {"tcp_bridge_chunks_total", "Socket reads that carried payload.", &DirectionMetrics::chunks},
+        {"tcp_bridge_send_stalls_total", "Sends that would block and left data queued.", &DirectionMetrics::stalls},
+    };
+    for (const auto& family : directionFamilies)
+    {
+        appendFamily(out, family.name, "counter", family.help);
+        for (const BridgeMetrics* bridge : bridges)
+        {
+            const std::string labels = bridgeLabels(*bridge);
+            appendSample(out, family.name, labels + ",direction=\"up\"", std::to_string((bridge->up.*family.counter).load()));
+            appendSample(out, family.name, labels + ",direction=\"down\"", std::to_string((bridge->down.*family.counter).load()));
+        }
+    }
+
+    struct BridgeFamily
+    {
+        const char* name;
+        const char* help;
+        const MetricCounter BridgeMetrics::*counter;
+    };
+    const BridgeFamily bridgeFamilies[] = {
+        {"tcp_bridge_reconnects_total", "Device links re-established after a loss.", &BridgeMetrics::reconnects},
+        {"tcp_bridge_connect_failures_total", "Device connect attempts that failed or timed out.", &BridgeMetrics::connectFailures},
+        {"tcp_bridge_clients_accepted_total", "Client connections accepted.", &BridgeMetrics::clientsAccepted},
+        {"tcp_bridge_subscribers_dropped_total", "Broadcast clients dropped for lagging.", &BridgeMetrics::subscribersDropped},
+        {"tcp_bridge_clients_reaped_total", "Clients closed for exceeding the idle timeout.", &BridgeMetrics::clientsReaped},
+        {"tcp_bridge_cache_hits_total", "Modbus requests answered from the response cache.", &BridgeMetrics::cacheHits},
+        {"tcp_bridge_cache_misses_total", "Cacheable Modbus requests sent to the device.", &BridgeMetrics::cacheMisses},
+        {"tcp_bridge_requests_coalesced_total", "Modbus requests answered by an identical request already in flight.",
+         &BridgeMetrics::requestsCoalesced},
+    };
+    for (const auto& family : bridgeFamilies)
+    {
+        appendFamily(out, family.name, "counter", family.help);
+        for (const BridgeMetrics* bridge : bridges)
+        {
+            appendSample(out, family.name, bridgeLabels(*bridge), std::to_string((bridge->*family.counter).load()));
+        }
+    }
+
+    appendFamily(out, "tcp_bridge_dwell_outliers_total", "counter", "Forwarded spans slower than the outlier threshold.");
+    for (const BridgeMetrics* bridge : bridges)
+    {
+        appendSample(out, "tcp_bridge_dwell_outliers_total", bridgeLabels(*bridge), std::to_string(bridge->dwellOutliers.total()));
+    }
+
+    appendFamily(out, "tcp_bridge_clients_active", "gauge", "Clients currently attached.");
+    for (const BridgeMetrics* bridge : bridges)
+    {
+        appendSample(out, "tcp_bridge_clients_active", bridgeLabels(*bridge), std::to_string(bridge->clientsActive.load()));
+    }
+    appendFamily(out, "tcp_bridge_link_up", "gauge", "1 while the device link is up.");
+    for (const BridgeMetrics* bridge : bridges)
+    {
+        appendSample(out, "tcp_bridge_link_up", bridgeLabels(*bridge), bridge->linkUp ? "1" : "0");
+    }
+
+    const DirectionFamily clientFamilies[] = {
+        {"tcp_bridge_client_bytes_total", "Payload bytes forwarded for one client.", &DirectionMetrics::bytes},
+        {"tcp_bridge_client_chunks_total", "Reads from, or writes handed to, one client.", &DirectionMetrics::chunks},
+    };
+    std::vector<std::vector<std::shared_ptr<ClientMetrics>>> clientLists;
+    for (const BridgeMetrics* bridge : bridges)
+    {
+        clientLists.push_back(bridge->clientList());
+    }
+    for (const auto& family : clientFamilies)
+    {
+        appendFamily(out, family.name, "counter", family.help);
+        for (size_t b = 0; b < bridges.size(); ++b)
+        {
+            for (const auto& client : clientLists[b])
+            {
+                const std::string labels = bridgeLabels(*bridges[b]) + ",client=\"" + std::to_string(client->id) +
+                                           "\",peer=\"" + client->peer + "\"";
+                appendSample(out, family.name, labels + ",direction=\"up\"", std::to_string((client->up.*family.counter).load()));
+                appendSample(out, family.name, labels + ",direction=\"down\"", std::to_string((client->down.*family.counter).load()));
+            }
+        }
+    }
+
+    struct HistogramFamily
+    {
+        const char* name;
+        const char* help;
+        const LatencyHistogram BridgeMetrics::*hist;
+        const char* extraLabels;
+        double perSecond;
+    };
+    const HistogramFamily histogramFamilies[] = {
+        {"tcp_bridge_device_rtt_seconds", "Heartbeat round trips to the device.", &BridgeMetrics::deviceRtt, "", 1e6},
+        {"tcp_bridge_modbus_transaction_seconds", "Modbus request to response time.", &BridgeMetrics::modbusTransaction, "", 1e6},
+        {"tcp_bridge_send_stall_seconds", "How long queued data waited for a writable socket.", &BridgeMetrics::stallUp, ",direction=\"up\"", 1e6},
+        {"tcp_bridge_send_stall_seconds", nullptr, &BridgeMetrics::stallDown, ",direction=\"down\"", 1e6},
+        {"tcp_bridge_dwell_seconds", "Time forwarded bytes spent inside the bridge, read to write.", &BridgeMetrics::dwellUp, ",direction=\"up\"", 1e9},
+        {"tcp_bridge_dwell_seconds", nullptr, &BridgeMetrics::dwellDown, ",direction=\"down\"", 1e9},
+    };
+    for (const auto& family : histogramFamilies)
+    {
+        if (family.help)
+        {
+            appendFamily(out, family.name, "histogram", family.help);
+        }
+        for (const BridgeMetrics* bridge : bridges)
+        {
+            appendHistogram(out, family.name, bridgeLabels(*bridge) + family.extraLabels, bridge->*family.hist,
+                            family.perSecond);
+        }
+    }
+    return out;
+}
+
+std::string formatBinary(const std::vector<const BridgeMetrics*>& bridges)
+{
+    std::string out = "TBM1";
+    appendVarint(out, bridges.size());
+    for (const BridgeMetrics* bridge : bridges)
+    {
+        appendVarint(out, static_cast<uint64_t>(bridge->listenPort));
+        appendVarint(out, static_cast<uint64_t>(bridge->remotePort));
+        appendString(out, bridge->remoteIp);
+        appendVarint(out, bridge->linkUp ? 1 : 0);
+        appendVarint(out, static_cast<uint64_t>(std::max<int64_t>(0, bridge->clientsActive.load())));
+
+        const uint64_t counters[] = {
+            bridge->up.bytes.load(),       bridge->down.bytes.load(),   bridge->up.chunks.load(),
+            bridge->down.chunks.load(),    bridge->up.stalls.load(),    bridge->down.stalls.load(),
+            bridge->reconnects.load(),     bridge->connectFailures.load(), bridge->clientsAccepted.load(),
+            bridge->subscribersDropped.load(), bridge->clientsReaped.load(), bridge->cacheHits.load(),
+            bridge->cacheMisses.load(),        bridge->requestsCoalesced.load(),
+        };
+        appendVarint(out, sizeof(counters) / sizeof(counters[0]));
+        for (uint64_t value : counters)
+        {
+            appendVarint(out, value);
+        }
+
+        const LatencyHistogram* histograms[] = {&bridge->deviceRtt, &bridge->modbusTransaction, &bridge->stallUp,
+                                                &bridge->stallDown, &bridge->dwellUp, &bridge->dwellDown};
+        appendVarint(out, sizeof(histograms) / sizeof(histograms[0]));
+        for (const LatencyHistogram* hist : histograms)
+        {
+            appendBinaryHistogram(out, *hist);
+        }
+
+        const auto clients = bridge->clientList();
+        appendVarint(out, clients.size());
+        for (const auto& client : clients)
+        {
+            appendVarint(out, client->id);
+            appendString(out, client->peer);
+            appendVarint(out, client->up.bytes.load());
+            appendVarint(out, client->down.bytes.load());
+            appendVarint(out, client->up.chunks.load());
+            appendVarint(out, client->down.chunks.load());
+            appendVarint(out, client->down.stalls.load());
+        }
+    }
+    return out;
+}
+
+std::string formatOutliers(const std::vector<const BridgeMetrics*>& bridges)
+{
+    struct Entry
+    {
+        const BridgeMetrics* bridge;
+        DwellOutlier outlier;
+    };
+    std::vector<Entry> entries;
+    for (const BridgeMetrics* bridge : bridges)
+    {
+        for (const DwellOutlier& outlier : bridge->dwellOutliers.snapshot())
+        {
+            entries.push_back({bridge, outlier});
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.outlier.egressTicks > b.outlier.egressTicks; });
+
+    const uint64_t now = TraceClock::now();
+    std::string out;
+    for (const Entry& entry : entries)
+    {
+        const DwellOutlier& o = entry.outlier;
+        const uint64_t age = now > o.egressTicks ? TraceClock::toNanos(now - o.egressTicks) : 0;
+        char line[256];
+        std::snprintf(line, sizeof(line),
+                      "listen %d remote %s:%d %s client=%llu bytes=%llu dwell_us=%.3f age_ms=%llu\n",
+                      entry.bridge->listenPort, entry.bridge->remoteIp.c_str(), entry.bridge->remotePort,
+                      o.up ? "up" : "down", static_cast<unsigned long long>(o.client),
+                      static_cast<unsigned long long>(o.bytes), static_cast<double>(o.dwellNanos) / 1e3,
+                      static_cast<unsigned long long>(age / 1000000));
+        out += line;
+    }
+    return out;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Counter with one writing thread (the bridge's loop) and any number of readers. The writer
+// never issues a locked read-modify-write; readers may see a value a few updates old.
+class MetricCounter
+{
+public:
+    void add(uint64_t n = 1)
+    {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    uint64_t load() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+// Log-linear latency histogram in the HDR style: values below 32 get a bucket each, above
+// that every power of two is split into 16 equal buckets, so any recorded value is known to
+// within 1/16 of itself. Single writer, like MetricCounter; values are microseconds unless
+// the owner says otherwise.
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned kSubBits = 4;
+    static constexpr unsigned kMaxBits = 40; // larger values (12 days in us, 18 min in ns) are clamped
+    static constexpr size_t kBuckets = (kMaxBits - kSubBits + 1) << kSubBits;
+
+    void record(uint64_t micros);
+
+    uint64_t count() const { return total.load(); }
+    uint64_t sum() const { return sumUs.load(); }
+    uint64_t max() const { return maxUs.load(std::memory_order_relaxed); }
+    uint64_t bucket(size_t index) const { return buckets[index].load(); }
+
+    // Smallest bucket bound at or below which a q share of the samples lie (0 when empty)
+    uint64_t quantile(double q) const;
+
+    static size_t bucketIndex(uint64_t micros);
+    // Largest value that lands in the bucket
+    static uint64_t bucketUpperBound(size_t index);
+
+private:
+    MetricCounter buckets[kBuckets];
+    MetricCounter total;
+    MetricCounter sumUs;
+    std::atomic<uint64_t> maxUs{0};
+};
+
+// One send direction of a bridge or client
+struct DirectionMetrics
+{
+    MetricCounter bytes;
+    MetricCounter chunks; // socket reads on the way in, or writes handed on for clients
+    MetricCounter stalls; // times a send would block and data had to be queued
+};
+
+struct ClientMetrics
+{
+    uint64_t id = 0;  // accept order within the bridge
+    std::string peer; // "ip:port"
+    DirectionMetrics up;   // client -> device
+    DirectionMetrics down; // device -> client
+};
+
+// A forwarded span that sat in the bridge longer than the outlier threshold
+struct DwellOutlier
+{
+    bool up = false;          // client -> device
+    uint64_t client = 0;      // accept order of the client whose bytes these were
+    uint64_t bytes = 0;
+    uint64_t dwellNanos = 0;  // ingress read to the write that finished them
+    uint64_t egressTicks = 0; // TraceClock reading when they left
+};
+
+// The latest outliers, older ones overwritten. One writer (the bridge's loop); a reader copies
+// each slot between two reads of its sequence number and skips slots being rewritten, so
+// neither side ever waits for the other.
+class OutlierRing
+{
+public:
+    static constexpr size_t kCapacity = 64;
+
+    void push(const DwellOutlier& outlier);
+
+    // Outliers still in the ring, oldest first
+    std::vector<DwellOutlier> snapshot() const;
+
+    // Outliers ever pushed
+    uint64_t total() const { return written.load(std::memory_order_acquire); }
+
+private:
+    static constexpr size_t kWords = 5;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> seq{0}; // odd while the writer is inside
+        std::atomic<uint64_t> words[kWords] = {};
+    };
+
+    Slot slots[kCapacity];
+    std::atomic<uint64_t> written{0};
+};
+
+// Everything a bridge exports. Counters are written by the bridge's loop thread only; the
+// client list is locked on connect and disconnect, never while forwarding.
+struct BridgeMetrics
+{
+    std::string remoteIp;
+    int remotePort = 0;
+    int listenPort = 0;
+
+    DirectionMetrics up;
+    DirectionMetrics down;
+    MetricCounter reconnects;
+    MetricCounter connectFailures;
+    MetricCounter clientsAccepted;
+    MetricCounter subscribersDropped;
+    MetricCounter clientsReaped;     // closed for sitting idle past the client idle timeout
+    MetricCounter cacheHits;         // modbus requests answered from the response cache
+    MetricCounter cacheMisses;       // cacheable modbus requests that had to go to the device
+    MetricCounter requestsCoalesced; // modbus requests that joined an identical one in flight
+    std::atomic<int64_t> clientsActive{0};
+    std::atomic<bool> linkUp{false};
+
+    LatencyHistogram deviceRtt;
+    LatencyHistogram modbusTransaction;
+    LatencyHistogram stallUp;   // how long client data waited for the device socket
+    LatencyHistogram stallDown; // how long device data waited for a client socket
+    LatencyHistogram dwellUp;   // nanoseconds from a client read to the device write
+    LatencyHistogram dwellDown; // nanoseconds from a device read to the client write
+    OutlierRing dwellOutliers;
+
+    std::shared_ptr<ClientMetrics> addClient(uint64_t id, std::string peer);
+    void removeClient(const std::shared_ptr<ClientMetrics>& client);
+    std::vector<std::shared_ptr<ClientMetrics>> clientList() const;
+
+private:
+    mutable std::mutex clientMutex;
+    std::vector<std::shared_ptr<ClientMetrics>> clients;
+};
+
+// Prometheus text exposition format (version 0.0.4)
+std::string formatPrometheus(const std::vector<const BridgeMetrics*>& bridges);
+
+// Compact binary snapshot; every number is an unsigned LEB128 varint, strings are a length
+// varint followed by the bytes:
+//   "TBM1" bridgeCount
+//   per bridge:    listenPort remotePort remoteIp linkUp clientsActive
+//                  counterCount bytesUp bytesDown chunksUp chunksDown stallsUp stallsDown
+//                               reconnects connectFailures clientsAccepted subscribersDropped
+//                               clientsReaped cacheHits cacheMisses requestsCoalesced
+//                  histogramCount, per histogram (deviceRtt modbusTransaction stallUp stallDown,
+//                                                 then dwellUp dwellDown in nanoseconds):
+//                      count sumUs maxUs nonEmpty, nonEmpty x (bucketIndexDelta bucketCount)
+//                  clientCount, per client: id peer bytesUp bytesDown chunksUp chunksDown stallsDown
+// Readers skip trailing counters and histograms they do not know.
+std::string formatBinary(const std::vector<const BridgeMetrics*>& bridges);
+
+// Dwell outliers of every bridge, one line each, newest first
+std::string formatOutliers(const std::vector<const BridgeMetrics*>& bridges);
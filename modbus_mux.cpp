@@ -0,0 +1,160 @@
+#include "modbus_mux.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace {
+
+uint16_t readBe16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+void writeBe16(uint8_t* p, uint16_t value)
+{
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value & 0xFF);
+}
+
+} // namespace
+
+int ModbusMux::frameSize(const uint8_t* data, size_t size)
+{
+    if (size < kHeaderSize)
+    {
+        return 0;
+    }
+    // Length counts the unit ID plus the PDU (function code and at most 252 data bytes)
+    const uint16_t length = readBe16(data + 4);
+    if (readBe16(data + 2) != 0 || length < 2 || length > kMaxFrameSize - 6)
+    {
+        return -1;
+    }
+    const size_t total = 6 + static_cast<size_t>(length);
+    return size >= total ? static_cast<int>(total) : 0;
+}
+
+bool ModbusMux::isWrite(const uint8_t* frame)
+{
+    switch (frame[7])
+    {
+    case 5:  // write single coil
+    case 6:  // write single register
+    case 15: // write multiple coils
+    case 16: // write multiple registers
+    case 22: // mask write register
+    case 23: // read/write multiple registers
+        return true;
+    default:
+        return false;
+    }
+}
+
+void ModbusMux::mapRequest(uint8_t* frame, SOCKET_T client, size_t size)
+{
+    if (isWrite(frame))
+    {
+        // Keys start after the transaction ID, so the unit ID is their fifth byte
+        for (auto it = joinable.begin(); it != joinable.end();)
+        {
+            it = it->first[4] == static_cast<char>(frame[6]) ? joinable.erase(it) : std::next(it);
+        }
+    }
+    const uint16_t linkTid = nextTid++;
+    auto previous = txns.find(linkTid);
+    if (previous != txns.end())
+    {
+        // Unanswered for 65536 requests; nobody can join it any more
+        retire(linkTid, previous->second);
+    }
+    Txn& txn = txns[linkTid];
+    txn = Txn{client, readBe16(frame), std::chrono::steady_clock::now(), std::string(), {}};
+    if (size > 0)
+    {
+        txn.key.assign(reinterpret_cast<const char*>(frame) + 2, size - 2);
+        joinable[txn.key] = linkTid;
+    }
+    writeBe16(frame, linkTid);
+}
+
+bool ModbusMux::joinInflight(const uint8_t* frame, size_t size, SOCKET_T client)
+{
+    auto it = joinable.find(std::string(reinterpret_cast<const char*>(frame) + 2, size - 2));
+    if (it == joinable.end())
+    {
+        return false;
+    }
+    txns[it->second].followers.push_back(Waiter{client, readBe16(frame)});
+    return true;
+}
+
+SOCKET_T ModbusMux::mapResponse(uint8_t* frame, uint64_t* elapsedUs, std::vector<Waiter>* followers)
+{
+    auto it = txns.find(readBe16(frame));
+    if (it == txns.end())
+    {
+        return INVALID_SOCKET_T;
+    }
+    Txn txn = std::move(it->second);
+    retire(it->first, txn);
+    txns.erase(it);
+    writeBe16(frame, txn.clientTid);
+    if (elapsedUs)
+    {
+        *elapsedUs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - txn.sentAt).count());
+    }
+    if (followers)
+    {
+        *followers = std::move(txn.followers);
+    }
+    return txn.client;
+}
+
+void ModbusMux::forgetClient(SOCKET_T client)
+{
+    for (auto it = txns.begin(); it != txns.end();)
+    {
+        Txn& txn = it->second;
+        txn.followers.erase(std::remove_if(txn.followers.begin(), txn.followers.end(),
+                                           [client](const Waiter& waiter) { return waiter.client == client; }),
+                            txn.followers.end());
+        if (txn.client != client)
+        {
+            ++it;
+        }
+        else if (!txn.followers.empty())
+        {
+            // Others joined the request; the first of them inherits it
+            txn.client = txn.followers.front().client;
+            txn.clientTid = txn.followers.front().clientTid;
+            txn.followers.erase(txn.followers.begin());
+            ++it;
+        }
+        else
+        {
+            retire(it->first, txn);
+            it = txns.erase(it);
+        }
+    }
+}
+
+void ModbusMux::clear()
+{
+    txns.clear();
+    joinable.clear();
+}
+
+void ModbusMux::retire(uint16_t linkTid, const Txn& txn)
+{
+    if (txn.key.empty())
+    {
+        return;
+    }
+    auto it = joinable.find(txn.key);
+    if (it != joinable.end() && it->second == linkTid)
+    {
+        joinable.erase(it);
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "net_io.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Lets many Modbus TCP masters share one device link. Requests get a transaction ID that is
+// unique on the link; the response carrying that ID is routed back to the client that sent
+// the request, with the client's own ID restored.
+//
+// Single flight: a request mapped as joinable can be joined by later requests that are
+// identical but for their transaction ID, while it is in flight. Those are never sent; the one
+// response goes to every client that asked, so device load stays flat however many masters
+// poll the same registers. A write to a unit ends the joinable requests to it, so nothing
+// asked after the write is answered with a value read before it.
+class ModbusMux
+{
+public:
+    // A client waiting for a response, and the transaction ID it expects in it
+    struct Waiter
+    {
+        SOCKET_T client;
+        uint16_t clientTid;
+    };
+
+    // MBAP header: transaction ID, protocol ID (0), length, unit ID
+    static constexpr size_t kHeaderSize = 7;
+    static constexpr size_t kMaxFrameSize = 260;
+
+    // Size of the frame at the front of data: >0 when complete, 0 when more bytes are
+    // needed, -1 when the bytes cannot be an MBAP frame
+    static int frameSize(const uint8_t* data, size_t size);
+
+    // Whether a complete request frame changes device state (function 5, 6, 15, 16, 22, 23)
+    static bool isWrite(const uint8_t* frame);
+
+    // Rewrite the request's transaction ID to a link-unique one owned by client.
+    // IDs are handed out in sequence, so an ID is only reused after 65536 newer requests;
+    // a request still unanswered by then is forgotten. Passing the frame's size makes the
+    // request joinable.
+    void mapRequest(uint8_t* frame, SOCKET_T client, size_t size = 0);
+
+    // Attach a request to an identical joinable one in flight; false when there is none and
+    // the request has to be mapped and sent
+    bool joinInflight(const uint8_t* frame, size_t size, SOCKET_T client);
+
+    // Restore the client's transaction ID in a response and return that client,
+    // INVALID_SOCKET_T when the ID is not in flight. elapsedUs, when given, receives the time
+    // since the request was mapped; followers, the clients that joined the request.
+    SOCKET_T mapResponse(uint8_t* frame, uint64_t* elapsedUs = nullptr, std::vector<Waiter>* followers = nullptr);
+
+    // Forget the requests of a client that went away
+    void forgetClient(SOCKET_T client);
+
+    // Forget everything (the device link was lost)
+    void clear();
+
+    size_t inflight() const { return txns.size(); }
+
+private:
+    struct Txn
+    {
+        SOCKET_T client;
+        uint16_t clientTid;
+        std::chrono::steady_clock::time_point sentAt;
+        std::string key; // joinable requests: the frame after its transaction ID
+        std::vector<Waiter> followers;
+    };
+
+    std::unordered_map<uint16_t, Txn> txns;
+    std::unordered_map<std::string, uint16_t> joinable; // request key -> link ID in flight
+    uint16_t nextTid = 0;
+
+    void retire(uint16_t linkTid, const Txn& txn);
+};
@@ -3,7 +3,9 @@
 //#include "special_math.h"
 //#include "file.h"
 #include "net_io.h"
-#include <iostream>
+#include "chunk_pool.h"
+#include "uring_io.h"
+#include "logger.h"
 #include <chrono>
 //#include "spdloguse.h"
 
@@ -19,6 +21,7 @@ typedef int sockaddr_size_t;
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <sys/uio.h>
 
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -59,20 +62,74 @@ static bool SetRecvTimeout(SOCKET_T s, int ms)
 #endif
 }
 
+bool SetSocketNonBlocking(SOCKET_T s, bool enable)
+{
+#ifdef _WIN32
+    unsigned long on = enable ? 1 : 0;
+    return ioctlsocket(s, FIONBIO, &on) == 0;
+#else
+    int flags = fcntl(s, F_GETFL, 0);  // 获取当前文件描述符标志
+    if (flags == -1)
+        return false;
+    flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(s, F_SETFL, flags) != -1;
+#endif
+}
+
+int SendSocketV(SOCKET_T s, const NetIoVec* bufs, int count)
+{
+    // beyond this many buffers the caller simply sends again
+    constexpr int kMaxVecs = 64;
+    if (count > kMaxVecs)
+        count = kMaxVecs;
+#ifdef _WIN32
+    WSABUF vecs[kMaxVecs];
+    for (int i = 0; i < count; ++i)
+    {
+        vecs[i].buf = (char*)bufs[i].data;
+        vecs[i].len = (ULONG)bufs[i].size;
+    }
+    DWORD sent = 0;
+    if (WSASend(s, vecs, count, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+        return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+    return (int)sent;
+#else
+    iovec vecs[kMaxVecs];
+    for (int i = 0; i < count; ++i)
+    {
+        vecs[i].iov_base = (void*)bufs[i].data;
+        vecs[i].iov_len = bufs[i].size;
+    }
+    msghdr msg{};
+    msg.msg_iov = vecs;
+    msg.msg_iovlen = count;
+    int flags = MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+#endif
+    ssize_t sent = sendmsg(s, &msg, flags);
+    if (sent < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    return (int)sent;
+#endif
+}
+
 static int GetSockError()
 {
 #ifdef _WIN32
-    return GetLastError();
+    return WSAGetLastError();
 #else
     return errno;
 #endif
 }
 
+// Nothing to read or write right now: a receive timeout on blocking sockets, would-block on
+// the non-blocking device and listen sockets
 static bool IsErrorTimeout()
 {
 #ifdef _WIN32
-    int err = GetLastError();
-    return err == 10060;
+    int err = WSAGetLastError();
+    return err == WSAETIMEDOUT || err == WSAEWOULDBLOCK || err == WSAEINTR;
 #else
     return (errno == EINTR || errno == EWOULDBLOCK || errno == EAGAIN);
 #endif
@@ -244,11 +301,11 @@ bool NetUdpIO::ReadClear()
     if (Open())
     {
         SetRecvTimeout(sock, 1);
-        std::unique_ptr<uint8_t[]> buf = std::make_unique<uint8_t[]>(0x400);
+        ChunkRef buf = ChunkRef::acquire();
         while (true)
         {
             int size = 0;
-            int ret = Read(buf.get(), 0x400, &size);
+            int ret = Read(buf.data(), static_cast<int>(buf.capacity()), &size);
             if (size == 0)
                 break;
         }
@@ -292,17 +349,58 @@ int NetUdpIO::sendto(SOCKET_T sock, const void *buf, size_t size, std::string re
 //#endif
 //}
 
+NetTcpIO::NetTcpIO() = default;
+
+NetTcpIO::NetTcpIO(NetTcpPARAM param)
+{
+    Param = param;
+}
+
+NetTcpIO::~NetTcpIO() = default;
+
 bool NetTcpIO::Open()
 {
 	std::lock_guard<std::mutex> guard(m_OpenAct);
 	if (!bOpen)
 	{
+        if (!PrepareSocket())
+            return 0;
+
+        bool ret = false;
+        if(Param.bServer)
+            ret = RunServer();
+        else
+            ret = ConnectServer();
+        if(ret == false)
+        {
+            DoClose();
+            return 0;
+        }
+        if (!Param.bServer || Param.bManualAccept)
+            CompleteOpen();
+        else
+            bOpen = true;
+        return 1;
+	}
+	return 1;
+}
+
+bool NetTcpIO::PrepareSocket()
+{
         InitSocketSystem();
         assert(sock == INVALID_SOCKET_T);
         sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
 		if (sock == INVALID_SOCKET_T)
-            return 0;
+            return false;
 
+#ifndef _WIN32
+        if (Param.bServer)
+        {
+            // allow an immediate rebind while old connections sit in TIME_WAIT
+            int opt = 1;
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        }
+#endif
         //printf("bind\r\n");
         sockaddr_in address{};
         address.sin_family = AF_INET;
@@ -347,23 +445,121 @@ bool NetTcpIO::Open()
         if(SetTcpRecvTimeout() == false)
         {
             DoClose();
-            return 0;
+            return false;
         }
+        return true;
+}
 
-        bool ret = false;
-        if(Param.bServer)
-            ret = RunServer();
-        else
-            ret = ConnectServer();
-        if(ret == false)
-        {
-            DoClose();
-            return 0;
-        }
-        bOpen = true;
+void NetTcpIO::CompleteOpen()
+{
+    if (Param.bIoUring)
+        StartIoUring();
+    bOpen = true;
+}
+
+int NetTcpIO::BeginConnect()
+{
+    std::lock_guard<std::mutex> guard(m_OpenAct);
+    if (bOpen)
         return 1;
-	}
-	return 1;
+    if (sock != INVALID_SOCKET_T)
+        return 0; // the earlier connect is still in flight
+    if (Param.bServer || !PrepareSocket())
+        return -1;
+    if (!SetSocketNonBlocking(sock, true))
+    {
+        DoClose();
+        return -1;
+    }
+
+    sockaddr_in server_addr{};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(Param.RemotePort);
+    server_addr.sin_addr.s_addr = inet_addr(Param.RemoteIp.c_str());
+    if (::connect(sock, (sockaddr*)&(server_addr), sizeof(server_addr)) == 0)
+    {
+        CompleteOpen();
+        return 1;
+    }
+#ifdef _WIN32
+    const bool inProgress = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    const bool inProgress = GetSockError() == EINPROGRESS;
+#endif
+    if (!inProgress)
+    {
+        DoClose();
+        return -1;
+    }
+    return 0;
+}
+
+int NetTcpIO::FinishConnect()
+{
+    std::lock_guard<std::mutex> guard(m_OpenAct);
+    if (bOpen)
+        return 1;
+    if (sock == INVALID_SOCKET_T)
+        return -1;
+    int err = 0;
+    sockaddr_size_t len = sizeof(err);
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&err, &len) < 0 || err != 0)
+    {
+        DoClose();
+        return -1;
+    }
+    // no error yet may still mean no peer yet
+    sockaddr_in peer{};
+    sockaddr_size_t peerLen = sizeof(peer);
+    if (getpeername(sock, (sockaddr*)&peer, &peerLen) < 0)
+        return 0;
+    CompleteOpen();
+    return 1;
+}
+
+void NetTcpIO::StartIoUring()
+{
+    // io_uring parks blocked operations on its own poll queue, which O_NONBLOCK would defeat
+    const bool wasNonBlocking = Param.bManualAccept || Param.bRefConnectTimeout;
+    SetSocketNonBlocking(sock, false);
+    uring = std::make_unique<UringIO>();
+    if (!uring->init(sock, Param.bServer != 0))
+    {
+        // kernel lacks support: stay on the plain socket path
+        uring.reset();
+        SetSocketNonBlocking(sock, wasNonBlocking);
+    }
+}
+
+SOCKET_T NetTcpIO::GetPollFd() const
+{
+    return uring ? uring->eventFd() : sock;
+}
+
+void NetTcpIO::ClearPollEvent()
+{
+    if (uring)
+    {
+        uring->clearEvent();
+    }
+}
+
+bool NetTcpIO::UringLinkLost() const
+{
+    return uring && uring->linkLost();
+}
+
+uint64_t NetTcpIO::UringBytesReceived() const
+{
+    return uring ? uring->bytesReceived() : 0;
+}
+
+bool NetTcpIO::SetNonBlocking(bool enable)
+{
+    bNonBlock = enable;
+    if (uring)
+        return true; // the ring never blocks on the socket itself
+    return sock != INVALID_SOCKET_T && SetSocketNonBlocking(sock, enable);
 }
 
 bool NetTcpIO::Close()
@@ -392,6 +588,7 @@ bool NetTcpIO::isSocketReadable(int timeout_sec)
 bool NetTcpIO::DoClose()
 {
     bOpen = false;
+    uring.reset();
     if(sock == INVALID_SOCKET_T)
         return 1;
 #ifdef _WIN32
@@ -420,25 +617,10 @@ bool NetTcpIO::ConnectServer()
     if (Param.bRefConnectTimeout != 0)
     {
         //socket设置为非阻塞 
-#ifdef _WIN32
-         unsigned long on = 1;
-         if (ioctlsocket(sock, FIONBIO, &on) < 0) {
-             //printf("ioctlsocket failed\n");
-             return false;
-         }
-#else
-         int flags = fcntl(sock, F_GETFL, 0);  // 获取当前文件描述符标志
-         if (flags == -1) {
-             perror("fcntl(F_GETFL)");
-             return false;
-         }
-
-         flags |= O_NONBLOCK;  // 设置非阻塞标志
-         if (fcntl(sock, F_SETFL, flags) == -1) {  // 更新文件描述符标志
-             perror("fcntl(F_SETFL)");
-             return false;
-         }
-#endif
+        if (!SetSocketNonBlocking(sock, true)) {
+            logWarn("SetSocketNonBlocking failed: error {}", GetSockError());
+            return false;
+        }
 
         //尝试连接
         sockaddr_in clientService{};
@@ -447,7 +629,7 @@ bool NetTcpIO::ConnectServer()
         clientService.sin_port = htons(Param.RemotePort);
         int ret = connect(sock, (struct sockaddr*)&clientService, sizeof(clientService));
         if (ret == 0) {
-            printf("connect success1\n");
+            logDebug("connected to {}:{}", Param.RemoteIp, Param.RemotePort);
             return true;
         }
 
@@ -472,7 +654,7 @@ bool NetTcpIO::ConnectServer()
         tv.tv_usec = 0;//10000;
         ret = select(sock + 1, nullptr, &writeset, nullptr, &tv);
         if (ret == 0) {
-            printf("connect timeout\n");
+            logDebug("connect to {}:{} timed out", Param.RemoteIp, Param.RemotePort);
             return false;
         }
         else if (ret < 0) {
@@ -503,9 +685,14 @@ bool NetTcpIO::ConnectServer()
 
 bool NetTcpIO::RunServer()
 {
-    int ret = ::listen(sock, 2);
+    int ret = ::listen(sock, Param.ListenBacklog);
     if(ret < 0)
         return false;
+    if (Param.bManualAccept)
+    {
+        // the owner's event loop watches the listen socket and calls Accept()
+        return SetSocketNonBlocking(sock, true);
+    }
     //std::cout << "listening..." << std::endl;
     auto listenfunc = [=]() {
         while (true)
@@ -517,7 +704,7 @@ bool NetTcpIO::RunServer()
             if (newconnect == INVALID_SOCKET_T)
             {
                 auto err = GetSockError();
-                std::cout << "error:" << err << std::endl;
+                logWarn("accept failed: error {}", err);
                 break;
             }
             if(Param.ServerFunc)
@@ -528,6 +715,43 @@ bool NetTcpIO::RunServer()
     return true;
 }
 
+bool NetTcpIO::Accept(SOCKET_T* pClient)
+{
+    if (!bOpen || !Param.bServer)
+        return false;
+    if (uring)
+    {
+        // connections were already taken by the multishot accept
+        SOCKET_T accepted = uring->accept();
+        if (accepted == INVALID_SOCKET_T)
+            return false;
+        if (pClient)
+            *pClient = accepted;
+        return true;
+    }
+    SOCKET_T newconnect = INVALID_SOCKET_T;
+    while (newconnect == INVALID_SOCKET_T)
+    {
+        sockaddr_in clientaddr{};
+        sockaddr_size_t clientaddrsize = sizeof(sockaddr_in);
+        newconnect = ::accept(sock, (sockaddr*)&(clientaddr), &clientaddrsize);
+        if (newconnect != INVALID_SOCKET_T)
+            break;
+#ifndef _WIN32
+        // the peer gave up while queued; keep draining the backlog
+        if (GetSockError() == ECONNABORTED)
+            continue;
+#endif
+        // EAGAIN simply means the backlog is drained
+        if (!IsErrorTimeout())
+            logWarn("accept failed: error {}", GetSockError());
+        return false;
+    }
+    if (pClient)
+        *pClient = newconnect;
+    return true;
+}
+
 bool NetTcpIO::SetTcpRecvTimeout()
 {
     if(Param.bRefRecvTimeout)
@@ -548,8 +772,25 @@ bool NetTcpIO::SetTcpRecvTimeout()
 
 bool NetTcpIO::Read(uint8_t* pData, int DataSize, int* pReadSize)
 {
-    if (Open())
+    // only take the open lock when a reconnect is actually needed
+    if (bOpen || (!Param.bNoReconnect && Open()))
     {
+        if (uring)
+        {
+            int Ret = uring->recv(pData, DataSize, bNonBlock ? 0 : (Param.bRefRecvTimeout ? Param.RecvTimeout : -1));
+            if (Ret < 0)
+            {
+                // peer closed or socket error
+                if (pReadSize)
+                    *pReadSize = 0;
+                Close();
+                bOpen = false;
+                return 0;
+            }
+            if (pReadSize)
+                *pReadSize = Ret;
+            return Ret > 0;
+        }
         //if (!isSocketReadable(5)) // 等待 5 秒，确认可读
         //{
         //    if (pReadSize) *pReadSize = 0;
@@ -615,14 +856,14 @@ bool NetTcpIO::Read(uint8_t* pData, int DataSize, int* pReadSize)
 
 bool NetTcpIO::ReadClear()
 {
-	if (Open())
+	if (bOpen || (!Param.bNoReconnect && Open()))
 	{
 		SetRecvTimeout(sock, 1);
-		std::unique_ptr<uint8_t[]> buf = std::make_unique<uint8_t[]>(0x400);
+		ChunkRef buf = ChunkRef::acquire();
 		while (true)
 		{
 			int size = 0;
-			int ret = Read(buf.get(), 0x400, &size);
+			int ret = Read(buf.data(), static_cast<int>(buf.capacity()), &size);
 			if (size == 0)
 				break;
 		}
@@ -637,6 +878,22 @@ bool NetTcpIO::Write(const uint8_t* pData, int DataSize, int* pWriteSize)
 {
     if (bOpen)
     {
+        if (uring)
+        {
+            // staged into the registered buffer; 0 means the staging area is full
+            int Ret = uring->send(pData, DataSize);
+            if (Ret < 0)
+            {
+                if (pWriteSize)
+                    *pWriteSize = 0;
+                bOpen = false;
+                Close();
+                return false;
+            }
+            if (pWriteSize)
+                *pWriteSize = Ret;
+            return true;
+        }
         int Ret = ::send(sock, (const char*)pData, DataSize, 0);
 
         if (Ret < 0)
@@ -712,6 +969,21 @@ bool NetTcpIO::sendData(const uint8_t* data, int dataSize)
 {
     if (!bOpen)
         return false;
+    if (uring)
+    {
+        // stage as much as fits and wait on write completions instead of select() per chunk
+        int totalSent = 0;
+        while (totalSent < dataSize)
+        {
+            int sent_size = 0;
+            if (!Write(data + totalSent, dataSize - totalSent, &sent_size))
+                return false;
+            totalSent += sent_size;
+            if (totalSent < dataSize)
+                uring->waitSent(1000);
+        }
+        return true;
+    }
     std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
 
     size_t totalSent = 0;
@@ -741,6 +1013,34 @@ bool NetTcpIO::sendData(const uint8_t* data, int dataSize)
     return true;
 }
 
+int NetTcpIO::sendDataV(const NetIoVec* bufs, int count)
+{
+    if (!bOpen)
+        return -1;
+    if (uring)
+    {
+        // the staging buffer already coalesces; one submission carries everything staged
+        int total = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            int sent_size = 0;
+            if (!Write(bufs[i].data, (int)bufs[i].size, &sent_size))
+                return -1;
+            total += sent_size;
+            if (sent_size < (int)bufs[i].size)
+                break;
+        }
+        return total;
+    }
+    int Ret = SendSocketV(sock, bufs, count);
+    if (Ret < 0)
+    {
+        bOpen = false;
+        Close();
+    }
+    return Ret;
+}
+
 //bool NetTcpIO::SetRecvTimeout(SOCKET_T s, int ms)
 //{
 //        int time_out = ms; //ms
@@ -8,6 +8,22 @@
 typedef  int SOCKET_T;
 const int INVALID_SOCKET_T = -1;
 
+class UringIO;
+
+// switch a socket between blocking and non-blocking mode
+bool SetSocketNonBlocking(SOCKET_T s, bool enable);
+
+// one buffer of a gather write
+struct NetIoVec
+{
+    const uint8_t* data;
+    size_t size;
+};
+
+// send as many of the buffers as the socket takes in one writev/sendmsg (WSASend on Windows),
+// never blocking; returns bytes sent, 0 when the socket would block, -1 on error
+int SendSocketV(SOCKET_T s, const NetIoVec* bufs, int count);
+
 
 struct NetUdpPARAM
 {
@@ -111,6 +127,9 @@ struct NetTcpPARAM
     int    bRefRecvTimeout = 0;
     int    bRefConnectTimeout = 0;
     int    bNoDelay = 0;
+    int    bManualAccept = 0; // server: listen only, the owner drains Accept() from its event loop
+    int    bIoUring = 0;      // use the io_uring backend when the kernel supports it (Linux 6.0+)
+    int    bNoReconnect = 0;  // client: Read/ReadClear never reopen a lost link, the owner reconnects
 
     std::string   LocalIp = "192.168.183.2";
     int    LocalPort = 0;
@@ -120,6 +139,7 @@ struct NetTcpPARAM
 
     int    ConnectTimeout = 0;
     int    RecvTimeout = 100; // ms
+    int    ListenBacklog = 2;
 
     TcpSerFunc ServerFunc;
 
@@ -132,12 +152,16 @@ struct NetTcpPARAM
             bRefRecvTimeout == other.bRefRecvTimeout &&
             bRefConnectTimeout == other.bRefConnectTimeout &&
             bNoDelay == other.bNoDelay &&
+            bManualAccept == other.bManualAccept &&
+            bIoUring == other.bIoUring &&
+            bNoReconnect == other.bNoReconnect &&
             LocalIp == other.LocalIp &&
             LocalPort == other.LocalPort &&
             RemoteIp == other.RemoteIp &&
             RemotePort == other.RemotePort &&
             ConnectTimeout == other.ConnectTimeout &&
-            RecvTimeout == other.RecvTimeout );
+            RecvTimeout == other.RecvTimeout &&
+            ListenBacklog == other.ListenBacklog );
     }
     // 重载 != 操作符
     bool operator!=(const NetTcpPARAM& other) const
@@ -155,15 +179,21 @@ class NetTcpIO
     int            Sock_Error = 0;
     std::mutex     m_OpenAct;
     std::unique_ptr<std::thread> listening;
+    bool           bNonBlock = false;
+    std::unique_ptr<UringIO> uring; // set while the io_uring backend drives this socket
 protected:
+    bool PrepareSocket();
     bool RunServer();
     bool ConnectServer();
+    void CompleteOpen();
     //bool IsErrorTimeout();
     bool SetTcpRecvTimeout();
     bool DoClose();
+    void StartIoUring();
 public:
-    NetTcpIO() {}
-    NetTcpIO(NetTcpPARAM param) { Param = param; }
+    NetTcpIO();
+    NetTcpIO(NetTcpPARAM param);
+    ~NetTcpIO();
 
     void  SetParam(NetTcpPARAM param) 
     { 
@@ -176,15 +206,36 @@ public:
     NetTcpPARAM GetParam() { return Param; }
 
     //int  GetSockError();
+    SOCKET_T GetSocket() const { return sock; }
+    // fd an event loop should watch: the socket, or the io_uring completion eventfd
+    SOCKET_T GetPollFd() const;
+    bool UsesIoUring() const { return uring != nullptr; }
+    // io_uring backend: reset the completion eventfd once it polled readable (no-op otherwise)
+    void ClearPollEvent();
+    // io_uring backend: the peer closed or the socket failed (plain sockets report this to the poller)
+    bool UringLinkLost() const;
+    // io_uring backend: bytes that arrived so far, read or not (0 on the plain path)
+    uint64_t UringBytesReceived() const;
+    // non-blocking Read/Write/Accept for event loops (the uring backend never blocks the socket itself)
+    bool SetNonBlocking(bool enable);
     bool CheckLinkOk() const { return bOpen; }
     bool Open();
+    // non-blocking connect for event loops: 1 connected, 0 in progress (wait for GetSocket() to
+    // turn writable, then call FinishConnect), -1 failed. Only one connect is ever in flight.
+    int BeginConnect();
+    // 1 connected, 0 still in progress, -1 failed (the socket is closed)
+    int FinishConnect();
     bool Close();
     bool isSocketReadable(int timeout_sec);
     bool Read(uint8_t* pData, int DataSize, int* pReadSize);
     bool Write(const uint8_t* pData, int DataSize, int* pWriteSize);
     bool isSocketWritable(int sockfd, int timeout_sec = 1);
     bool sendData(const uint8_t* pData, int DataSize);
+    // non-blocking gather variant of sendData for event loops: the caller waits for writability
+    // itself; returns bytes sent, 0 when the socket would block, -1 on error (the link is closed)
+    int sendDataV(const NetIoVec* bufs, int count);
     bool ReadClear();
+    bool Accept(SOCKET_T* pClient);
 
     void WaitServerFinish();
 
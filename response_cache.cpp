@@ -0,0 +1,232 @@
+#include "response_cache.h"
+
+#include "modbus_mux.h"
+
+#include <cstdlib>
+#include <iterator>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+constexpr size_t kUnitAt = 6;
+constexpr size_t kFunctionAt = 7;
+constexpr size_t kAddressAt = 8;
+constexpr size_t kQuantityAt = 10;
+
+uint16_t readBe16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+bool matches(const CacheRule& rule, const uint8_t* frame, size_t size)
+{
+    if (frame[kFunctionAt] != rule.function || (rule.unit >= 0 && frame[kUnitAt] != rule.unit))
+    {
+        return false;
+    }
+    if (rule.first == 0 && rule.last == 0xFFFF)
+    {
+        return true;
+    }
+    // Reads carry a start address and a count; the whole span has to be inside the rule's
+    if (size < kQuantityAt + 2)
+    {
+        return false;
+    }
+    const uint32_t address = readBe16(frame + kAddressAt);
+    const uint32_t quantity = readBe16(frame + kQuantityAt);
+    return quantity > 0 && address >= rule.first && address + quantity - 1 <= rule.last;
+}
+
+// Whole-string unsigned number no larger than limit
+bool parseNumber(const std::string& text, uint32_t limit, uint32_t& value)
+{
+    char* end = nullptr;
+    const unsigned long parsed = std::strtoul(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || text[0] == '-' || parsed > limit)
+    {
+        return false;
+    }
+    value = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+auto fields(const CacheRule& r)
+{
+    return std::tie(r.function, r.unit, r.first, r.last);
+}
+
+} // namespace
+
+bool operator==(const CacheRule& a, const CacheRule& b)
+{
+    return fields(a) == fields(b);
+}
+
+bool operator==(const ResponseCacheConfig& a, const ResponseCacheConfig& b)
+{
+    return std::tie(a.ttlMs, a.rules, a.maxEntries) == std::tie(b.ttlMs, b.rules, b.maxEntries);
+}
+
+bool operator!=(const ResponseCacheConfig& a, const ResponseCacheConfig& b)
+{
+    return !(a == b);
+}
+
+bool parseCacheRules(const std::string& spec, std::vector<CacheRule>& rules)
+{
+    std::vector<CacheRule> parsed;
+    size_t begin = 0;
+    while (begin <= spec.size())
+    {
+        size_t end = spec.find(',', begin);
+        end = end == std::string::npos ? spec.size() : end;
+        std::string item = spec.substr(begin, end - begin);
+        begin = end + 1;
+
+        CacheRule rule;
+        const size_t colon = item.find(':');
+        if (colon != std::string::npos)
+        {
+            const std::string range = item.substr(colon + 1);
+            const size_t dash = range.find('-');
+            if (dash == std::string::npos || !parseNumber(range.substr(0, dash), 0xFFFF, rule.first) ||
+                !parseNumber(range.substr(dash + 1), 0xFFFF, rule.last) || rule.first > rule.last)
+            {
+                return false;
+            }
+            item.resize(colon);
+        }
+        const size_t at = item.find('@');
+        uint32_t function = 0;
+        uint32_t unit = 0;
+        // Only reads may be answered from the cache: a cached write would never reach the device
+        if (!parseNumber(item.substr(0, at), 4, function) || function == 0 ||
+            (at != std::string::npos && !parseNumber(item.substr(at + 1), 255, unit)))
+        {
+            return false;
+        }
+        rule.function = static_cast<uint8_t>(function);
+        rule.unit = at == std::string::npos ? -1 : static_cast<int>(unit);
+        parsed.push_back(rule);
+    }
+    rules = std::move(parsed);
+    return true;
+}
+
+bool matchesCacheRules(const std::vector<CacheRule>& rules, const uint8_t* frame, size_t size)
+{
+    if (size <= kFunctionAt)
+    {
+        return false;
+    }
+    if (rules.empty())
+    {
+        return frame[kFunctionAt] >= 1 && frame[kFunctionAt] <= 4;
+    }
+    for (const CacheRule& rule : rules)
+    {
+        if (matches(rule, frame, size))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+ResponseCache::ResponseCache(const ResponseCacheConfig& config)
+    : ttl(std::chrono::milliseconds(config.ttlMs)), maxEntries(config.maxEntries)
+{
+}
+
+const std::string* ResponseCache::find(const uint8_t* frame, size_t size, Clock::time_point now)
+{
+    auto it = entries.find(keyOf(frame, size));
+    if (it == entries.end())
+    {
+        return nullptr;
+    }
+    if (now >= it->second.expires)
+    {
+        entries.erase(it);
+        return nullptr;
+    }
+    return &it->second.response;
+}
+
+void ResponseCache::expect(const uint8_t* frame, size_t size)
+{
+    pending[readBe16(frame)] = keyOf(frame, size);
+}
+
+void ResponseCache::store(const uint8_t* frame, size_t size, Clock::time_point now)
+{
+    auto it = pending.find(readBe16(frame));
+    if (it == pending.end())
+    {
+        return;
+    }
+    std::string key = std::move(it->second);
+    pending.erase(it);
+    if (size <= kFunctionAt || (frame[kFunctionAt] & 0x80))
+    {
+        // An exception may be transient (device busy); the next poll asks again
+        return;
+    }
+    if (entries.size() >= maxEntries && entries.find(key) == entries.end())
+    {
+        evictExpired(now);
+        if (entries.size() >= maxEntries)
+        {
+            return;
+        }
+    }
+    Entry& entry = entries[std::move(key)];
+    entry.response.assign(reinterpret_cast<const char*>(frame), size);
+    entry.expires = now + ttl;
+}
+
+void ResponseCache::invalidateFor(const uint8_t* frame, size_t size)
+{
+    if (size <= kFunctionAt || !ModbusMux::isWrite(frame))
+    {
+        return;
+    }
+    // Keys start with protocol ID and length; the unit ID follows. Reads already on the link
+    // may be answered with the value from before the write, so their answers are not kept.
+    const char unit = static_cast<char>(frame[kUnitAt]);
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        it = it->first[kUnitAt - 2] == unit ? entries.erase(it) : std::next(it);
+    }
+    for (auto it = pending.begin(); it != pending.end();)
+    {
+        it = it->second[kUnitAt - 2] == unit ? pending.erase(it) : std::next(it);
+    }
+}
+
+void ResponseCache::forgetPending()
+{
+    pending.clear();
+}
+
+std::string ResponseCache::keyOf(const uint8_t* frame, size_t size)
+{
+    return std::string(reinterpret_cast<const char*>(frame) + 2, size - 2);
+}
+
+void ResponseCache::evictExpired(Clock::time_point now)
+{
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if (now >= it->second.expires)
+        {
+            it = entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
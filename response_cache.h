@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A kind of Modbus request that may be answered from the cache: one read function, optionally
+// only for one unit and only when the addresses it reads lie within [first, last]
+struct CacheRule
+{
+    uint8_t function = 0;
+    int unit = -1; // -1 = any unit
+    uint32_t first = 0;
+    uint32_t last = 0xFFFF;
+};
+
+bool operator==(const CacheRule& a, const CacheRule& b);
+
+struct ResponseCacheConfig
+{
+    int ttlMs = 0;                // how long a response stays fresh, 0 = no cache
+    std::vector<CacheRule> rules; // empty = the read functions 1-4, any unit and address
+    size_t maxEntries = 4096;
+};
+
+bool operator==(const ResponseCacheConfig& a, const ResponseCacheConfig& b);
+bool operator!=(const ResponseCacheConfig& a, const ResponseCacheConfig& b);
+
+// Comma-separated FUNCTION[@UNIT][:FIRST-LAST] items, e.g. "3,4@1:0-99". FUNCTION must be one
+// of the read functions 1-4.
+bool parseCacheRules(const std::string& spec, std::vector<CacheRule>& rules);
+
+// Whether a complete MBAP request frame matches one of rules (empty = the default rules)
+bool matchesCacheRules(const std::vector<CacheRule>& rules, const uint8_t* frame, size_t size);
+
+// Responses of a Modbus device link, keyed by the request that produced them minus its
+// transaction ID, so identical polls from any number of masters share one entry. Entries are
+// served until ttl has passed since the device answered. A write request (function 5, 6, 15,
+// 16, 22 or 23) going through to a unit drops that unit's entries, so a master never reads
+// back its own write's old value. Exception responses are not cached. Which requests are
+// cacheable is the caller's to decide with matchesCacheRules(). Loop thread only.
+class ResponseCache
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ResponseCache(const ResponseCacheConfig& config);
+
+    // The fresh response to a cacheable request, nullptr on a miss; its transaction ID is the
+    // one it went to the device with, the caller puts the request's in its place
+    const std::string* find(const uint8_t* frame, size_t size, Clock::time_point now);
+
+    // A cacheable request went to the device, already carrying its link transaction ID
+    void expect(const uint8_t* frame, size_t size);
+
+    // A response read from the device, still carrying its link transaction ID; cached when it
+    // answers an expected request
+    void store(const uint8_t* frame, size_t size, Clock::time_point now);
+
+    // A request that is not cacheable is on its way to the device
+    void invalidateFor(const uint8_t* frame, size_t size);
+
+    // The device link dropped; requests still expected will never be answered
+    void forgetPending();
+
+    size_t size() const { return entries.size(); }
+
+private:
+    struct Entry
+    {
+        std::string response;
+        Clock::time_point expires;
+    };
+
+    Clock::duration ttl;
+    size_t maxEntries;
+    std::unordered_map<std::string, Entry> entries;    // request key -> response
+    std::unordered_map<uint16_t, std::string> pending; // link transaction ID -> request key
+
+    // Everything after the transaction ID: protocol ID, length, unit ID and PDU
+    static std::string keyOf(const uint8_t* frame, size_t size);
+    void evictExpired(Clock::time_point now);
+};
@@ -0,0 +1,38 @@
+#include "rtt_window.h"
+
+#include <algorithm>
+
+void RttWindow::record(uint32_t micros)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    window[recorded % kWindow] = micros;
+    ++recorded;
+}
+
+RttWindow::Summary RttWindow::summary() const
+{
+    uint32_t copy[kWindow];
+    Summary result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.samples = recorded;
+        std::copy(window, window + kWindow, copy);
+    }
+    const size_t count = static_cast<size_t>(std::min<uint64_t>(result.samples, kWindow));
+    if (count == 0)
+    {
+        return result;
+    }
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        sum += copy[i];
+    }
+    result.avgUs = static_cast<uint32_t>(sum / count);
+    result.minUs = *std::min_element(copy, copy + count);
+    // Nearest rank: the smallest sample with at least 99% of the window at or below it
+    const size_t rank = (count * 99 + 99) / 100 - 1;
+    std::nth_element(copy, copy + rank, copy + count);
+    result.p99Us = copy[rank];
+    return result;
+}
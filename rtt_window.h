@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// The most recent round-trip samples of one link. The loop thread records; any thread may
+// ask for a summary, which is worked out from the window on the reader's side.
+class RttWindow
+{
+public:
+    struct Summary
+    {
+        uint64_t samples = 0; // recorded since start, not just those in the window
+        uint32_t minUs = 0;
+        uint32_t avgUs = 0;
+        uint32_t p99Us = 0;
+    };
+
+    void record(uint32_t micros);
+
+    Summary summary() const;
+
+private:
+    static constexpr size_t kWindow = 256;
+
+    mutable std::mutex mutex;
+    uint32_t window[kWindow] = {};
+    uint64_t recorded = 0;
+};
@@ -0,0 +1,105 @@
+#include "splice_pipe.h"
+
+#include <cerrno>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+SplicePipe::~SplicePipe()
+{
+    close();
+}
+
+bool SplicePipe::open(size_t capacity)
+{
+#ifdef __linux__
+    close();
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        return false;
+    }
+    readFd = fds[0];
+    writeFd = fds[1];
+    // Best effort: unprivileged processes are capped by /proc/sys/fs/pipe-max-size
+    fcntl(writeFd, F_SETPIPE_SZ, static_cast<int>(capacity));
+    return true;
+#else
+    (void)capacity;
+    return false;
+#endif
+}
+
+void SplicePipe::close()
+{
+#ifdef __linux__
+    if (readFd >= 0)
+    {
+        ::close(readFd);
+        ::close(writeFd);
+    }
+#endif
+    readFd = -1;
+    writeFd = -1;
+    bytes = 0;
+}
+
+int SplicePipe::fill(SOCKET_T from, size_t maxBytes)
+{
+#ifdef __linux__
+    ssize_t n = splice(from, nullptr, writeFd, nullptr, maxBytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0)
+    {
+        bytes += static_cast<size_t>(n);
+    }
+    return static_cast<int>(n);
+#else
+    (void)from;
+    (void)maxBytes;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+bool SplicePipe::drain(SOCKET_T to)
+{
+#ifdef __linux__
+    while (bytes > 0)
+    {
+        ssize_t n = splice(readFd, nullptr, to, nullptr, bytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0)
+        {
+            bytes -= static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+            return true;
+        }
+        return false;
+    }
+    return true;
+#else
+    (void)to;
+    return bytes == 0;
+#endif
+}
+
+void SplicePipe::discard()
+{
+#ifdef __linux__
+    char sink[4096];
+    while (bytes > 0)
+    {
+        ssize_t n = read(readFd, sink, sizeof(sink));
+        if (n <= 0)
+        {
+            break;
+        }
+        bytes -= static_cast<size_t>(n) < bytes ? static_cast<size_t>(n) : bytes;
+    }
+#endif
+    bytes = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "net_io.h"
+
+#include <cstddef>
+
+// Kernel pipe used as the buffer of a zero-copy forwarding path: payload moves
+// socket -> pipe -> socket with splice() and never enters user space.
+// Only available on Linux; open() fails elsewhere so callers keep the copy path.
+class SplicePipe
+{
+public:
+    SplicePipe() = default;
+    ~SplicePipe();
+    SplicePipe(const SplicePipe&) = delete;
+    SplicePipe& operator=(const SplicePipe&) = delete;
+
+    // Create the non-blocking pipe and try to resize it to capacity bytes
+    bool open(size_t capacity);
+    void close();
+    bool isOpen() const { return readFd >= 0; }
+
+    // Bytes currently parked in the pipe
+    size_t buffered() const { return bytes; }
+
+    // Move up to maxBytes from a socket into the pipe, with recv() semantics:
+    // >0 bytes moved, 0 on EOF, -1 with errno set (EAGAIN when the socket is drained
+    // or the pipe has no room left).
+    int fill(SOCKET_T from, size_t maxBytes);
+
+    // Flush parked bytes into a socket until the pipe empties or the socket would block.
+    // Returns false on a socket error.
+    bool drain(SOCKET_T to);
+
+    // Throw away parked bytes (e.g. when their destination went away)
+    void discard();
+
+private:
+    int readFd = -1;
+    int writeFd = -1;
+    size_t bytes = 0;
+};
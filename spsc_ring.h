@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded single-producer/single-consumer ring. Each side owns one index and keeps a cached
+// copy of the other, on its own cache line, so an uncontended push or pop touches no line
+// the other side writes. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    static constexpr size_t capacity() { return Capacity; }
+
+    // Producer: false when the ring is full (value is left untouched)
+    bool push(T&& value)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cachedHead == Capacity)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead == Capacity)
+            {
+                return false;
+            }
+        }
+        slots[t & (Capacity - 1)] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: the oldest element, nullptr when empty
+    T* front()
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h == cachedTail)
+            {
+                return nullptr;
+            }
+        }
+        return &slots[h & (Capacity - 1)];
+    }
+
+    // Consumer: the index-th oldest element, nullptr past the newest
+    T* peek(size_t index)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (cachedTail - h <= index)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (cachedTail - h <= index)
+            {
+                return nullptr;
+            }
+        }
+        return &slots[(h + index) & (Capacity - 1)];
+    }
+
+    // Consumer: drop the oldest element, releasing what it holds
+    void pop()
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        slots[h & (Capacity - 1)] = T{};
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<size_t> head{0}; // consumer-owned
+    size_t cachedTail = 0;
+    alignas(64) std::atomic<size_t> tail{0}; // producer-owned
+    size_t cachedHead = 0;
+    alignas(64) T slots[Capacity];
+};
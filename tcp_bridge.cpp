@@ -0,0 +1,2022 @@
+#include "tcp_bridge.h"
+
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+// Size of a single socket read on the loop thread: one pooled chunk
+constexpr size_t kReadChunk = ChunkPool::kChunkSize;
+
+// Spans handed to one gather write
+constexpr int kMaxIoVecs = 16;
+
+// Highest usable high watermark: a full queue plus one read must fit a queue's span ring
+constexpr size_t kMaxWatermark = ChunkQueue::kMinCapacity - kReadChunk;
+
+// Device link retry delay: doubles per failed attempt up to the cap, then jittered down by
+// as much as half
+constexpr std::chrono::milliseconds kBackoffBase(100);
+constexpr std::chrono::milliseconds kBackoffMax(30 * 1000);
+
+// Broadcast mode: how far a client may fall behind the device stream (in high watermarks)
+// before it is dropped
+constexpr size_t kFanoutWatermarks = 4;
+
+// Idle client reaping: byte counter samples per idle timeout
+constexpr int kIdleChecks = 4;
+
+bool wouldBlock()
+{
+#ifdef _WIN32
+    const int err = WSAGetLastError();
+    return err == WSAEWOULDBLOCK || err == WSAEINTR;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// Client exchanges are small request/response pairs: Nagle plus the peer's delayed ACK would
+// hold each reply back ~40 ms, so clients get the same TCP_NODELAY as the device link
+void setNoDelay(SOCKET_T sock)
+{
+    const int on = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+}
+
+void setSocketBuffers(SOCKET_T sock, int bytes)
+{
+    if (bytes <= 0)
+    {
+        return;
+    }
+    // A small kernel buffer keeps the backlog in the bridge's bounded queues, where it is visible
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+}
+
+void setLinkTimeouts(SOCKET_T sock, int intervalMs, int timeoutMs, bool keepalive)
+{
+#ifdef TCP_USER_TIMEOUT
+    // Data the peer never acknowledges fails the socket within the same window
+    int userTimeout = intervalMs + timeoutMs;
+    setsockopt(sock, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout));
+#endif
+    if (!keepalive)
+    {
+        return;
+    }
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<const char*>(&on), sizeof(on));
+#ifdef TCP_KEEPIDLE
+    // Idle for the interval, then three probes spread over the timeout
+    const int count = 3;
+    int idle = std::max(1, intervalMs / 1000);
+    int gap = std::max(1, timeoutMs / 1000 / count);
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &gap, sizeof(gap));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+}
+
+std::string peerAddress(SOCKET_T sock)
+{
+    sockaddr_in addr{};
+    socklen_t length = sizeof(addr);
+    char ip[INET_ADDRSTRLEN] = "?";
+    if (getpeername(sock, reinterpret_cast<sockaddr*>(&addr), &length) == 0)
+    {
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    }
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+// First line a status client sent, empty if it sent nothing within a short grace period. The
+// grace period bounds the whole request, so a client trickling bytes cannot hold the status
+// thread; one that shuts down its sending side without a word is answered at once.
+std::string readStatusRequest(SOCKET_T sock)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    std::string request;
+    char buffer[512];
+    while (request.size() < 4096 && request.find('\n') == std::string::npos)
+    {
+        const auto left =
+            std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0)
+        {
+            break;
+        }
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sock, &readable);
+        timeval timeout{};
+        timeout.tv_sec = static_cast<long>(left.count() / 1000000);
+        timeout.tv_usec = static_cast<long>(left.count() % 1000000);
+        if (select(static_cast<int>(sock) + 1, &readable, nullptr, nullptr, &timeout) <= 0)
+        {
+            break;
+        }
+        const int received = ::recv(sock, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+        {
+            break;
+        }
+        request.append(buffer, static_cast<size_t>(received));
+    }
+    request = request.substr(0, request.find('\n'));
+    if (!request.empty() && request.back() == '\r')
+    {
+        request.pop_back();
+    }
+    return request;
+}
+
+void sendAll(SOCKET_T sock, const std::string& data)
+{
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        const int sent = ::send(sock, data.data() + offset, static_cast<int>(data.size() - offset), kSendFlags);
+        if (sent <= 0)
+        {
+            return;
+        }
+        offset += static_cast<size_t>(sent);
+    }
+}
+
+std::string httpReply(const char* status, const char* contentType, const std::string& body)
+{
+    return std::string("HTTP/1.0 ") + status + "\r\nContent-Type: " + contentType +
+           "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+}
+
+uint64_t microsSince(std::chrono::steady_clock::time_point since)
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count());
+}
+
+void closeSocket(SOCKET_T sock)
+{
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+} // namespace
+
+const char* linkStateName(LinkState state)
+{
+    switch (state)
+    {
+    case LinkState::Disconnected:
+        return "disconnected";
+    case LinkState::Connecting:
+        return "connecting";
+    case LinkState::Up:
+        return "up";
+    case LinkState::Backoff:
+        return "backoff";
+    }
+    return "unknown";
+}
+
+TcpBridgeInstance::TcpBridgeInstance(BridgeConfig cfg, EventLoop& eventLoop)
+    : config(std::move(cfg)), loop(eventLoop), jitter(std::random_device{}())
+{
+    metrics.remoteIp = config.remoteIp;
+    metrics.remotePort = config.remotePort;
+    metrics.listenPort = config.listenPort;
+    dwellOutlierNanos = static_cast<uint64_t>(std::max(0, config.dwellOutlierUs)) * 1000;
+    config.highWatermark = std::min(std::max<size_t>(config.highWatermark, kReadChunk), kMaxWatermark);
+    config.lowWatermark = std::min(config.lowWatermark, config.highWatermark);
+    if (config.modbusMux)
+    {
+        modbus = std::make_unique<ModbusMux>();
+    }
+    else if (config.broadcast)
+    {
+        fanout = std::make_unique<FanoutRing>(kFanoutWatermarks * config.highWatermark);
+    }
+    if (config.heartbeatIntervalMs <= 0)
+    {
+        config.heartbeatProbe.clear();
+    }
+    if (!modbus && !config.heartbeatProbe.empty())
+    {
+        // Only modbus replies carry an ID that tells them from answers to client requests;
+        // anywhere else the probe's reply would reach clients and late answers would time it
+        logDebug("heartbeat probe needs modbus mode, using TCP keepalive");
+        config.heartbeatProbe.clear();
+    }
+    if (!config.heartbeatProbe.empty() &&
+        ModbusMux::frameSize(config.heartbeatProbe.data(), config.heartbeatProbe.size()) !=
+            static_cast<int>(config.heartbeatProbe.size()))
+    {
+        // A probe that is not exactly one MBAP frame would desync the link; use keepalive instead
+        logDebug("heartbeat probe is not a single modbus frame, using TCP keepalive");
+        config.heartbeatProbe.clear();
+    }
+    if (config.cache.ttlMs > 0 && modbus)
+    {
+        cache = std::make_unique<ResponseCache>(config.cache);
+    }
+    else if (config.cache.ttlMs > 0)
+    {
+        logDebug("response cache needs modbus mode, bridge runs without it");
+    }
+    if (config.coalesceRequests && !modbus)
+    {
+        logDebug("request coalescing needs modbus mode, bridge runs without it");
+    }
+    if (!config.captureDir.empty())
+    {
+        // Spliced bytes never reach user space, so a captured bridge copies
+        config.spliceForward = false;
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+        const std::string path = config.captureDir + "/bridge-" + std::to_string(config.listenPort) + "-" +
+                                 std::to_string(std::chrono::duration_cast<std::chrono::seconds>(now).count()) +
+                                 ".cap";
+        capture = std::make_unique<CaptureWriter>();
+        if (!capture->open(path, config.captureBytes, config.remoteIp, config.remotePort, config.listenPort))
+        {
+            logError("capture file {} unavailable, bridge runs without capture", path);
+            capture.reset();
+        }
+    }
+}
+
+TcpBridgeInstance::~TcpBridgeInstance()
+{
+    running = false;
+}
+
+void TcpBridgeInstance::start()
+{
+    // Neither step waits for the network: the listener is up at once, the device connects later
+    startedAt = std::chrono::steady_clock::now();
+    setupServer();
+    setupRemote();
+    logDebug("bridge started: remote {}:{} <-> listen {}", config.remoteIp, config.remotePort, config.listenPort);
+}
+
+void TcpBridgeInstance::stop()
+{
+    // Behind start()'s posted setup in the loop's queue, so nothing is left to run afterwards
+    running = false;
+    loop.post([this]() { shutdown(); });
+}
+
+void TcpBridgeInstance::waitStopped()
+{
+    std::unique_lock<std::mutex> lock(linkMutex);
+    linkChanged.wait(lock, [this]() { return stopped; });
+}
+
+void TcpBridgeInstance::shutdown()
+{
+    if (listenPollFd != INVALID_SOCKET_T)
+    {
+        loop.remove(listenPollFd);
+        listenPollFd = INVALID_SOCKET_T;
+    }
+    server.Close();
+
+    loop.cancelTimer(backoffTimer);
+    loop.cancelTimer(connectTimer);
+    backoffTimer = 0;
+    connectTimer = 0;
+    stopHeartbeat();
+    if (connectSock != INVALID_SOCKET_T)
+    {
+        loop.remove(connectSock);
+        connectSock = INVALID_SOCKET_T;
+    }
+    if (remotePollFd != INVALID_SOCKET_T)
+    {
+        loop.remove(remotePollFd);
+        remoteSock = INVALID_SOCKET_T;
+        remotePollFd = INVALID_SOCKET_T;
+    }
+    remote.Close();
+    metrics.linkUp = false;
+    remoteWriter = INVALID_SOCKET_T;
+    while (!clients.empty())
+    {
+        closeClient(clients.begin()->first);
+    }
+
+    logDebug("bridge stopped: listen {}", config.listenPort);
+
+    // waitStopped() may destroy the bridge as soon as it sees stopped, so the notify under the
+    // lock is the last touch of this
+    std::lock_guard<std::mutex> lock(linkMutex);
+    linkState = LinkState::Disconnected;
+    stopped = true;
+    linkChanged.notify_all();
+}
+
+void TcpBridgeInstance::setupRemote()
+{
+    // Configure the always-on client socket to the external device
+    NetTcpPARAM param{};
+    param.bServer = 0;
+    param.RemoteIp = config.remoteIp;
+    param.RemotePort = config.remotePort;
+    param.bRefRecvTimeout = 1;
+    param.RecvTimeout = 200;
+    param.bNoDelay = 1;
+    param.bNoReconnect = 1; // reconnects go through the link state machine only
+    // splice() reads the raw socket, which a multishot recv would race
+    param.bIoUring = config.ioUring && !config.spliceForward;
+    remote.SetParam(param);
+
+    // The loop owns the link from the first connect on, so nothing here waits for the device
+    loop.post([this]() { connectRemote(); });
+}
+
+void TcpBridgeInstance::setupServer()
+{
+    // Start a local TCP server so the upstream host can connect; accepts run on the loop
+    NetTcpPARAM param{};
+    param.bServer = 1;
+    param.bRefLocalPort = 1;
+    param.LocalPort = config.listenPort;
+    param.bManualAccept = 1;
+    param.ListenBacklog = 1024;
+    param.bIoUring = config.ioUring;
+
+    server.SetParam(param);
+    if (!server.Open())
+    {
+        logDebug("listen failed on port {}", config.listenPort);
+        return;
+    }
+    const SOCKET_T listenSock = server.GetPollFd();
+    loop.post([this, listenSock]() {
+        if (loop.add(listenSock, [this](uint32_t) { acceptClients(); }))
+        {
+            listenPollFd = listenSock;
+        }
+    });
+}
+
+void TcpBridgeInstance::setLinkState(LinkState state)
+{
+    {
+        std::lock_guard<std::mutex> lock(linkMutex);
+        linkState = state;
+    }
+    linkChanged.notify_all();
+}
+
+bool TcpBridgeInstance::waitRemoteConnected(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(linkMutex);
+    return linkChanged.wait_for(lock, timeout, [this]() { return linkState == LinkState::Up; });
+}
+
+void TcpBridgeInstance::connectRemote()
+{
+    // Single flight: a connect is only started from Disconnected or at the end of a backoff
+    const LinkState state = linkState;
+    if (!running || state == LinkState::Connecting || state == LinkState::Up)
+    {
+        return;
+    }
+    setLinkState(LinkState::Connecting);
+    const int result = remote.BeginConnect();
+    if (result > 0)
+    {
+        onRemoteConnected();
+        return;
+    }
+    if (result == 0)
+    {
+        connectSock = remote.GetSocket();
+        if (loop.add(connectSock, [this](uint32_t) { onConnectEvent(); }))
+        {
+            loop.watchWrite(connectSock, true);
+            if (config.connectTimeoutMs > 0)
+            {
+                // An unreachable host would otherwise hold the attempt for the kernel's SYN timeout
+                connectTimer = loop.runAfter(std::chrono::milliseconds(config.connectTimeoutMs),
+                                             [this]() { onConnectTimeout(); });
+            }
+            return;
+        }
+        connectSock = INVALID_SOCKET_T;
+        remote.Close();
+    }
+    logDebug("connect failed {}:{}", config.remoteIp, config.remotePort);
+    metrics.connectFailures.add();
+    scheduleReconnect();
+}
+
+void TcpBridgeInstance::onConnectEvent()
+{
+    const int result = remote.FinishConnect();
+    if (result == 0)
+    {
+        return;
+    }
+    loop.remove(connectSock);
+    connectSock = INVALID_SOCKET_T;
+    loop.cancelTimer(connectTimer);
+    connectTimer = 0;
+    if (result < 0)
+    {
+        logDebug("connect failed {}:{}", config.remoteIp, config.remotePort);
+        metrics.connectFailures.add();
+        scheduleReconnect();
+        return;
+    }
+    onRemoteConnected();
+}
+
+void TcpBridgeInstance::onConnectTimeout()
+{
+    connectTimer = 0;
+    if (connectSock == INVALID_SOCKET_T)
+    {
+        return;
+    }
+    loop.remove(connectSock);
+    connectSock = INVALID_SOCKET_T;
+    remote.Close();
+    logDebug("connect timed out {}:{}", config.remoteIp, config.remotePort);
+    metrics.connectFailures.add();
+    scheduleReconnect();
+}
+
+void TcpBridgeInstance::onRemoteConnected()
+{
+    if (!attachRemote())
+    {
+        metrics.connectFailures.add();
+        scheduleReconnect();
+        return;
+    }
+    logDebug("connected to remote {}:{}", config.remoteIp, config.remotePort);
+    connectFailures = 0;
+    if (startupMicros < 0)
+    {
+        startupMicros = static_cast<int64_t>(microsSince(startedAt));
+    }
+    else
+    {
+        metrics.reconnects.add();
+    }
+    metrics.linkUp = true;
+    captureRecord(CaptureKind::LinkUp, kCaptureNoClient, TraceClock::now());
+    setLinkState(LinkState::Up);
+    startHeartbeat();
+}
+
+void TcpBridgeInstance::scheduleReconnect()
+{
+    // Exponential backoff with jitter: a dead device is retried less and less often, and
+    // bridges that lost their devices together do not retry in lockstep
+    const int64_t ceiling = std::min<int64_t>(kBackoffBase.count() << std::min<uint32_t>(connectFailures, 16),
+                                              kBackoffMax.count());
+    ++connectFailures;
+    std::uniform_int_distribution<int64_t> pick(ceiling / 2, ceiling);
+    const std::chrono::milliseconds delay(pick(jitter));
+    setLinkState(LinkState::Backoff);
+    loop.cancelTimer(backoffTimer);
+    backoffTimer = loop.runAfter(delay, [this]() {
+        backoffTimer = 0;
+        connectRemote();
+    });
+}
+
+bool TcpBridgeInstance::attachRemote()
+{
+    const SOCKET_T sock = remote.GetSocket();
+    const SOCKET_T pollFd = remote.GetPollFd();
+    if (!remote.SetNonBlocking(true) ||
+        !loop.add(pollFd, [this](uint32_t events) { onRemoteEvent(events); }))
+    {
+        remote.Close();
+        return false;
+    }
+    setSocketBuffers(sock, config.socketBufferBytes);
+    remoteSock = sock;
+    remotePollFd = pollFd;
+    // A fresh link starts with nothing in flight, so no request can join one that was never sent
+    forgetModbusInflight();
+    return true;
+}
+
+void TcpBridgeInstance::forgetModbusInflight()
+{
+    if (modbus)
+    {
+        modbus->clear();
+        if (cache)
+        {
+            cache->forgetPending();
+        }
+    }
+}
+
+void TcpBridgeInstance::detachRemote()
+{
+    if (linkState != LinkState::Up)
+    {
+        // Nothing attached; a connect may be in flight and must not be torn down
+        return;
+    }
+    stopHeartbeat();
+    metrics.linkUp = false;
+    captureRecord(CaptureKind::LinkDown, kCaptureNoClient, TraceClock::now());
+    remoteStallSince = std::chrono::steady_clock::time_point();
+    loop.remove(remotePollFd);
+    remoteSock = INVALID_SOCKET_T;
+    remotePollFd = INVALID_SOCKET_T;
+    remote.Close();
+    remotePending.clear();
+    remoteReadable = false;
+    remoteBytesSeen = 0;
+    remoteWriter = INVALID_SOCKET_T;
+    remoteFrames.clear();
+    // Requests in flight on the old link will never be answered
+    forgetModbusInflight();
+    for (auto& entry : clients)
+    {
+        if (entry.second->upPipe)
+        {
+            entry.second->upPipe->discard();
+            entry.second->upTrace = BacklogTrace();
+        }
+    }
+
+    // The loss is noticed on the failing call itself, so the first retry follows right away
+    scheduleReconnect();
+
+    // Clients paused on a full device queue go back to reading (and dropping) their input
+    resumeClientReads();
+}
+
+void TcpBridgeInstance::startHeartbeat()
+{
+    if (config.heartbeatIntervalMs <= 0)
+    {
+        return;
+    }
+    setLinkTimeouts(remoteSock, config.heartbeatIntervalMs, config.heartbeatTimeoutMs, config.heartbeatProbe.empty());
+    lastDeviceRx = std::chrono::steady_clock::now();
+    heartbeatTimer = loop.runAfter(std::chrono::milliseconds(config.heartbeatIntervalMs), [this]() { onHeartbeatTick(); });
+}
+
+void TcpBridgeInstance::stopHeartbeat()
+{
+    loop.cancelTimer(heartbeatTimer);
+    loop.cancelTimer(probeTimer);
+    heartbeatTimer = 0;
+    probeTimer = 0;
+    probeInFlight = false;
+}
+
+void TcpBridgeInstance::onHeartbeatTick()
+{
+    const std::chrono::milliseconds interval(config.heartbeatIntervalMs);
+    heartbeatTimer = loop.runAfter(interval, [this]() { onHeartbeatTick(); });
+    if (config.heartbeatProbe.empty())
+    {
+#ifdef TCP_INFO
+        // Keepalive mode has no application round trip; sample the kernel's smoothed RTT instead
+        tcp_info info{};
+        socklen_t length = sizeof(info);
+        if (getsockopt(remoteSock, IPPROTO_TCP, TCP_INFO, &info, &length) == 0 && info.tcpi_rtt > 0)
+        {
+            recordRtt(info.tcpi_rtt);
+        }
+#endif
+        return;
+    }
+
+    // Probe only a silent link, and never in the middle of client bytes bound for the device
+    const auto now = std::chrono::steady_clock::now();
+    if (probeInFlight || now - lastDeviceRx < interval || !remotePending.empty() || remoteWriter != INVALID_SOCKET_T)
+    {
+        return;
+    }
+    probeInFlight = true;
+    probeSentAt = now;
+    probeTimer = loop.runAfter(std::chrono::milliseconds(config.heartbeatTimeoutMs), [this]() {
+        probeTimer = 0;
+        logDebug("heartbeat timed out {}:{}", config.remoteIp, config.remotePort);
+        detachRemote();
+    });
+    // Owned by no client, so the response is dropped once it has timed the round trip
+    std::vector<uint8_t> probe = config.heartbeatProbe;
+    modbus->mapRequest(probe.data(), INVALID_SOCKET_T);
+    probeTid = static_cast<uint16_t>((probe[0] << 8) | probe[1]);
+    forwardToRemote(probe.data(), probe.size());
+}
+
+void TcpBridgeInstance::onDeviceBytes()
+{
+    if (config.heartbeatIntervalMs <= 0)
+    {
+        return;
+    }
+    lastDeviceRx = std::chrono::steady_clock::now();
+}
+
+void TcpBridgeInstance::onProbeAnswered()
+{
+    // Only the reply carrying the probe's transaction ID times it, not a late client answer
+    probeInFlight = false;
+    loop.cancelTimer(probeTimer);
+    probeTimer = 0;
+    recordRtt(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - probeSentAt)
+            .count()));
+}
+
+void TcpBridgeInstance::recordRtt(uint64_t micros)
+{
+    rtt.record(static_cast<uint32_t>(std::min<uint64_t>(micros, UINT32_MAX)));
+    metrics.deviceRtt.record(micros);
+}
+
+void TcpBridgeInstance::countDeviceRead(size_t bytes)
+{
+    metrics.down.bytes.add(bytes);
+    metrics.down.chunks.add();
+}
+
+void TcpBridgeInstance::countClientRead(ClientConn& conn, size_t bytes)
+{
+    metrics.up.bytes.add(bytes);
+    metrics.up.chunks.add();
+    conn.stats->up.bytes.add(bytes);
+    conn.stats->up.chunks.add();
+}
+
+void TcpBridgeInstance::countClientWrite(ClientConn& conn, size_t bytes)
+{
+    conn.stats->down.bytes.add(bytes);
+    conn.stats->down.chunks.add();
+}
+
+void TcpBridgeInstance::captureRecord(CaptureKind kind, uint64_t client, uint64_t ticks, const uint8_t* data,
+                                      size_t size)
+{
+    if (capture)
+    {
+        capture->record(kind, client, ticks, data, size);
+    }
+}
+
+void TcpBridgeInstance::remoteStalled()
+{
+    if (remoteStallSince == std::chrono::steady_clock::time_point())
+    {
+        remoteStallSince = std::chrono::steady_clock::now();
+        metrics.up.stalls.add();
+    }
+}
+
+void TcpBridgeInstance::remoteDrained()
+{
+    if (remoteStallSince != std::chrono::steady_clock::time_point())
+    {
+        metrics.stallUp.record(microsSince(remoteStallSince));
+        remoteStallSince = std::chrono::steady_clock::time_point();
+    }
+}
+
+void TcpBridgeInstance::clientStalled(ClientConn& conn)
+{
+    if (conn.stallSince == std::chrono::steady_clock::time_point())
+    {
+        conn.stallSince = std::chrono::steady_clock::now();
+        metrics.down.stalls.add();
+        conn.stats->down.stalls.add();
+    }
+}
+
+void TcpBridgeInstance::clientDrained(ClientConn& conn)
+{
+    if (conn.stallSince != std::chrono::steady_clock::time_point())
+    {
+        metrics.stallDown.record(microsSince(conn.stallSince));
+        conn.stallSince = std::chrono::steady_clock::time_point();
+    }
+}
+
+void TcpBridgeInstance::traceDwell(bool up, const ChunkStamp& stamp, size_t bytes, uint64_t now)
+{
+    if (stamp.ticks == 0)
+    {
+        return;
+    }
+    const uint64_t nanos = now > stamp.ticks ? TraceClock::toNanos(now - stamp.ticks) : 0;
+    (up ? metrics.dwellUp : metrics.dwellDown).record(nanos);
+    if (dwellOutlierNanos > 0 && nanos >= dwellOutlierNanos)
+    {
+        metrics.dwellOutliers.push(DwellOutlier{up, stamp.client, bytes, nanos, now});
+    }
+}
+
+void TcpBridgeInstance::traceIngress(BacklogTrace& trace, size_t bytes, uint64_t ticks)
+{
+    if (trace.bytes == 0)
+    {
+        trace.since = ticks;
+    }
+    trace.bytes += bytes;
+}
+
+void TcpBridgeInstance::traceDrained(bool up, BacklogTrace& trace, uint64_t client)
+{
+    if (trace.bytes > 0)
+    {
+        traceDwell(up, ChunkStamp{trace.since, client}, trace.bytes, TraceClock::now());
+        trace = BacklogTrace();
+    }
+}
+
+void TcpBridgeInstance::onRemoteEvent(uint32_t events)
+{
+    bool arrived = (events & EvRead) != 0;
+    if (remote.UsesIoUring())
+    {
+        // Completions for both directions arrive on one eventfd
+        remote.ClearPollEvent();
+        events |= EvRead | EvWrite;
+        if (remote.UringLinkLost())
+        {
+            events |= EvClosed;
+        }
+        const uint64_t received = remote.UringBytesReceived();
+        arrived = received != remoteBytesSeen;
+        remoteBytesSeen = received;
+    }
+    if (arrived)
+    {
+        // Counted on arrival: bytes left in the kernel for want of a client prove life as well
+        onDeviceBytes();
+    }
+    if (events & EvWrite)
+    {
+        flushRemote();
+    }
+    if (remoteSock != INVALID_SOCKET_T && (events & EvClosed) && clients.empty())
+    {
+        // Nobody would read up to the EOF, so the loss would go unnoticed until a client came
+        logDebug("remote closed {}:{}", config.remoteIp, config.remotePort);
+        detachRemote();
+        return;
+    }
+    if (remoteSock != INVALID_SOCKET_T && (events & (EvRead | EvClosed)))
+    {
+        remoteReadable = true;
+        drainRemote();
+    }
+}
+
+void TcpBridgeInstance::drainRemote()
+{
+    if (fanout)
+    {
+        drainRemoteFanout();
+        return;
+    }
+    if (modbus)
+    {
+        drainRemoteModbus();
+        return;
+    }
+
+    // Pull data from remote device and forward to upstream host
+    while (remoteReadable && remoteSock != INVALID_SOCKET_T)
+    {
+        ClientConn* target = routeTarget();
+        if (target && target->downPipe)
+        {
+            // Zero-copy: device socket -> target's pipe -> target socket
+            int moved = target->downPipe->fill(remoteSock, config.highWatermark);
+            if (moved > 0)
+            {
+                traceIngress(target->downTrace, static_cast<size_t>(moved), TraceClock::now());
+                countDeviceRead(static_cast<size_t>(moved));
+                countClientWrite(*target, static_cast<size_t>(moved));
+                flushClient(*target);
+                continue;
+            }
+            if (moved < 0 && wouldBlock())
+            {
+                // A non-empty pipe may simply be full; the client's write edge retries
+                if (target->downPipe->buffered() == 0)
+                {
+                    remoteReadable = false;
+                }
+                return;
+            }
+            logDebug("remote closed {}:{}", config.remoteIp, config.remotePort);
+            detachRemote();
+            return;
+        }
+        if (!target || target->pending.size() >= config.highWatermark)
+        {
+            // Leave the data in the kernel until a client can take it
+            return;
+        }
+
+        // A chunk whose bytes end up queued stays with the queue; otherwise it is reused next round
+        ChunkRef chunk = ChunkRef::acquire();
+        int readSize = 0;
+        remote.Read(chunk.data(), static_cast<int>(kReadChunk), &readSize);
+        if (readSize > 0)
+        {
+            const ChunkStamp stamp{TraceClock::now(), target->seq};
+            countDeviceRead(static_cast<size_t>(readSize));
+            captureRecord(CaptureKind::DeviceToClient, target->seq, stamp.ticks, chunk.data(),
+                          static_cast<size_t>(readSize));
+            sendToClient(*target, chunk.data(), static_cast<size_t>(readSize), &chunk, stamp);
+            continue;
+        }
+        if (!remote.CheckLinkOk())
+        {
+            logDebug("remote closed {}:{}", config.remoteIp, config.remotePort);
+            detachRemote();
+            return;
+        }
+        remoteReadable = false;
+    }
+}
+
+void TcpBridgeInstance::drainRemoteFanout()
+{
+    // One device read feeds every client; nobody waits for the slowest one
+    while (remoteReadable && remoteSock != INVALID_SOCKET_T)
+    {
+        if (clients.empty())
+        {
+            // Leave the data in the kernel until someone subscribes
+            return;
+        }
+        if (!dropLaggingClients(kReadChunk))
+        {
+            // Everyone is behind: throttle the device until a client write edge frees room
+            return;
+        }
+
+        size_t span = kReadChunk;
+        uint8_t* buffer = fanout->writeSpan(span);
+        int readSize = 0;
+        remote.Read(buffer, static_cast<int>(span), &readSize);
+        if (readSize > 0)
+        {
+            const uint64_t readTicks = TraceClock::now();
+            countDeviceRead(static_cast<size_t>(readSize));
+            captureRecord(CaptureKind::DeviceToClient, kCaptureNoClient, readTicks, buffer,
+                          static_cast<size_t>(readSize));
+            fanout->commit(static_cast<size_t>(readSize));
+            publishFanout(static_cast<size_t>(readSize), readTicks);
+            continue;
+        }
+        if (!remote.CheckLinkOk())
+        {
+            logDebug("remote closed {}:{}", config.remoteIp, config.remotePort);
+            detachRemote();
+            return;
+        }
+        remoteReadable = false;
+    }
+}
+
+void TcpBridgeInstance::drainRemoteModbus()
+{
+    // Responses are split back out per client by transaction ID
+    ChunkRef chunk = ChunkRef::acquire();
+    while (remoteReadable && remoteSock != INVALID_SOCKET_T)
+    {
+        int readSize = 0;
+        remote.Read(chunk.data(), static_cast<int>(kReadChunk), &readSize);
+        if (readSize > 0)
+        {
+            const uint64_t readTicks = TraceClock::now();
+            countDeviceRead(static_cast<size_t>(readSize));
+            captureRecord(CaptureKind::DeviceToClient, kCaptureNoClient, readTicks, chunk.data(),
+                          static_cast<size_t>(readSize));
+            remoteFrames.insert(remoteFrames.end(), chunk.data(), chunk.data() + readSize);
+            routeModbusResponses(readTicks);
+            continue;
+        }
+        if (!remote.CheckLinkOk())
+        {
+            logDebug("remote closed {}:{}", config.remoteIp, config.remotePort);
+            detachRemote();
+            return;
+        }
+        remoteReadable = false;
+    }
+}
+
+void TcpBridgeInstance::routeModbusResponses(uint64_t readTicks)
+{
+    std::vector<SOCKET_T> touched;
+    std::vector<ModbusMux::Waiter> followers;
+    const auto now = cache ? ResponseCache::Clock::now() : ResponseCache::Clock::time_point();
+    size_t offset = 0;
+    while (true)
+    {
+        uint8_t* frame = remoteFrames.data() + offset;
+        const int size = ModbusMux::frameSize(frame, remoteFrames.size() - offset);
+        if (size < 0)
+        {
+            // No way to find the next frame boundary; a fresh link starts clean
+            logDebug("malformed modbus response, closing remote");
+            detachRemote();
+            return;
+        }
+        if (size == 0)
+        {
+            break;
+        }
+        offset += static_cast<size_t>(size);
+
+        const bool probeReply = probeInFlight && ((frame[0] << 8) | frame[1]) == probeTid;
+        if (probeReply)
+        {
+            onProbeAnswered();
+        }
+        if (cache)
+        {
+            cache->store(frame, static_cast<size_t>(size), now);
+        }
+        uint64_t elapsedUs = 0;
+        followers.clear();
+        const SOCKET_T owner = modbus->mapResponse(frame, &elapsedUs, &followers);
+        if (owner == INVALID_SOCKET_T)
+        {
+            if (!probeReply)
+            {
+                logDebug("dropping modbus response without a waiting client");
+            }
+            continue;
+        }
+        metrics.modbusTransaction.record(elapsedUs);
+        queueModbusResponse(owner, frame, static_cast<size_t>(size), readTicks, touched);
+        // Every client that joined the request gets the same answer under its own transaction ID
+        for (const ModbusMux::Waiter& waiter : followers)
+        {
+            frame[0] = static_cast<uint8_t>(waiter.clientTid >> 8);
+            frame[1] = static_cast<uint8_t>(waiter.clientTid & 0xFF);
+            queueModbusResponse(waiter.client, frame, static_cast<size_t>(size), readTicks, touched);
+        }
+    }
+    remoteFrames.erase(remoteFrames.begin(), remoteFrames.begin() + static_cast<std::ptrdiff_t>(offset));
+
+    for (SOCKET_T sock : touched)
+    {
+        auto it = clients.find(sock);
+        if (it != clients.end())
+        {
+            flushClient(*it->second);
+        }
+    }
+}
+
+bool TcpBridgeInstance::queueModbusResponse(SOCKET_T client, const uint8_t* frame, size_t size, uint64_t readTicks,
+                                            std::vector<SOCKET_T>& touched)
+{
+    auto it = clients.find(client);
+    if (it == clients.end())
+    {
+        logDebug("dropping modbus response without a waiting client");
+        return false;
+    }
+    ClientConn& conn = *it->second;
+    if (conn.pending.size() >= config.highWatermark)
+    {
+        // The other masters keep being served while this one ignores its responses
+        logDebug("client not reading modbus responses, closing client");
+        closeClient(client);
+        return false;
+    }
+    // Queue first, so all responses for one client from this read leave in one syscall
+    if (!conn.pending.append(frame, size, ChunkStamp{readTicks, conn.seq}))
+    {
+        logDebug("client queue overflow, closing client");
+        closeClient(client);
+        return false;
+    }
+    countClientWrite(conn, size);
+    if (std::find(touched.begin(), touched.end(), client) == touched.end())
+    {
+        touched.push_back(client);
+    }
+    return true;
+}
+
+void TcpBridgeInstance::forwardToRemote(const uint8_t* data, size_t size, const ChunkRef* chunk,
+                                        const ChunkStamp& stamp)
+{
+    if (remoteSock == INVALID_SOCKET_T)
+    {
+        logDebug("remote not connected, dropping {} bytes", size);
+        return;
+    }
+
+    size_t offset = 0;
+    if (remotePending.empty())
+    {
+        while (offset < size)
+        {
+            int written = 0;
+            if (!remote.Write(data + offset, static_cast<int>(size - offset), &written))
+            {
+                logDebug("send to remote failed, closing remote");
+                detachRemote();
+                return;
+            }
+            if (written == 0)
+            {
+                break;
+            }
+            offset += static_cast<size_t>(written);
+        }
+        if (offset == size)
+        {
+            traceDwell(true, stamp, size, TraceClock::now());
+            return;
+        }
+    }
+    if (offset < size)
+    {
+        const bool queued = chunk ? remotePending.append(*chunk, static_cast<size_t>(data - chunk->data()) + offset,
+                                                         size - offset, stamp)
+                                  : remotePending.append(data + offset, size - offset, stamp);
+        if (!queued)
+        {
+            // Dropping bytes mid-stream would corrupt it; start over on a fresh link instead
+            logDebug("remote queue overflow, closing remote");
+            detachRemote();
+            return;
+        }
+        remoteStalled();
+        loop.watchWrite(remoteSock, true);
+    }
+}
+
+void TcpBridgeInstance::flushRemote()
+{
+    if (remoteSock == INVALID_SOCKET_T)
+    {
+        return;
+    }
+    if (config.spliceForward)
+    {
+        // Finish the client whose bytes are half way onto the link, then the others in turn
+        std::vector<SOCKET_T> writers;
+        if (remoteWriter != INVALID_SOCKET_T)
+        {
+            writers.push_back(remoteWriter);
+        }
+        for (const auto& entry : clients)
+        {
+            if (entry.second->upPipe && entry.second->upPipe->buffered() > 0 && entry.first != remoteWriter)
+            {
+                writers.push_back(entry.first);
+            }
+        }
+        for (SOCKET_T sock : writers)
+        {
+            auto it = clients.find(sock);
+            if (it == clients.end())
+            {
+                continue;
+            }
+            if (!flushUpPipe(*it->second))
+            {
+                return;
+            }
+            if (remoteWriter != INVALID_SOCKET_T)
+            {
+                return;
+            }
+        }
+    }
+    while (!remotePending.empty())
+    {
+        // Everything queued goes out in one writev, however many reads it came from
+        NetIoVec vecs[kMaxIoVecs];
+        const int count = remotePending.gather(vecs, kMaxIoVecs);
+        const int written = remote.sendDataV(vecs, count);
+        if (written < 0)
+        {
+            logDebug("send to remote failed, closing remote");
+            detachRemote();
+            return;
+        }
+        if (written == 0)
+        {
+            if (remotePending.size() <= config.lowWatermark)
+            {
+                // Enough room again; paused clients refill up to the high watermark
+                resumeClientReads();
+            }
+            return;
+        }
+        const uint64_t now = TraceClock::now();
+        remotePending.consume(static_cast<size_t>(written),
+                              [&](const ChunkStamp& stamp, size_t bytes) { traceDwell(true, stamp, bytes, now); });
+    }
+    loop.watchWrite(remoteSock, false);
+    remoteDrained();
+    resumeClientReads();
+}
+
+void TcpBridgeInstance::acceptClients()
+{
+    server.ClearPollEvent();
+    SOCKET_T sock = INVALID_SOCKET_T;
+    while (server.Accept(&sock))
+    {
+        SetSocketNonBlocking(sock, true);
+        setNoDelay(sock);
+        setSocketBuffers(sock, config.socketBufferBytes);
+        auto conn = std::make_unique<ClientConn>();
+        conn->sock = sock;
+        conn->seq = nextSeq++;
+        conn->cursor = fanout ? fanout->head() : 0;
+        conn->stats = metrics.addClient(conn->seq, peerAddress(sock));
+        if (!modbus)
+        {
+            conn->framer = makeFramer(config.framing);
+        }
+        if (config.spliceForward && !modbus && !(conn->framer && fanout))
+        {
+            // A pipe is consumed by one reader, so broadcast keeps device data in the fan-out ring;
+            // framing has to see client bytes, so they stay out of the kernel
+            auto up = conn->framer ? nullptr : std::make_unique<SplicePipe>();
+            auto down = fanout ? nullptr : std::make_unique<SplicePipe>();
+            if ((!up || up->open(config.highWatermark)) && (!down || down->open(config.highWatermark)))
+            {
+                conn->upPipe = std::move(up);
+                conn->downPipe = std::move(down);
+            }
+            else
+            {
+                logDebug("splice pipes unavailable, client uses the copy path");
+            }
+        }
+        auto stats = conn->stats;
+        clients[sock] = std::move(conn);
+        if (!loop.add(sock, [this, sock](uint32_t events) { onClientEvent(sock, events); }))
+        {
+            metrics.removeClient(stats);
+            clients.erase(sock);
+            closeSocket(sock);
+            continue;
+        }
+        metrics.clientsAccepted.add();
+        ++metrics.clientsActive;
+        if (capture)
+        {
+            const std::string peer = peerAddress(sock);
+            captureRecord(CaptureKind::ClientOpen, clients[sock]->seq, TraceClock::now(),
+                          reinterpret_cast<const uint8_t*>(peer.data()), peer.size());
+        }
+        if (config.clientIdleTimeoutMs > 0)
+        {
+            armIdleCheck(*clients[sock]);
+        }
+        logDebug("client connected on port {}", config.listenPort);
+    }
+
+    // Device data may have been waiting for someone to deliver it to
+    drainRemote();
+}
+
+void TcpBridgeInstance::armIdleCheck(ClientConn& conn)
+{
+    // Sampling the byte counters a few times per timeout keeps the data path free of clock
+    // reads: a client is closed between one and 1.25 timeouts after its last byte
+    const SOCKET_T sock = conn.sock;
+    const int interval = std::max(1, config.clientIdleTimeoutMs / kIdleChecks);
+    conn.idleTimer = loop.runAfter(std::chrono::milliseconds(interval), [this, sock]() { onIdleCheck(sock); });
+}
+
+void TcpBridgeInstance::onIdleCheck(SOCKET_T sock)
+{
+    auto it = clients.find(sock);
+    if (it == clients.end())
+    {
+        return;
+    }
+    ClientConn& conn = *it->second;
+    conn.idleTimer = 0;
+    const uint64_t seen = conn.stats->up.bytes.load() + conn.stats->down.bytes.load();
+    if (seen != conn.idleSeen)
+    {
+        conn.idleSeen = seen;
+        conn.quietChecks = 0;
+    }
+    else if (++conn.quietChecks >= kIdleChecks)
+    {
+        logDebug("closing idle client on port {}", config.listenPort);
+        metrics.clientsReaped.add();
+        closeClient(sock);
+        return;
+    }
+    armIdleCheck(conn);
+}
+
+void TcpBridgeInstance::onClientEvent(SOCKET_T sock, uint32_t events)
+{
+    if (events & EvWrite)
+    {
+        auto it = clients.find(sock);
+        if (it == clients.end() || !flushClient(*it->second))
+        {
+            return;
+        }
+        // Hysteresis: the device is read again only once this client's backlog is low
+        if (it->second->pending.size() <= config.lowWatermark)
+        {
+            drainRemote();
+        }
+    }
+    if (events & (EvRead | EvClosed))
+    {
+        auto it = clients.find(sock);
+        if (it != clients.end())
+        {
+            readClient(*it->second);
+        }
+    }
+}
+
+void TcpBridgeInstance::readClient(ClientConn& conn)
+{
+    if (conn.upPipe && remoteSock != INVALID_SOCKET_T)
+    {
+        readClientSplice(conn);
+        return;
+    }
+
+    // Read from upstream host and push to remote device
+    while (true)
+    {
+        if (remotePending.size() >= config.highWatermark)
+        {
+            // The device is backed up; flushRemote() resumes this client once it drains
+            conn.readPaused = true;
+            return;
+        }
+
+        ChunkRef chunk = ChunkRef::acquire();
+        int received = ::recv(conn.sock, reinterpret_cast<char*>(chunk.data()), static_cast<int>(kReadChunk), 0);
+        const ChunkStamp stamp{TraceClock::now(), conn.seq};
+        if (received > 0)
+        {
+            countClientRead(conn, static_cast<size_t>(received));
+            captureRecord(CaptureKind::ClientToDevice, conn.seq, stamp.ticks, chunk.data(),
+                          static_cast<size_t>(received));
+        }
+        if (received > 0 && modbus)
+        {
+            if (!forwardModbusRequests(conn, chunk.data(), static_cast<size_t>(received), stamp))
+            {
+                return;
+            }
+            continue;
+        }
+        if (received > 0 && conn.framer)
+        {
+            if (!forwardFrames(conn, chunk, static_cast<size_t>(received), stamp))
+            {
+                return;
+            }
+            continue;
+        }
+        if (received > 0)
+        {
+            // Device responses go back to whichever client spoke last
+            targetClient = conn.sock;
+            forwardToRemote(chunk.data(), static_cast<size_t>(received), &chunk, stamp);
+            continue;
+        }
+        if (received < 0 && wouldBlock())
+        {
+            return;
+        }
+        closeClient(conn.sock);
+        return;
+    }
+}
+
+void TcpBridgeInstance::readClientSplice(ClientConn& conn)
+{
+    // Zero-copy: client socket -> client's pipe -> device socket
+    while (true)
+    {
+        int moved = conn.upPipe->fill(conn.sock, config.highWatermark);
+        if (moved > 0)
+        {
+            traceIngress(conn.upTrace, static_cast<size_t>(moved), TraceClock::now());
+            countClientRead(conn, static_cast<size_t>(moved));
+            targetClient = conn.sock;
+            if (!flushUpPipe(conn))
+            {
+                // The link dropped; keep draining the socket through the (dropping) copy path
+                readClient(conn);
+                return;
+            }
+            continue;
+        }
+        if (moved < 0 && wouldBlock())
+        {
+            if (conn.upPipe->buffered() > 0)
+            {
+                // Pipe is full or queued behind another writer; flushRemote() resumes it
+                conn.readPaused = true;
+            }
+            return;
+        }
+        closeClient(conn.sock);
+        return;
+    }
+}
+
+bool TcpBridgeInstance::forwardModbusRequests(ClientConn& conn, const uint8_t* data, size_t size,
+                                              const ChunkStamp& stamp)
+{
+    // Rewrite every complete request in place, then hand them to the link in one write. Requests
+    // the cache answers are squeezed out; their responses may overtake earlier requests' ones,
+    // which Modbus TCP masters match by transaction ID. Requests joining an identical one already
+    // on the link are squeezed out too and answered when it is. While the link is not up, every
+    // request gets an exception response instead, so nothing is left waiting in the mux.
+    conn.frames.insert(conn.frames.end(), data, data + size);
+    const auto now = cache ? ResponseCache::Clock::now() : ResponseCache::Clock::time_point();
+    size_t offset = 0;
+    size_t kept = 0; // end of the requests bound for the device
+    bool answered = false;
+    while (true)
+    {
+        uint8_t* request = conn.frames.data() + offset;
+        const int frame = ModbusMux::frameSize(request, conn.frames.size() - offset);
+        if (frame < 0)
+        {
+            logDebug("malformed modbus request, closing client");
+            closeClient(conn.sock);
+            return false;
+        }
+        if (frame == 0)
+        {
+            break;
+        }
+        const size_t length = static_cast<size_t>(frame);
+        // The cache rules say which requests only read, so may share an answer
+        const bool idempotent =
+            (cache || config.coalesceRequests) && matchesCacheRules(config.cache.rules, request, length);
+        const bool cacheable = cache && idempotent;
+        const bool coalescable = config.coalesceRequests && idempotent;
+        const std::string* hit = cacheable ? cache->find(request, length, now) : nullptr;
+        if (hit)
+        {
+            uint8_t response[ModbusMux::kMaxFrameSize];
+            std::memcpy(response, hit->data(), hit->size());
+            response[0] = request[0];
+            response[1] = request[1];
+            if (!answerModbusRequest(conn, response, hit->size(), stamp))
+            {
+                return false;
+            }
+            metrics.cacheHits.add();
+            answered = true;
+            offset += length;
+            continue;
+        }
+        if (linkState != LinkState::Up)
+        {
+            // Nothing would ever answer it: reply at once with exception 0x0B (gateway target
+            // device failed to respond) rather than mapping a request that cannot be sent
+            const uint8_t response[] = {request[0], request[1], 0, 0, 0, 3, request[6],
+                                        static_cast<uint8_t>(request[7] | 0x80), 0x0B};
+            if (!answerModbusRequest(conn, response, sizeof(response), stamp))
+            {
+                return false;
+            }
+            answered = true;
+            offset += length;
+            continue;
+        }
+        if (coalescable && modbus->joinInflight(request, length, conn.sock))
+        {
+            metrics.requestsCoalesced.add();
+            offset += length;
+            continue;
+        }
+        if (kept != offset)
+        {
+            std::memmove(conn.frames.data() + kept, request, length);
+        }
+        uint8_t* mapped = conn.frames.data() + kept;
+        modbus->mapRequest(mapped, conn.sock, coalescable ? length : 0);
+        if (cacheable)
+        {
+            metrics.cacheMisses.add();
+            cache->expect(mapped, length);
+        }
+        else if (cache)
+        {
+            cache->invalidateFor(mapped, length);
+        }
+        kept += length;
+        offset += length;
+    }
+    if (kept > 0)
+    {
+        // Frames finished by this read are stamped with it, even if they began in an earlier one
+        forwardToRemote(conn.frames.data(), kept, nullptr, stamp);
+    }
+    conn.frames.erase(conn.frames.begin(), conn.frames.begin() + static_cast<std::ptrdiff_t>(offset));
+    return !answered || flushClient(conn);
+}
+
+bool TcpBridgeInstance::answerModbusRequest(ClientConn& conn, const uint8_t* response, size_t size,
+                                           const ChunkStamp& stamp)
+{
+    if (conn.pending.size() >= config.highWatermark ||
+        !conn.pending.append(response, size, ChunkStamp{stamp.ticks, conn.seq}))
+    {
+        logDebug("client not reading modbus responses, closing client");
+        closeClient(conn.sock);
+        return false;
+    }
+    countClientWrite(conn, size);
+    return true;
+}
+
+bool TcpBridgeInstance::forwardFrames(ClientConn& conn, const ChunkRef& chunk, size_t size, const ChunkStamp& stamp)
+{
+    // A partial frame waits in conn.frames, so nothing from another client can land inside it on
+    // the link. A read that starts on a frame boundary, the usual case, is split in place.
+    const bool buffered = !conn.frames.empty();
+    if (buffered)
+    {
+        conn.frames.insert(conn.frames.end(), chunk.data(), chunk.data() + size);
+    }
+    const uint8_t* data = buffered ? conn.frames.data() : chunk.data();
+    const size_t available = buffered ? conn.frames.size() : size;
+    const size_t whole = conn.framer->split(data, available);
+    if (whole == Framer::kMalformed)
+    {
+        logDebug("client frame too long, closing client");
+        closeClient(conn.sock);
+        return false;
+    }
+    if (whole > 0)
+    {
+        // Device responses go back to whichever client sent the last whole frame
+        targetClient = conn.sock;
+        forwardToRemote(data, whole, buffered ? nullptr : &chunk, stamp);
+    }
+    if (buffered)
+    {
+        conn.frames.erase(conn.frames.begin(), conn.frames.begin() + static_cast<std::ptrdiff_t>(whole));
+    }
+    else
+    {
+        conn.frames.assign(chunk.data() + whole, chunk.data() + size);
+    }
+    return true;
+}
+
+bool TcpBridgeInstance::flushUpPipe(ClientConn& conn)
+{
+    // Only one client at a time may have a partial chunk on the device link
+    if (remoteWriter != INVALID_SOCKET_T && remoteWriter != conn.sock)
+    {
+        return true;
+    }
+    if (!conn.upPipe->drain(remoteSock))
+    {
+        logDebug("send to remote failed, closing remote");
+        detachRemote();
+        return false;
+    }
+    remoteWriter = conn.upPipe->buffered() > 0 ? conn.sock : INVALID_SOCKET_T;
+    if (remoteWriter != INVALID_SOCKET_T)
+    {
+        remoteStalled();
+    }
+    else
+    {
+        traceDrained(true, conn.upTrace, conn.seq);
+    }
+    return true;
+}
+
+bool TcpBridgeInstance::sendToClient(ClientConn& conn, const uint8_t* data, size_t size, const ChunkRef* chunk,
+                                     const ChunkStamp& stamp)
+{
+    countClientWrite(conn, size);
+    size_t offset = 0;
+    if (conn.pending.empty())
+    {
+        while (offset < size)
+        {
+            int written = ::send(conn.sock, reinterpret_cast<const char*>(data + offset),
+                                 static_cast<int>(size - offset), kSendFlags);
+            if (written > 0)
+            {
+                offset += static_cast<size_t>(written);
+                continue;
+            }
+            if (written < 0 && wouldBlock())
+            {
+                break;
+            }
+            logDebug("send to client failed, closing client");
+            closeClient(conn.sock);
+            return false;
+        }
+        if (offset == size)
+        {
+            traceDwell(false, stamp, size, TraceClock::now());
+            return true;
+        }
+    }
+    if (offset < size)
+    {
+        const bool queued = chunk ? conn.pending.append(*chunk, static_cast<size_t>(data - chunk->data()) + offset,
+                                                        size - offset, stamp)
+                                  : conn.pending.append(data + offset, size - offset, stamp);
+        if (!queued)
+        {
+            logDebug("client queue overflow, closing client");
+            closeClient(conn.sock);
+            return false;
+        }
+        clientStalled(conn);
+        loop.watchWrite(conn.sock, true);
+    }
+    return true;
+}
+
+bool TcpBridgeInstance::flushClient(ClientConn& conn)
+{
+    if (fanout)
+    {
+        return flushFanout(conn);
+    }
+    if (conn.downPipe)
+    {
+        if (!conn.downPipe->drain(conn.sock))
+        {
+            logDebug("send to client failed, closing client");
+            closeClient(conn.sock);
+            return false;
+        }
+        if (conn.downPipe->buffered() > 0)
+        {
+            clientStalled(conn);
+        }
+        else
+        {
+            clientDrained(conn);
+            traceDrained(false, conn.downTrace, conn.seq);
+        }
+        loop.watchWrite(conn.sock, conn.downPipe->buffered() > 0);
+        return true;
+    }
+    while (!conn.pending.empty())
+    {
+        NetIoVec vecs[kMaxIoVecs];
+        const int count = conn.pending.gather(vecs, kMaxIoVecs);
+        const int written = SendSocketV(conn.sock, vecs, count);
+        if (written > 0)
+        {
+            const uint64_t now = TraceClock::now();
+            conn.pending.consume(static_cast<size_t>(written),
+                                 [&](const ChunkStamp& stamp, size_t bytes) { traceDwell(false, stamp, bytes, now); });
+            continue;
+        }
+        if (written == 0)
+        {
+            clientStalled(conn);
+            return true;
+        }
+        logDebug("send to client failed, closing client");
+        closeClient(conn.sock);
+        return false;
+    }
+    clientDrained(conn);
+    loop.watchWrite(conn.sock, false);
+    return true;
+}
+
+bool TcpBridgeInstance::flushFanout(ClientConn& conn)
+{
+    while (conn.cursor < fanout->head())
+    {
+        size_t size = 0;
+        const uint8_t* data = fanout->readSpan(conn.cursor, size);
+        int written = ::send(conn.sock, reinterpret_cast<const char*>(data), static_cast<int>(size), kSendFlags);
+        if (written > 0)
+        {
+            conn.cursor += static_cast<uint64_t>(written);
+            countClientWrite(conn, static_cast<size_t>(written));
+            continue;
+        }
+        if (written < 0 && wouldBlock())
+        {
+            clientStalled(conn);
+            loop.watchWrite(conn.sock, true);
+            return true;
+        }
+        logDebug("send to client failed, closing client");
+        closeClient(conn.sock);
+        return false;
+    }
+    clientDrained(conn);
+    traceDrained(false, conn.downTrace, conn.seq);
+    loop.watchWrite(conn.sock, false);
+    return true;
+}
+
+void TcpBridgeInstance::publishFanout(size_t bytes, uint64_t readTicks)
+{
+    std::vector<SOCKET_T> socks;
+    socks.reserve(clients.size());
+    for (const auto& entry : clients)
+    {
+        traceIngress(entry.second->downTrace, bytes, readTicks);
+        socks.push_back(entry.first);
+    }
+    for (SOCKET_T sock : socks)
+    {
+        auto it = clients.find(sock);
+        if (it != clients.end())
+        {
+            flushFanout(*it->second);
+        }
+    }
+}
+
+bool TcpBridgeInstance::dropLaggingClients(size_t incoming)
+{
+    // A client that would lose unread bytes to the next write is cut off instead of stalling
+    // the rest. Returns false when no client could take more, so nobody is worth dropping for.
+    if (fanout->head() + incoming <= fanout->capacity())
+    {
+        return true;
+    }
+    const uint64_t limit = fanout->head() + incoming - fanout->capacity();
+    std::vector<SOCKET_T> lagging;
+    for (const auto& entry : clients)
+    {
+        if (entry.second->cursor < limit)
+        {
+            lagging.push_back(entry.first);
+        }
+    }
+    if (lagging.size() == clients.size())
+    {
+        return false;
+    }
+    for (SOCKET_T sock : lagging)
+    {
+        logDebug("dropping slow subscriber on port {}", config.listenPort);
+        metrics.subscribersDropped.add();
+        closeClient(sock);
+    }
+    return true;
+}
+
+void TcpBridgeInstance::closeClient(SOCKET_T sock)
+{
+    auto it = clients.find(sock);
+    if (it == clients.end())
+    {
+        return;
+    }
+    loop.cancelTimer(it->second->idleTimer);
+    captureRecord(CaptureKind::ClientClose, it->second->seq, TraceClock::now());
+    loop.remove(sock);
+    closeSocket(sock);
+    metrics.removeClient(it->second->stats);
+    --metrics.clientsActive;
+    clients.erase(it);
+    if (modbus)
+    {
+        modbus->forgetClient(sock);
+    }
+    if (targetClient == sock)
+    {
+        targetClient = INVALID_SOCKET_T;
+    }
+    if (remoteWriter == sock)
+    {
+        // Its half-sent chunk is gone; let the next client onto the link
+        remoteWriter = INVALID_SOCKET_T;
+        flushRemote();
+    }
+    logDebug("client disconnected on port {}", config.listenPort);
+}
+
+TcpBridgeInstance::ClientConn* TcpBridgeInstance::routeTarget()
+{
+    auto it = clients.find(targetClient);
+    if (it != clients.end())
+    {
+        return it->second.get();
+    }
+
+    // Nobody has spoken yet (or the last speaker left): fall back to the newest client
+    ClientConn* newest = nullptr;
+    for (auto& entry : clients)
+    {
+        if (!newest || entry.second->seq > newest->seq)
+        {
+            newest = entry.second.get();
+        }
+    }
+    targetClient = newest ? newest->sock : INVALID_SOCKET_T;
+    return newest;
+}
+
+void TcpBridgeInstance::resumeClientReads()
+{
+    std::vector<SOCKET_T> paused;
+    for (const auto& entry : clients)
+    {
+        if (entry.second->readPaused)
+        {
+            paused.push_back(entry.first);
+        }
+    }
+    for (SOCKET_T sock : paused)
+    {
+        auto it = clients.find(sock);
+        if (it == clients.end())
+        {
+            continue;
+        }
+        it->second->readPaused = false;
+        readClient(*it->second);
+    }
+}
+
+TcpBridgeManager::TcpBridgeManager(std::vector<BridgeConfig> cfgs, int statusPort, unsigned workers)
+    : configs(std::move(cfgs)), workerCount(workers), statusListenPort(statusPort)
+{
+    if (workerCount == 0)
+    {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+void TcpBridgeManager::start()
+{
+    const auto begin = std::chrono::steady_clock::now();
+    // Pick the dwell clock before any loop stamps a chunk with it
+    TraceClock::calibrate();
+    // Thread-per-core: pin each worker when there is more than one so shards keep their caches
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < workerCount; ++i)
+    {
+        loops.emplace_back(std::make_unique<EventLoop>());
+        loops.back()->startThread(workerCount > 1 ? static_cast<int>(i % cores) : -1);
+    }
+    loopBridges.assign(loops.size(), 0);
+
+    {
+        std::lock_guard<std::mutex> lock(topologyMutex);
+        applyTopology(std::move(configs));
+    }
+    startStatusServer();
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+    logDebug("started {} bridges on {} workers in {}ms", bridges.size(), workerCount, elapsed.count());
+}
+
+void TcpBridgeManager::setConfigLoader(ConfigLoader loader)
+{
+    std::lock_guard<std::mutex> lock(topologyMutex);
+    configLoader = std::move(loader);
+}
+
+std::string TcpBridgeManager::reload()
+{
+    std::lock_guard<std::mutex> lock(topologyMutex);
+    if (!configLoader)
+    {
+        return "reload: no config source\n";
+    }
+    std::vector<BridgeConfig> cfgs;
+    std::string error;
+    if (!configLoader(cfgs, error))
+    {
+        logDebug("reload failed: {}", error);
+        return "reload failed: " + error + "\n";
+    }
+    return applyTopology(std::move(cfgs));
+}
+
+std::string TcpBridgeManager::applyTopology(std::vector<BridgeConfig> cfgs)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    std::unordered_map<int, BridgeConfig*> wanted;
+    wanted.reserve(cfgs.size());
+    for (auto& cfg : cfgs)
+    {
+        if (!wanted.emplace(cfg.listenPort, &cfg).second)
+        {
+            logDebug("listen port {} configured twice, keeping the first", cfg.listenPort);
+        }
+    }
+
+    // Bridges that are gone or changed stop first, so a changed one can take its port back.
+    // The stops are posted together and awaited together: one loop round trip per worker,
+    // not per bridge.
+    std::vector<std::map<int, Slot>::iterator> retired;
+    size_t restarted = 0;
+    for (auto it = bridges.begin(); it != bridges.end(); ++it)
+    {
+        auto match = wanted.find(it->first);
+        if (match != wanted.end() && *match->second == it->second.config)
+        {
+            wanted.erase(match); // unchanged: keep it running, clients and all
+            continue;
+        }
+        restarted += match != wanted.end() ? 1 : 0;
+        it->second.bridge->stop();
+        retired.push_back(it);
+    }
+    for (auto it : retired)
+    {
+        it->second.bridge->waitStopped();
+        --loopBridges[it->second.worker];
+        bridges.erase(it);
+    }
+
+    // What is left in wanted is new or changed; keep the configured order for reproducible placement
+    for (auto& cfg : cfgs)
+    {
+        auto match = wanted.find(cfg.listenPort);
+        if (match == wanted.end() || match->second != &cfg)
+        {
+            continue;
+        }
+        const size_t worker = static_cast<size_t>(
+            std::min_element(loopBridges.begin(), loopBridges.end()) - loopBridges.begin());
+        Slot slot;
+        slot.config = cfg;
+        slot.worker = worker;
+        slot.bridge = std::make_unique<TcpBridgeInstance>(std::move(cfg), *loops[worker]);
+        slot.bridge->start();
+        ++loopBridges[worker];
+        const int port = slot.config.listenPort;
+        bridges.emplace(port, std::move(slot));
+    }
+
+    const size_t started = wanted.size() - restarted;
+    const size_t stopped = retired.size() - restarted;
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+    const std::string summary = "topology: " + std::to_string(bridges.size()) + " bridges, " +
+                                std::to_string(started) + " started, " + std::to_string(stopped) + " stopped, " +
+                                std::to_string(restarted) + " restarted in " + std::to_string(elapsed.count()) + "us\n";
+    logDebug("topology: {} bridges, {} started, {} stopped, {} restarted in {}us", bridges.size(), started, stopped,
+             restarted, elapsed.count());
+    return summary;
+}
+
+void TcpBridgeManager::startStatusServer()
+{
+    // Lightweight status server for the upper host to query bridge health
+    NetTcpPARAM statusParam{};
+    statusParam.bServer = 1;
+    statusParam.bRefLocalPort = 1;
+    statusParam.LocalPort = statusListenPort;
+    statusParam.ServerFunc = [this](SOCKET_T clientSock) {
+        sendAll(clientSock, handleStatusRequest(readStatusRequest(clientSock)));
+        closeSocket(clientSock);
+    };
+
+    statusServer.SetParam(statusParam);
+    statusServer.Open();
+    logDebug("status server listening on port {}", statusListenPort);
+}
+
+std::string TcpBridgeManager::handleStatusRequest(const std::string& request)
+{
+    // Plain commands for scripts, or HTTP GETs for scrapers; a client that says nothing gets
+    // the one-line-per-bridge report as before
+    if (request == "reload")
+    {
+        return reload();
+    }
+    std::lock_guard<std::mutex> lock(topologyMutex);
+    if (request.compare(0, 4, "GET ") == 0)
+    {
+        const std::string path = request.substr(4, request.find(' ', 4) - 4);
+        if (path == "/metrics")
+        {
+            return httpReply("200 OK", "text/plain; version=0.0.4", formatPrometheus(metricsList()));
+        }
+        if (path == "/metrics.bin")
+        {
+            return httpReply("200 OK", "application/octet-stream", formatBinary(metricsList()));
+        }
+        if (path == "/outliers")
+        {
+            return httpReply("200 OK", "text/plain", formatOutliers(metricsList()));
+        }
+        if (path == "/" || path == "/status")
+        {
+            return httpReply("200 OK", "text/plain", buildStatusReport());
+        }
+        return httpReply("404 Not Found", "text/plain", "unknown path\n");
+    }
+    if (request == "metrics")
+    {
+        return formatPrometheus(metricsList());
+    }
+    if (request == "metrics-bin")
+    {
+        return formatBinary(metricsList());
+    }
+    if (request == "outliers")
+    {
+        return formatOutliers(metricsList());
+    }
+    return buildStatusReport();
+}
+
+std::vector<const BridgeMetrics*> TcpBridgeManager::metricsList() const
+{
+    std::vector<const BridgeMetrics*> list;
+    for (const auto& entry : bridges)
+    {
+        list.push_back(&entry.second.bridge->getMetrics());
+    }
+    return list;
+}
+
+std::string TcpBridgeManager::buildStatusReport() const
+{
+    // Build plain-text status lines for each bridge
+    std::string report;
+    for (const auto& entry : bridges)
+    {
+        const auto& bridge = entry.second.bridge;
+        const auto& cfg = bridge->getConfig();
+        report += "remote " + cfg.remoteIp + ":" + std::to_string(cfg.remotePort);
+        report += " -> listen " + std::to_string(cfg.listenPort);
+        report += " connected=" + std::string(bridge->isRemoteConnected() ? "1" : "0");
+        report += " link=" + std::string(linkStateName(bridge->getLinkState()));
+        report += " clients=" + std::to_string(bridge->getMetrics().clientsActive.load());
+        const int64_t startup = bridge->getStartupMicros();
+        report += " startup=" + (startup < 0 ? std::string("pending") : std::to_string(startup / 1000) + "ms");
+        if (cfg.heartbeatIntervalMs > 0)
+        {
+            // min/avg/p99 over the recent window, in microseconds
+            const RttWindow::Summary rtt = bridge->getRtt();
+            report += " rtt_us=" + (rtt.samples == 0 ? std::string("none")
+                                                     : std::to_string(rtt.minUs) + "/" + std::to_string(rtt.avgUs) +
+                                                           "/" + std::to_string(rtt.p99Us));
+        }
+        if (cfg.broadcast)
+        {
+            report += " dropped=" + std::to_string(bridge->getDroppedSubscribers());
+        }
+        report += "\n";
+    }
+    return report;
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "bridge_config.h"
+#include "capture.h"
+#include "chunk_pool.h"
+#include "event_loop.h"
+#include "fanout_ring.h"
+#include "metrics.h"
+#include "modbus_mux.h"
+#include "net_io.h"
+#include "rtt_window.h"
+#include "splice_pipe.h"
+#include "trace_clock.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Lifecycle of a bridge's device link
+enum class LinkState
+{
+    Disconnected, // not started yet
+    Connecting,   // one non-blocking connect in flight
+    Up,           // attached to the event loop
+    Backoff,      // waiting out the retry delay after a failure
+};
+
+const char* linkStateName(LinkState state);
+
+// Represents one bidirectional bridge: maintains a long-lived client link to the remote
+// device and accepts upstream connections from the local host for forwarding.
+// All sockets of a bridge live on one worker's event loop, so its data path needs no locks;
+// the device link is reconnected from the same loop, with exponential backoff.
+class TcpBridgeInstance
+{
+public:
+    TcpBridgeInstance(BridgeConfig cfg, EventLoop& eventLoop);
+    ~TcpBridgeInstance();
+
+    void start();
+
+    // Close the listener, every client and the device link on the loop thread; returns at
+    // once, waitStopped() blocks a non-loop thread until the bridge may be destroyed
+    void stop();
+    void waitStopped();
+
+    bool isRemoteConnected() const
+    {
+        return linkState == LinkState::Up;
+    }
+
+    LinkState getLinkState() const
+    {
+        return linkState;
+    }
+
+    // Block the calling (non-loop) thread until the device link is up; false on timeout
+    bool waitRemoteConnected(std::chrono::milliseconds timeout);
+
+    // Heartbeat round trips of the device link
+    RttWindow::Summary getRtt() const
+    {
+        return rtt.summary();
+    }
+
+    // Time from start() until the device link first came up, -1 while it never has
+    int64_t getStartupMicros() const
+    {
+        return startupMicros;
+    }
+
+    // Broadcast mode: clients dropped for falling a whole fan-out ring behind
+    uint64_t getDroppedSubscribers() const
+    {
+        return metrics.subscribersDropped.load();
+    }
+
+    // Counters and histograms, readable from any thread
+    const BridgeMetrics& getMetrics() const
+    {
+        return metrics;
+    }
+
+    const BridgeConfig& getConfig() const
+    {
+        return config;
+    }
+
+private:
+    // Dwell tracing for bytes held outside a ChunkQueue (splice pipe, fan-out ring): one sample
+    // per backlog, from the read of its oldest byte until the last of it has been written
+    struct BacklogTrace
+    {
+        uint64_t since = 0; // TraceClock ticks
+        size_t bytes = 0;
+    };
+
+    struct ClientConn
+    {
+        SOCKET_T sock = INVALID_SOCKET_T;
+        uint64_t seq = 0;            // accept order, newest client wins device data when unrouted
+        ChunkQueue pending;          // device data the client socket has not accepted yet
+        bool readPaused = false;     // stopped reading because the device side is backed up
+        std::unique_ptr<SplicePipe> upPipe;   // splice mode: client bytes parked in the kernel
+        std::unique_ptr<SplicePipe> downPipe; // splice mode: device bytes parked in the kernel
+        uint64_t cursor = 0;         // broadcast mode: next fan-out ring position to deliver
+        std::vector<uint8_t> frames; // modbus or framing mode: request bytes not yet forming a whole frame
+        std::unique_ptr<Framer> framer; // framing mode
+        std::shared_ptr<ClientMetrics> stats;
+        std::chrono::steady_clock::time_point stallSince; // set while sends to the client are blocked
+        BacklogTrace upTrace;   // splice mode: bytes in upPipe
+        BacklogTrace downTrace; // splice mode: bytes in downPipe; broadcast mode: ring bytes not yet sent
+        EventLoop::TimerId idleTimer = 0;
+        uint64_t idleSeen = 0; // bytes both ways at the last idle check
+        int quietChecks = 0;   // idle checks in a row that saw no traffic
+    };
+
+    BridgeConfig config;
+    EventLoop& loop;
+    NetTcpIO remote;
+    NetTcpIO server;
+    std::atomic<bool> running{true};
+    BridgeMetrics metrics;
+    std::chrono::steady_clock::time_point startedAt;
+    std::atomic<int64_t> startupMicros{-1};
+    RttWindow rtt;
+    uint64_t dwellOutlierNanos = 0;
+
+    // Written on the loop thread only; waiters sleep on linkChanged
+    std::atomic<LinkState> linkState{LinkState::Disconnected};
+    bool stopped = false;
+    std::mutex linkMutex;
+    std::condition_variable linkChanged;
+
+    // Loop-thread state
+    SOCKET_T remoteSock = INVALID_SOCKET_T;
+    SOCKET_T remotePollFd = INVALID_SOCKET_T; // remoteSock, or its io_uring eventfd
+    SOCKET_T connectSock = INVALID_SOCKET_T;  // socket of the connect in flight
+    SOCKET_T listenPollFd = INVALID_SOCKET_T; // listener, or its io_uring eventfd
+    EventLoop::TimerId backoffTimer = 0;
+    EventLoop::TimerId connectTimer = 0; // bounds the connect in flight
+    EventLoop::TimerId heartbeatTimer = 0;
+    EventLoop::TimerId probeTimer = 0;   // the outstanding probe's deadline
+    bool probeInFlight = false;
+    std::chrono::steady_clock::time_point probeSentAt;
+    uint16_t probeTid = 0; // link transaction ID of the probe in flight
+    std::chrono::steady_clock::time_point lastDeviceRx;
+    uint64_t remoteBytesSeen = 0;        // io_uring: receive count at the last event
+    std::chrono::steady_clock::time_point remoteStallSince; // set while sends to the device are blocked
+    uint32_t connectFailures = 0;       // consecutive failures, sets the backoff delay
+    std::minstd_rand jitter;
+    ChunkQueue remotePending;           // client data the device socket has not accepted yet
+    bool remoteReadable = false;        // read edge not drained because no client could take the data
+    std::unordered_map<SOCKET_T, std::unique_ptr<ClientConn>> clients;
+    SOCKET_T targetClient = INVALID_SOCKET_T; // client that receives device data
+    SOCKET_T remoteWriter = INVALID_SOCKET_T; // splice mode: client whose pipe is half flushed to the device
+    uint64_t nextSeq = 0;
+    std::unique_ptr<FanoutRing> fanout; // broadcast mode: device stream shared by all clients
+    std::unique_ptr<ModbusMux> modbus;  // modbus mode: transaction ID routing
+    std::vector<uint8_t> remoteFrames;  // modbus mode: response bytes not yet forming a whole frame
+    std::unique_ptr<CaptureWriter> capture; // captureDir set: the traffic ring file
+    std::unique_ptr<ResponseCache> cache;   // modbus mode with a cache TTL
+
+    void setupRemote();
+    void setupServer();
+    void shutdown();
+
+    void setLinkState(LinkState state);
+    void connectRemote();
+    void onConnectEvent();
+    void onConnectTimeout();
+    void onRemoteConnected();
+    void scheduleReconnect();
+    bool attachRemote();
+    void detachRemote();
+    void startHeartbeat();
+    void stopHeartbeat();
+    void onHeartbeatTick();
+    void onDeviceBytes();
+    void onProbeAnswered();
+    void recordRtt(uint64_t micros);
+    void countDeviceRead(size_t bytes);
+    void countClientRead(ClientConn& conn, size_t bytes);
+    void countClientWrite(ClientConn& conn, size_t bytes);
+    void captureRecord(CaptureKind kind, uint64_t client, uint64_t ticks, const uint8_t* data = nullptr,
+                       size_t size = 0);
+    void remoteStalled();
+    void remoteDrained();
+    void clientStalled(ClientConn& conn);
+    void clientDrained(ClientConn& conn);
+    // Record how long stamped bytes spent in the bridge, now being their write time
+    void traceDwell(bool up, const ChunkStamp& stamp, size_t bytes, uint64_t now);
+    void traceIngress(BacklogTrace& trace, size_t bytes, uint64_t ticks);
+    void traceDrained(bool up, BacklogTrace& trace, uint64_t client);
+    void onRemoteEvent(uint32_t events);
+    void drainRemote();
+    void drainRemoteFanout();
+    void drainRemoteModbus();
+    void routeModbusResponses(uint64_t readTicks);
+    // Drop every mapped request, joinable key and expected cache answer
+    void forgetModbusInflight();
+    // Queue a response for client, recording it in touched; false if the client was closed
+    bool queueModbusResponse(SOCKET_T client, const uint8_t* frame, size_t size, uint64_t readTicks,
+                             std::vector<SOCKET_T>& touched);
+    // chunk, when given, holds data; leftovers then share it instead of being copied.
+    // stamp marks when and from whom the data was read, for dwell tracing.
+    void forwardToRemote(const uint8_t* data, size_t size, const ChunkRef* chunk = nullptr,
+                         const ChunkStamp& stamp = {});
+    void flushRemote();
+
+    void acceptClients();
+    void armIdleCheck(ClientConn& conn);
+    void onIdleCheck(SOCKET_T sock);
+    void onClientEvent(SOCKET_T sock, uint32_t events);
+    void readClient(ClientConn& conn);
+    void readClientSplice(ClientConn& conn);
+    bool forwardModbusRequests(ClientConn& conn, const uint8_t* data, size_t size, const ChunkStamp& stamp);
+    // Queue a response the bridge makes up itself (cache hit, link down); false if the client was closed
+    bool answerModbusRequest(ClientConn& conn, const uint8_t* response, size_t size, const ChunkStamp& stamp);
+    bool forwardFrames(ClientConn& conn, const ChunkRef& chunk, size_t size, const ChunkStamp& stamp);
+    bool flushUpPipe(ClientConn& conn);
+    bool sendToClient(ClientConn& conn, const uint8_t* data, size_t size, const ChunkRef* chunk = nullptr,
+                      const ChunkStamp& stamp = {});
+    bool flushClient(ClientConn& conn);
+    bool flushFanout(ClientConn& conn);
+    void publishFanout(size_t bytes, uint64_t readTicks);
+    bool dropLaggingClients(size_t incoming);
+    void closeClient(SOCKET_T sock);
+    ClientConn* routeTarget();
+    void resumeClientReads();
+};
+
+// Shards bridges over a fixed set of worker event loops (thread-per-core when workers > 1).
+// Each bridge and every socket it owns stay on a single worker for their whole life.
+// The topology can be replaced while running: reload() restarts only the bridges whose
+// configuration changed, so clients of the others never notice.
+class TcpBridgeManager
+{
+public:
+    // Fills configs with the new topology, or explains why it could not
+    using ConfigLoader = std::function<bool(std::vector<BridgeConfig>& configs, std::string& error)>;
+
+    // workers: number of event loop threads, 0 = one per core
+    TcpBridgeManager(std::vector<BridgeConfig> cfgs, int statusPort, unsigned workers = 1);
+
+    void start();
+
+    // Source of the topology for reload(), e.g. the config file the bridges came from
+    void setConfigLoader(ConfigLoader loader);
+
+    // Load the topology again and apply the difference; returns a one-line summary. A
+    // topology that fails to load leaves the running one untouched. Safe from any thread
+    // but the workers'; the status command "reload" calls it too.
+    std::string reload();
+
+private:
+    struct Slot
+    {
+        BridgeConfig config; // as configured, before the bridge normalizes its copy
+        size_t worker = 0;
+        std::unique_ptr<TcpBridgeInstance> bridge;
+    };
+
+    std::vector<BridgeConfig> configs;
+    unsigned workerCount = 1;
+    std::vector<std::unique_ptr<EventLoop>> loops;
+    std::vector<size_t> loopBridges; // bridges per worker, new ones go to the emptiest
+    // Keyed by listen port. Reloads and status readers take topologyMutex; the status
+    // formatters read bridge metrics through it, so no bridge is destroyed under them.
+    std::map<int, Slot> bridges;
+    mutable std::mutex topologyMutex;
+    ConfigLoader configLoader;
+    int statusListenPort = 0;
+    NetTcpIO statusServer;
+
+    // Start, stop and restart bridges until they match cfgs (topologyMutex held)
+    std::string applyTopology(std::vector<BridgeConfig> cfgs);
+    void startStatusServer();
+    // Reply to one status connection: the legacy report, or metrics when asked for them
+    std::string handleStatusRequest(const std::string& request);
+    std::string buildStatusReport() const;
+    std::vector<const BridgeMetrics*> metricsList() const;
+};
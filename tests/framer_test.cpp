@@ -0,0 +1,217 @@
+// Framing: the vector backward scan agrees with a plain loop at every length and alignment, and
+// a delimiter framer fed a stream in arbitrary pieces cuts it exactly where the delimiters end,
+// including delimiters split across reads
+
+#include "framer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+size_t lastByteReference(const uint8_t* data, size_t size, uint8_t byte)
+{
+    for (size_t i = size; i > 0; --i)
+    {
+        if (data[i - 1] == byte)
+        {
+            return i - 1;
+        }
+    }
+    return size;
+}
+
+// Every start offset (unaligned loads) and length across several 32-byte blocks, with the
+// needle absent, once, and at two places
+void backwardScan()
+{
+    std::vector<uint8_t> buffer(256);
+    uint64_t bad = 0;
+    for (size_t offset = 0; offset < 32; ++offset)
+    {
+        for (size_t size = 0; size + offset <= 160; ++size)
+        {
+            const uint8_t* data = buffer.data() + offset;
+            for (size_t i = 0; i < buffer.size(); ++i)
+            {
+                buffer[i] = static_cast<uint8_t>(i % 7 + 1);
+            }
+            bad += findLastByte(data, size, 0) != size;
+            for (size_t at = 0; at < size; ++at)
+            {
+                buffer[offset + at] = 0;
+                bad += findLastByte(data, size, 0) != at;
+                if (at >= 17)
+                {
+                    buffer[offset + at - 17] = 0;
+                    bad += findLastByte(data, size, 0) != at;
+                    buffer[offset + at - 17] = static_cast<uint8_t>((offset + at - 17) % 7 + 1);
+                }
+                buffer[offset + at] = static_cast<uint8_t>((offset + at) % 7 + 1);
+            }
+            // A needle just past the end must not be seen
+            if (offset + size < buffer.size())
+            {
+                buffer[offset + size] = 0;
+                bad += findLastByte(data, size, 0) != size;
+            }
+        }
+    }
+    expect(bad == 0, "findLastByte matches at every length and alignment");
+
+    std::mt19937 rng(7);
+    std::vector<uint8_t> random(4096);
+    for (int round = 0; round < 2000; ++round)
+    {
+        for (uint8_t& byte : random)
+        {
+            byte = static_cast<uint8_t>(rng() % 16);
+        }
+        const size_t size = rng() % random.size();
+        const uint8_t needle = static_cast<uint8_t>(rng() % 20);
+        bad += findLastByte(random.data(), size, needle) != lastByteReference(random.data(), size, needle);
+    }
+    expect(bad == 0, "findLastByte matches on random data");
+}
+
+// End of the last whole delimiter in data, 0 when there is none; the delimiter never overlaps
+// itself, so a forward search finds the same boundaries
+size_t lastFrameEnd(const std::string& data, const std::string& delimiter)
+{
+    size_t end = 0;
+    for (size_t at = data.find(delimiter); at != std::string::npos; at = data.find(delimiter, at + delimiter.size()))
+    {
+        end = at + delimiter.size();
+    }
+    return end;
+}
+
+// Feed stream to a fresh framer in pieces of the given sizes, as the bridge does: append what
+// arrived, take the whole frames split() reports, keep the rest
+bool feedMatches(const FramingConfig& config, const std::string& stream, const std::vector<size_t>& pieces)
+{
+    auto framer = makeFramer(config);
+    std::string buffered;
+    std::string taken;
+    size_t pos = 0;
+    for (size_t piece : pieces)
+    {
+        buffered.append(stream, pos, piece);
+        pos += piece;
+        const size_t cut = framer->split(reinterpret_cast<const uint8_t*>(buffered.data()), buffered.size());
+        if (cut == Framer::kMalformed || cut != lastFrameEnd(buffered, config.delimiter))
+        {
+            return false;
+        }
+        taken += buffered.substr(0, cut);
+        buffered.erase(0, cut);
+    }
+    return taken + buffered == stream.substr(0, pos);
+}
+
+void delimiters()
+{
+    FramingConfig crlf;
+    expect(parseFraming("delim:0d0a", crlf) && crlf.delimiter == "\r\n", "parse a two-byte delimiter");
+
+    // "\r" ends one read and "\n" starts the next
+    auto framer = makeFramer(crlf);
+    std::string buffered = "GET 1\r\nGET 2\r";
+    expect(framer->split(reinterpret_cast<const uint8_t*>(buffered.data()), buffered.size()) == 7,
+           "half a delimiter is not a frame end");
+    buffered.erase(0, 7);
+    buffered += "\nGET";
+    expect(framer->split(reinterpret_cast<const uint8_t*>(buffered.data()), buffered.size()) == 7,
+           "delimiter completed by the next read");
+    buffered.erase(0, 7);
+    expect(framer->split(reinterpret_cast<const uint8_t*>(buffered.data()), buffered.size()) == 0,
+           "nothing whole left");
+
+    // A lone "\n" (last byte of the delimiter) without its "\r" is no frame end
+    framer = makeFramer(crlf);
+    buffered = "a\nb\nc";
+    expect(framer->split(reinterpret_cast<const uint8_t*>(buffered.data()), buffered.size()) == 0,
+           "last byte alone does not match");
+
+    // Every way of cutting a stream in two, for one-, two- and four-byte delimiters
+    FramingConfig line;
+    FramingConfig magic;
+    expect(parseFraming("line", line) && parseFraming("delim:feedface", magic), "parse delimiters");
+    for (const FramingConfig* config : {&line, &crlf, &magic})
+    {
+        const std::string& d = config->delimiter;
+        const std::string stream = "first" + d + "x" + d + d + "a longer record with \xfe\xed and \r in it" + d + "tail";
+        bool ok = true;
+        for (size_t cut = 0; cut <= stream.size(); ++cut)
+        {
+            ok = ok && feedMatches(*config, stream, {cut, stream.size() - cut});
+        }
+        expect(ok, "delimiter found wherever the stream is cut");
+    }
+
+    // Random streams in random pieces, delimiter bytes sprinkled in as noise
+    std::mt19937 rng(99);
+    for (const FramingConfig* config : {&line, &crlf, &magic})
+    {
+        bool ok = true;
+        for (int round = 0; round < 300 && ok; ++round)
+        {
+            std::string stream;
+            const std::string alphabet = "ab\r\n\xfe\xed\xfa\xce";
+            while (stream.size() < 2000)
+            {
+                stream += rng() % 9 == 0 ? config->delimiter : std::string(1, alphabet[rng() % alphabet.size()]);
+            }
+            // Noise may form extra delimiters; only self-overlap would break the reference, and
+            // none of these delimiters overlaps itself
+            std::vector<size_t> pieces;
+            for (size_t left = stream.size(); left > 0;)
+            {
+                const size_t piece = std::min<size_t>(left, 1 + rng() % 70);
+                pieces.push_back(piece);
+                left -= piece;
+            }
+            ok = feedMatches(*config, stream, pieces);
+        }
+        expect(ok, "random pieces split where the delimiters end");
+    }
+
+    // No delimiter within maxFrame bytes is a broken stream
+    FramingConfig small = crlf;
+    small.maxFrame = 16;
+    framer = makeFramer(small);
+    buffered = std::string(16, 'x');
+    expect(framer->split(reinterpret_cast<const uint8_t*>(buffered.data()), buffered.size()) == 0, "at the limit");
+    buffered += "x";
+    expect(framer->split(reinterpret_cast<const uint8_t*>(buffered.data()), buffered.size()) == Framer::kMalformed,
+           "past the limit");
+}
+
+} // namespace
+
+int main()
+{
+    backwardScan();
+    delimiters();
+
+    if (failures == 0)
+    {
+        std::cout << "framer_test passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+// Modbus multiplexing: link transaction IDs are unique and map back to the client that asked,
+// and identical in-flight reads are joined into one device request until a write or its
+// response ends them
+
+#include "modbus_mux.h"
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+using Frame = std::vector<uint8_t>;
+
+// Read holding registers (function 3) of unit, count registers from address
+Frame readRequest(uint16_t tid, uint8_t unit, uint16_t address, uint16_t count = 1)
+{
+    return {static_cast<uint8_t>(tid >> 8),     static_cast<uint8_t>(tid), 0, 0, 0, 6, unit, 3,
+            static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address),
+            static_cast<uint8_t>(count >> 8),   static_cast<uint8_t>(count)};
+}
+
+// Write single register (function 6)
+Frame writeRequest(uint16_t tid, uint8_t unit, uint16_t address, uint16_t value)
+{
+    Frame frame = readRequest(tid, unit, address, value);
+    frame[7] = 6;
+    return frame;
+}
+
+uint16_t tidOf(const Frame& frame)
+{
+    return static_cast<uint16_t>((frame[0] << 8) | frame[1]);
+}
+
+// A device answer to a request as it went out on the link
+Frame responseTo(const Frame& sent)
+{
+    return {sent[0], sent[1], 0, 0, 0, 5, sent[6], sent[7], 2, 0x12, 0x34};
+}
+
+const SOCKET_T kClientA = 10;
+const SOCKET_T kClientB = 11;
+const SOCKET_T kClientC = 12;
+
+void framing()
+{
+    const Frame request = readRequest(1, 1, 0);
+    expect(ModbusMux::frameSize(request.data(), 6) == 0, "header incomplete");
+    expect(ModbusMux::frameSize(request.data(), 11) == 0, "body incomplete");
+    expect(ModbusMux::frameSize(request.data(), 12) == 12, "whole frame");
+    Frame twoFrames = request;
+    twoFrames.insert(twoFrames.end(), request.begin(), request.end());
+    expect(ModbusMux::frameSize(twoFrames.data(), twoFrames.size()) == 12, "first of two frames");
+
+    Frame bad = request;
+    bad[3] = 1;
+    expect(ModbusMux::frameSize(bad.data(), bad.size()) == -1, "nonzero protocol ID");
+    bad = request;
+    bad[5] = 1;
+    expect(ModbusMux::frameSize(bad.data(), bad.size()) == -1, "length below 2");
+    bad = request;
+    bad[4] = 1;
+    expect(ModbusMux::frameSize(bad.data(), bad.size()) == -1, "length past the MBAP limit");
+
+    expect(!ModbusMux::isWrite(request.data()), "function 3 reads");
+    for (uint8_t function : {5, 6, 15, 16, 22, 23})
+    {
+        Frame write = request;
+        write[7] = function;
+        expect(ModbusMux::isWrite(write.data()), "write function");
+    }
+}
+
+void remapping()
+{
+    ModbusMux mux;
+    // Both clients use transaction ID 7; on the link they must differ
+    Frame a = readRequest(7, 1, 0);
+    Frame b = readRequest(7, 1, 10);
+    mux.mapRequest(a.data(), kClientA);
+    mux.mapRequest(b.data(), kClientB);
+    expect(tidOf(a) != tidOf(b), "link IDs unique");
+    expect(mux.inflight() == 2, "two in flight");
+
+    // Answered out of order
+    Frame rb = responseTo(b);
+    Frame ra = responseTo(a);
+    uint64_t elapsed = ~uint64_t(0);
+    expect(mux.mapResponse(rb.data(), &elapsed) == kClientB && tidOf(rb) == 7, "B's answer back to B");
+    expect(elapsed < 1000000, "elapsed time reported");
+    expect(mux.mapResponse(ra.data()) == kClientA && tidOf(ra) == 7, "A's answer back to A");
+    expect(mux.inflight() == 0, "nothing left in flight");
+
+    Frame again = responseTo(a);
+    expect(mux.mapResponse(again.data()) == INVALID_SOCKET_T, "duplicate answer dropped");
+    Frame stray = readRequest(0xBEEF, 1, 0);
+    expect(mux.mapResponse(stray.data()) == INVALID_SOCKET_T, "unknown ID dropped");
+
+    // A client that leaves takes its requests along
+    Frame c = readRequest(3, 1, 0);
+    mux.mapRequest(c.data(), kClientC);
+    mux.forgetClient(kClientC);
+    Frame rc = responseTo(c);
+    expect(mux.mapResponse(rc.data()) == INVALID_SOCKET_T, "answer for a departed client dropped");
+}
+
+void wraparound()
+{
+    ModbusMux mux;
+    Frame first = readRequest(1, 1, 0);
+    mux.mapRequest(first.data(), kClientA, first.size());
+    const Frame sentFirst = first;
+    for (int i = 0; i < 65535; ++i)
+    {
+        Frame filler = readRequest(2, 2, 0);
+        mux.mapRequest(filler.data(), kClientB);
+    }
+    expect(mux.inflight() == 65536, "every ID in use");
+    Frame reuse = readRequest(9, 2, 0);
+    mux.mapRequest(reuse.data(), kClientB);
+    expect(tidOf(reuse) == tidOf(sentFirst), "IDs handed out in sequence and reused after 65536");
+    expect(mux.inflight() == 65536, "oldest request forgotten");
+    Frame late = readRequest(4, 1, 0);
+    expect(!mux.joinInflight(late.data(), late.size(), kClientC), "forgotten request no longer joinable");
+    Frame answer = responseTo(reuse);
+    expect(mux.mapResponse(answer.data()) == kClientB && tidOf(answer) == 9, "reused ID maps to the new request");
+}
+
+void coalescing()
+{
+    ModbusMux mux;
+    Frame leader = readRequest(100, 1, 0, 4);
+    mux.mapRequest(leader.data(), kClientA, leader.size());
+
+    Frame same = readRequest(200, 1, 0, 4);
+    Frame sameAgain = readRequest(300, 1, 0, 4);
+    Frame otherAddress = readRequest(200, 1, 1, 4);
+    Frame otherUnit = readRequest(200, 2, 0, 4);
+    expect(mux.joinInflight(same.data(), same.size(), kClientB), "identical read joins");
+    expect(mux.joinInflight(sameAgain.data(), sameAgain.size(), kClientC), "second identical read joins");
+    expect(!mux.joinInflight(otherAddress.data(), otherAddress.size(), kClientB), "other address does not join");
+    expect(!mux.joinInflight(otherUnit.data(), otherUnit.size(), kClientB), "other unit does not join");
+    expect(mux.inflight() == 1, "joined requests are never sent");
+
+    Frame response = responseTo(leader);
+    std::vector<ModbusMux::Waiter> followers;
+    expect(mux.mapResponse(response.data(), nullptr, &followers) == kClientA && tidOf(response) == 100,
+           "leader gets the answer with its own ID");
+    expect(followers.size() == 2 && followers[0].client == kClientB && followers[0].clientTid == 200 &&
+               followers[1].client == kClientC && followers[1].clientTid == 300,
+           "followers get it with theirs, in arrival order");
+    Frame after = readRequest(400, 1, 0, 4);
+    expect(!mux.joinInflight(after.data(), after.size(), kClientB), "answered request no longer joinable");
+
+    // Mapped without a size: sent, but never joined
+    Frame plain = readRequest(1, 1, 0, 4);
+    mux.mapRequest(plain.data(), kClientA);
+    expect(!mux.joinInflight(after.data(), after.size(), kClientB), "request mapped without size not joinable");
+}
+
+void writesEndJoins()
+{
+    ModbusMux mux;
+    Frame unit1 = readRequest(1, 1, 0);
+    Frame unit2 = readRequest(2, 2, 0);
+    mux.mapRequest(unit1.data(), kClientA, unit1.size());
+    mux.mapRequest(unit2.data(), kClientA, unit2.size());
+
+    Frame write = writeRequest(3, 1, 0, 0x55);
+    mux.mapRequest(write.data(), kClientB);
+    Frame readUnit1 = readRequest(4, 1, 0);
+    Frame readUnit2 = readRequest(5, 2, 0);
+    expect(!mux.joinInflight(readUnit1.data(), readUnit1.size(), kClientC), "read after a write is sent anew");
+    expect(mux.joinInflight(readUnit2.data(), readUnit2.size(), kClientC), "other units stay joinable");
+
+    // The read from before the write still gets its own answer
+    Frame answer = responseTo(unit1);
+    expect(mux.mapResponse(answer.data()) == kClientA && tidOf(answer) == 1, "pre-write read still answered");
+}
+
+void leaderLeaves()
+{
+    ModbusMux mux;
+    Frame leader = readRequest(1, 1, 0);
+    Frame follower = readRequest(2, 1, 0);
+    mux.mapRequest(leader.data(), kClientA, leader.size());
+    expect(mux.joinInflight(follower.data(), follower.size(), kClientB), "follower joins");
+
+    mux.forgetClient(kClientA);
+    expect(mux.inflight() == 1, "request kept for the follower");
+    Frame late = readRequest(3, 1, 0);
+    expect(mux.joinInflight(late.data(), late.size(), kClientC), "still joinable after hand-off");
+    Frame answer = responseTo(leader);
+    std::vector<ModbusMux::Waiter> followers;
+    expect(mux.mapResponse(answer.data(), nullptr, &followers) == kClientB && tidOf(answer) == 2,
+           "first follower inherits the request");
+    expect(followers.size() == 1 && followers[0].client == kClientC, "later followers kept");
+
+    Frame lone = readRequest(4, 1, 0);
+    mux.mapRequest(lone.data(), kClientA, lone.size());
+    mux.forgetClient(kClientA);
+    expect(mux.inflight() == 0, "request without followers forgotten");
+    expect(!mux.joinInflight(late.data(), late.size(), kClientC), "forgotten request not joinable");
+
+    Frame joined = readRequest(5, 1, 0);
+    mux.mapRequest(joined.data(), kClientA, joined.size());
+    mux.clear();
+    expect(mux.inflight() == 0 && !mux.joinInflight(late.data(), late.size(), kClientC), "clear forgets all");
+}
+
+} // namespace
+
+int main()
+{
+    framing();
+    remapping();
+    wraparound();
+    coalescing();
+    writesEndJoins();
+    leaderLeaves();
+
+    if (failures == 0)
+    {
+        std::cout << "modbus_mux_test passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+// Cache rule parsing: reads only, so a write can never be answered from the cache
+
+#include "response_cache.h"
+
+#include <iostream>
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+} // namespace
+
+int main()
+{
+    std::vector<CacheRule> rules;
+    expect(parseCacheRules("3,4@1:0-99", rules) && rules.size() == 2, "read rules parse");
+    expect(rules[1].function == 4 && rules[1].unit == 1 && rules[1].first == 0 && rules[1].last == 99,
+           "rule fields");
+
+    for (const char* write : {"5", "6", "15", "16", "22", "23", "3,6", "16@1:0-9"})
+    {
+        std::vector<CacheRule> kept = rules;
+        expect(!parseCacheRules(write, kept), write);
+        expect(kept == rules, "failed parse leaves the rules alone");
+    }
+    expect(!parseCacheRules("0", rules), "function 0");
+    expect(!parseCacheRules("3:9-1", rules), "reversed range");
+    expect(!parseCacheRules("3@256", rules), "unit out of range");
+
+    if (failures == 0)
+    {
+        std::cout << "response_cache_test passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+// Timer wheel: every timer runs exactly on its expiry tick, whichever level it was filed in and
+// however far advance() jumps, in expiry order, and never after it was cancelled
+
+#include "timer_wheel.h"
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+// Timers on and around each level boundary, each checked one tick early and on time
+void exactTicks()
+{
+    const uint64_t expiries[] = {1,     2,     255,      256,      257,      65535,    65536,
+                                 65537, 70000, 16777215, 16777216, 16777217, 16842755, 0xFFFFFFFF};
+    for (uint64_t expiry : expiries)
+    {
+        TimerWheel wheel;
+        uint64_t firedAt = 0;
+        wheel.schedule(expiry, [&] { firedAt = wheel.currentTick(); });
+        expect(wheel.nextDue() <= expiry, "nextDue is never after the expiry");
+        wheel.advance(expiry - 1);
+        expect(firedAt == 0, "not run a tick early");
+        wheel.advance(expiry);
+        expect(firedAt == expiry, "run on its expiry tick");
+        expect(wheel.size() == 0, "nothing left after it ran");
+    }
+}
+
+// Walking tick by tick makes every level-1 and level-2 slot cascade on its boundary
+void cascadeByTicks()
+{
+    TimerWheel wheel(100);
+    std::map<uint64_t, uint64_t> fired; // expiry -> tick it ran on
+    const uint64_t expiries[] = {356, 611, 65636, 65637, 131171, 200000};
+    for (uint64_t expiry : expiries)
+    {
+        wheel.schedule(expiry, [&wheel, &fired, expiry] { fired[expiry] = wheel.currentTick(); });
+    }
+    for (uint64_t tick = 101; tick <= 200000; ++tick)
+    {
+        wheel.advance(tick);
+    }
+    expect(fired.size() == 6, "every cascaded timer ran");
+    for (const auto& [expiry, tick] : fired)
+    {
+        expect(expiry == tick, "cascaded timer ran on its expiry tick");
+    }
+}
+
+void orderAndCancel()
+{
+    TimerWheel wheel;
+    std::vector<int> order;
+    wheel.schedule(70000, [&] { order.push_back(3); });
+    wheel.schedule(5, [&] { order.push_back(1); });
+    const TimerWheel::TimerId dropped = wheel.schedule(300, [&] { order.push_back(99); });
+    wheel.schedule(300, [&] { order.push_back(2); });
+    wheel.cancel(dropped);
+    wheel.cancel(dropped);
+    wheel.cancel(0);
+    wheel.advance(1000000);
+    expect(order == std::vector<int>({1, 2, 3}), "one long jump runs timers in expiry order");
+
+    // A fired ID must not cancel the timer that reuses its slab entry
+    bool ran = false;
+    const TimerWheel::TimerId old = wheel.schedule(1000010, [] {});
+    wheel.advance(1000010);
+    wheel.schedule(1000020, [&] { ran = true; });
+    wheel.cancel(old);
+    wheel.advance(1000020);
+    expect(ran, "stale ID ignored");
+
+    // An expiry already passed means the next tick
+    uint64_t late = 0;
+    wheel.schedule(5, [&] { late = wheel.currentTick(); });
+    wheel.advance(1000021);
+    expect(late == 1000021, "past expiry runs on the next tick");
+}
+
+void tasksReschedule()
+{
+    TimerWheel wheel;
+    std::vector<uint64_t> ticks;
+    TimerWheel::TimerId neighbour = 0;
+    std::function<void()> periodic = [&] {
+        ticks.push_back(wheel.currentTick());
+        if (ticks.size() < 5)
+        {
+            wheel.schedule(wheel.currentTick() + 300, periodic);
+        }
+    };
+    wheel.schedule(300, periodic);
+    // Same slot as the first run: cancelled by it before its turn
+    wheel.schedule(300, [&] { wheel.cancel(neighbour); });
+    bool neighbourRan = false;
+    neighbour = wheel.schedule(300, [&] { neighbourRan = true; });
+    wheel.advance(5000);
+    expect(ticks == std::vector<uint64_t>({300, 600, 900, 1200, 1500}), "task reschedules itself");
+    expect(!neighbourRan, "task cancels a timer due on the same tick");
+}
+
+// Random schedules, cancels and jumps against a plain map of what is pending
+void randomized()
+{
+    std::mt19937_64 rng(12345);
+    TimerWheel wheel;
+    std::map<uint64_t, uint64_t> live; // id -> expiry
+    uint64_t lastExpiry = 0;
+    uint64_t bad = 0;
+    for (int round = 0; round < 20000; ++round)
+    {
+        const unsigned op = rng() % 10;
+        if (op < 6)
+        {
+            const unsigned level = static_cast<unsigned>(rng() % 4);
+            const uint64_t expiry = wheel.currentTick() + 1 + rng() % (uint64_t(300) << (8 * level));
+            auto id = std::make_shared<TimerWheel::TimerId>(0);
+            *id = wheel.schedule(expiry, [&, id, expiry] {
+                bad += wheel.currentTick() != expiry || expiry < lastExpiry || live.erase(*id) != 1;
+                lastExpiry = expiry;
+            });
+            live[*id] = expiry;
+        }
+        else if (op < 8 && !live.empty())
+        {
+            auto it = live.begin();
+            std::advance(it, static_cast<long>(rng() % live.size()));
+            wheel.cancel(it->first);
+            live.erase(it);
+        }
+        else
+        {
+            const uint64_t target = wheel.currentTick() + rng() % 100000;
+            lastExpiry = 0;
+            wheel.advance(target);
+            for (const auto& [id, expiry] : live)
+            {
+                bad += expiry <= target;
+            }
+        }
+        bad += wheel.size() != live.size();
+    }
+    expect(bad == 0, "randomized timers match the model");
+}
+
+} // namespace
+
+int main()
+{
+    exactTicks();
+    cascadeByTicks();
+    orderAndCancel();
+    tasksReschedule();
+    randomized();
+
+    if (failures == 0)
+    {
+        std::cout << "timer_wheel_test passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+// Topology reload: applyTopology() leaves unchanged bridges running with their clients,
+// restarts changed ones, stops removed ones, starts new ones, and a failed load changes nothing
+
+#include "tcp_bridge.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void expect(bool condition, const std::string& what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+constexpr int kDevicePort = 27400;
+constexpr int kBasePort = 27401; // bridges listen on kBasePort .. kBasePort + 3
+constexpr int kStatusPort = 27409;
+
+// A device that only completes handshakes, so every bridge's link comes up
+int listenDevice()
+{
+    const int s = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(kDevicePort);
+    if (bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(s, 64) < 0)
+    {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+int connectTo(int port)
+{
+    const int s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+// Whether the bridge closed the connection within a second
+bool closedByPeer(int s)
+{
+    pollfd p{s, POLLIN, 0};
+    if (poll(&p, 1, 1000) <= 0)
+    {
+        return false;
+    }
+    char byte;
+    return recv(s, &byte, 1, MSG_DONTWAIT) <= 0;
+}
+
+// Whether the connection is still open and quiet
+bool stillOpen(int s)
+{
+    pollfd p{s, POLLIN, 0};
+    return poll(&p, 1, 200) == 0;
+}
+
+bool startsWith(const std::string& text, const std::string& prefix)
+{
+    return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+BridgeConfig bridge(int listenPort)
+{
+    BridgeConfig config;
+    config.remoteIp = "127.0.0.1";
+    config.remotePort = kDevicePort;
+    config.listenPort = listenPort;
+    return config;
+}
+
+bool canConnect(int port)
+{
+    const int s = connectTo(port);
+    if (s < 0)
+    {
+        return false;
+    }
+    close(s);
+    return true;
+}
+
+} // namespace
+
+int main()
+{
+    std::signal(SIGPIPE, SIG_IGN);
+    if (listenDevice() < 0)
+    {
+        std::cerr << "device port " << kDevicePort << " unavailable" << std::endl;
+        return 1;
+    }
+
+    // Never destroyed: the bridges' loop threads outlive main(), as they do in tcp_bridge_app
+    auto* manager = new TcpBridgeManager({bridge(kBasePort), bridge(kBasePort + 1), bridge(kBasePort + 2)},
+                                         kStatusPort, 2);
+    expect(manager->reload() == "reload: no config source\n", "reload without a loader");
+
+    std::vector<BridgeConfig> next;
+    bool loadFails = false;
+    manager->setConfigLoader([&](std::vector<BridgeConfig>& configs, std::string& error) {
+        if (loadFails)
+        {
+            error = "line 3: bad port";
+            return false;
+        }
+        configs = next;
+        return true;
+    });
+    manager->start();
+
+    const int kept = connectTo(kBasePort);
+    const int changed = connectTo(kBasePort + 1);
+    const int removed = connectTo(kBasePort + 2);
+    expect(kept >= 0 && changed >= 0 && removed >= 0, "initial bridges listen");
+    // Let the loops take the clients before the topology changes under them
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // Same, changed, gone, new; the duplicate of the new port is ignored
+    BridgeConfig resized = bridge(kBasePort + 1);
+    resized.socketBufferBytes = 64 * 1024;
+    BridgeConfig duplicate = bridge(kBasePort + 3);
+    duplicate.broadcast = true;
+    next = {bridge(kBasePort), resized, bridge(kBasePort + 3), duplicate};
+    std::string summary = manager->reload();
+    expect(startsWith(summary, "topology: 3 bridges, 1 started, 1 stopped, 1 restarted"),
+           "mixed reload summary: " + summary);
+    expect(stillOpen(kept), "unchanged bridge keeps its client");
+    expect(closedByPeer(changed), "changed bridge drops its clients");
+    expect(closedByPeer(removed), "removed bridge drops its clients");
+    expect(canConnect(kBasePort + 1), "changed bridge listens again");
+    expect(canConnect(kBasePort + 3), "new bridge listens");
+    expect(!canConnect(kBasePort + 2), "removed bridge's port is closed");
+
+    // Applying the same topology again is a no-op
+    summary = manager->reload();
+    expect(startsWith(summary, "topology: 3 bridges, 0 started, 0 stopped, 0 restarted"),
+           "unchanged reload summary: " + summary);
+    expect(stillOpen(kept), "no-op reload keeps clients");
+
+    // A topology that does not load leaves the running one alone
+    loadFails = true;
+    summary = manager->reload();
+    expect(summary == "reload failed: line 3: bad port\n", "failed reload reported: " + summary);
+    expect(stillOpen(kept) && canConnect(kBasePort + 3), "failed reload changes nothing");
+
+    // Emptied and refilled: every port released and taken again
+    loadFails = false;
+    next.clear();
+    summary = manager->reload();
+    expect(startsWith(summary, "topology: 0 bridges, 0 started, 3 stopped, 0 restarted"),
+           "emptying reload summary: " + summary);
+    expect(closedByPeer(kept), "stopping the last bridges drops their clients");
+    next = {bridge(kBasePort), bridge(kBasePort + 2)};
+    summary = manager->reload();
+    expect(startsWith(summary, "topology: 2 bridges, 2 started, 0 stopped, 0 restarted"),
+           "refilling reload summary: " + summary);
+    expect(canConnect(kBasePort) && canConnect(kBasePort + 2), "released ports bound again at once");
+
+    if (failures == 0)
+    {
+        std::cout << "topology_test passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+namespace {
+
+unsigned lowestBit(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(value));
+#else
+    unsigned index = 0;
+    while (!(value & 1))
+    {
+        value >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+} // namespace
+
+TimerWheel::TimerWheel(uint64_t startTick) : nodes(kLists), current(startTick)
+{
+    for (uint32_t list = 0; list < kLists; ++list)
+    {
+        nodes[list].prev = list;
+        nodes[list].next = list;
+        nodes[list].list = list;
+    }
+}
+
+TimerWheel::TimerId TimerWheel::schedule(uint64_t expiry, Task task)
+{
+    uint32_t node;
+    if (!freeNodes.empty())
+    {
+        node = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    else
+    {
+        node = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+    nodes[node].expiry = expiry;
+    nodes[node].task = std::move(task);
+    place(node);
+    ++pending;
+    return (static_cast<uint64_t>(nodes[node].generation) << 32) | node;
+}
+
+void TimerWheel::cancel(TimerId id)
+{
+    const uint32_t node = static_cast<uint32_t>(id);
+    if (node < kLists || node >= nodes.size() || nodes[node].list == kNil ||
+        nodes[node].generation != static_cast<uint32_t>(id >> 32))
+    {
+        return;
+    }
+    unlink(node);
+    release(node);
+    --pending;
+}
+
+void TimerWheel::advance(uint64_t tick)
+{
+    while (pending > 0)
+    {
+        const uint64_t due = nextDue();
+        if (due > tick)
+        {
+            break;
+        }
+        // Nothing is filed between here and due, so the ticks in between need no visit
+        current = due - 1;
+        step();
+    }
+    current = std::max(current, tick);
+}
+
+uint64_t TimerWheel::nextDue() const
+{
+    if (pending == 0)
+    {
+        return kNever;
+    }
+    const uint64_t next = current + 1;
+    uint64_t due = kNever;
+    for (unsigned level = 0; level < kLevels; ++level)
+    {
+        if (!levelOccupied(level))
+        {
+            continue;
+        }
+        // A level's slots come up on multiples of its unit; past the last one it wraps to slot 0,
+        // which a level above cascades first
+        const unsigned shift = kSlotBits * level;
+        const uint64_t unit = uint64_t(1) << shift;
+        const uint64_t boundary = (next + unit - 1) & ~(unit - 1);
+        const unsigned slot = static_cast<unsigned>(boundary >> shift) & (kSlots - 1);
+        const unsigned found = firstOccupied(level, slot);
+        due = std::min(due, boundary + static_cast<uint64_t>((found < kSlots ? found : kSlots) - slot) * unit);
+    }
+    return due;
+}
+
+void TimerWheel::link(uint32_t list, uint32_t node)
+{
+    const uint32_t tail = nodes[list].prev;
+    nodes[node].prev = tail;
+    nodes[node].next = list;
+    nodes[node].list = list;
+    nodes[tail].next = node;
+    nodes[list].prev = node;
+    if (list < kExpiring)
+    {
+        occupied[list / kSlots][(list % kSlots) / 64] |= uint64_t(1) << (list % 64);
+    }
+}
+
+void TimerWheel::unlink(uint32_t node)
+{
+    const uint32_t list = nodes[node].list;
+    nodes[nodes[node].prev].next = nodes[node].next;
+    nodes[nodes[node].next].prev = nodes[node].prev;
+    nodes[node].list = kNil;
+    if (list < kExpiring && listEmpty(list))
+    {
+        occupied[list / kSlots][(list % kSlots) / 64] &= ~(uint64_t(1) << (list % 64));
+    }
+}
+
+void TimerWheel::place(uint32_t node)
+{
+    // File by distance: level L holds expiries under 256^(L+1) ticks out, in the slot that comes
+    // up last before them; anything further than the wheel spans waits at its far end
+    const uint64_t next = current + 1;
+    const uint64_t span = uint64_t(1) << (kSlotBits * kLevels);
+    uint64_t& expiry = nodes[node].expiry;
+    expiry = std::min(std::max(expiry, next), next + span - 1);
+    const uint64_t distance = expiry - next;
+    unsigned level = 0;
+    while (level + 1 < kLevels && distance >= (uint64_t(1) << (kSlotBits * (level + 1))))
+    {
+        ++level;
+    }
+    const unsigned slot = static_cast<unsigned>(expiry >> (kSlotBits * level)) & (kSlots - 1);
+    link(level * kSlots + slot, node);
+}
+
+void TimerWheel::release(uint32_t node)
+{
+    nodes[node].task = nullptr;
+    ++nodes[node].generation;
+    freeNodes.push_back(node);
+}
+
+void TimerWheel::step()
+{
+    const uint64_t tick = current + 1;
+    // Top down, so timers a higher level drops into a lower slot due now are cascaded again
+    for (unsigned level = kLevels - 1; level > 0; --level)
+    {
+        const unsigned shift = kSlotBits * level;
+        if (tick & ((uint64_t(1) << shift) - 1))
+        {
+            continue;
+        }
+        const uint32_t list = level * kSlots + (static_cast<uint32_t>(tick >> shift) & (kSlots - 1));
+        while (!listEmpty(list))
+        {
+            const uint32_t node = nodes[list].next;
+            unlink(node);
+            place(node);
+        }
+    }
+
+    const uint32_t slot = static_cast<uint32_t>(tick) & (kSlots - 1);
+    current = tick;
+    // Detach the slot first: a task may cancel a neighbour or schedule into the same slot
+    while (!listEmpty(slot))
+    {
+        const uint32_t node = nodes[slot].next;
+        unlink(node);
+        link(kExpiring, node);
+    }
+    while (!listEmpty(kExpiring))
+    {
+        const uint32_t node = nodes[kExpiring].next;
+        Task task = std::move(nodes[node].task);
+        unlink(node);
+        release(node);
+        --pending;
+        task();
+    }
+}
+
+unsigned TimerWheel::firstOccupied(unsigned level, unsigned slot) const
+{
+    for (unsigned word = slot / 64; word < kSlots / 64; ++word)
+    {
+        uint64_t bits = occupied[level][word];
+        if (word == slot / 64)
+        {
+            bits &= ~uint64_t(0) << (slot % 64);
+        }
+        if (bits)
+        {
+            return word * 64 + lowestBit(bits);
+        }
+    }
+    return kSlots;
+}
+
+bool TimerWheel::levelOccupied(unsigned level) const
+{
+    for (unsigned word = 0; word < kSlots / 64; ++word)
+    {
+        if (occupied[level][word])
+        {
+            return true;
+        }
+    }
+    return false;
+}
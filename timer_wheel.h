@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Hierarchical timing wheel (Varghese & Lauck): four levels of 256 slots over an integer
+// tick, so a timer up to 2^32 ticks out is scheduled and cancelled in constant time and only
+// moves down a level when its slot comes up. Occupancy bitmaps let advance() and nextDue()
+// jump over empty slots, so an idle wheel costs nothing per tick and a busy one costs in
+// proportion to the timers that fall due, not to how many are pending. Not thread-safe;
+// tasks may schedule and cancel timers, including their own.
+class TimerWheel
+{
+public:
+    using Task = std::function<void()>;
+    using TimerId = uint64_t; // never 0, so 0 can mean "no timer"
+
+    static constexpr uint64_t kNever = ~uint64_t(0);
+
+    explicit TimerWheel(uint64_t startTick = 0);
+
+    // Run task once advance() reaches expiry; an expiry not after the current tick means the next one
+    TimerId schedule(uint64_t expiry, Task task);
+
+    // Unknown, fired and already cancelled IDs are ignored
+    void cancel(TimerId id);
+
+    // Run, in expiry order, every task due at or before tick
+    void advance(uint64_t tick);
+
+    // Earliest tick at which advance() has work (a task or a cascade), kNever when empty.
+    // Never later than the first expiry, possibly earlier.
+    uint64_t nextDue() const;
+
+    uint64_t currentTick() const { return current; }
+    size_t size() const { return pending; }
+
+private:
+    static constexpr unsigned kLevels = 4;
+    static constexpr unsigned kSlotBits = 8;
+    static constexpr unsigned kSlots = 1u << kSlotBits;
+    static constexpr uint32_t kExpiring = kLevels * kSlots; // list of the slot being run
+    static constexpr uint32_t kLists = kExpiring + 1;
+    static constexpr uint32_t kNil = ~uint32_t(0);
+
+    // Slab entries; the first kLists are list heads, the rest timers linked into them
+    struct Node
+    {
+        uint32_t prev = kNil;
+        uint32_t next = kNil;
+        uint32_t list = kNil;    // owning list while linked, kNil when free
+        uint32_t generation = 0; // bumped on release so stale IDs miss
+        uint64_t expiry = 0;
+        Task task;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+    uint64_t occupied[kLevels][kSlots / 64] = {};
+    uint64_t current = 0; // last tick processed
+    size_t pending = 0;
+
+    void link(uint32_t list, uint32_t node);
+    void unlink(uint32_t node);
+    void place(uint32_t node);
+    void release(uint32_t node);
+    // Process tick current + 1: cascade the levels it is a boundary of, then run level 0's slot
+    void step();
+    bool listEmpty(uint32_t list) const { return nodes[list].next == list; }
+    // First occupied slot of level at or after slot, kSlots when none
+    unsigned firstOccupied(unsigned level, unsigned slot) const;
+    bool levelOccupied(unsigned level) const;
+};
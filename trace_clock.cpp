@@ -0,0 +1,62 @@
+#include "trace_clock.h"
+
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace {
+
+bool invariantTsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+    {
+        return false;
+    }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1u << 8)) != 0;
+#elif defined(_M_X64) || defined(_M_IX86)
+    int regs[4] = {};
+    __cpuid(regs, 0x80000000);
+    if (static_cast<unsigned>(regs[0]) < 0x80000007)
+    {
+        return false;
+    }
+    __cpuid(regs, 0x80000007);
+    return (regs[3] & (1 << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+} // namespace
+
+void TraceClock::calibrate()
+{
+    static std::once_flag once;
+    std::call_once(once, [] {
+#ifdef TRACE_CLOCK_TSC
+        if (!invariantTsc())
+        {
+            return;
+        }
+        const auto wallStart = std::chrono::steady_clock::now();
+        const uint64_t tickStart = __rdtsc();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const uint64_t tickEnd = __rdtsc();
+        const auto wallEnd = std::chrono::steady_clock::now();
+        const double nanos = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(wallEnd - wallStart).count());
+        if (tickEnd <= tickStart || nanos <= 0)
+        {
+            return;
+        }
+        nanosPerTick = nanos / static_cast<double>(tickEnd - tickStart);
+        useTsc = true;
+#endif
+    });
+}
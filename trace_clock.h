@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_CLOCK_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define TRACE_CLOCK_TSC 1
+#endif
+
+// Monotonic tick source cheap enough to stamp every forwarded chunk: the time stamp counter
+// where it is invariant (constant rate, synchronized across cores), steady_clock nanoseconds
+// everywhere else. Ticks only mean something relative to each other; toNanos() scales a
+// difference. calibrate() picks the source and must run before any thread takes stamps.
+class TraceClock
+{
+public:
+    static uint64_t now()
+    {
+#ifdef TRACE_CLOCK_TSC
+        if (useTsc)
+        {
+            return __rdtsc();
+        }
+#endif
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+                .count());
+    }
+
+    static uint64_t toNanos(uint64_t ticks)
+    {
+        return static_cast<uint64_t>(static_cast<double>(ticks) * nanosPerTick);
+    }
+
+    // Measure the TSC against steady_clock (about 10 ms, first call only)
+    static void calibrate();
+
+    static bool usesTsc() { return useTsc; }
+
+private:
+    static inline bool useTsc = false;
+    static inline double nanosPerTick = 1.0;
+};
@@ -0,0 +1,788 @@
+#include "uring_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#endif
+
+// Multishot recv is the newest feature used; older headers build the stub
+#if defined(__linux__) && defined(IORING_RECV_MULTISHOT)
+#define BRIDGE_HAVE_URING 1
+#endif
+
+#ifdef BRIDGE_HAVE_URING
+
+namespace {
+
+constexpr unsigned kSqEntries = 16;
+constexpr unsigned kCqEntries = 256;
+constexpr unsigned kRecvBufCount = 8;
+constexpr unsigned kRecvBufSize = 16 * 1024;
+constexpr uint64_t kStageSize = 128 * 1024;
+constexpr uint16_t kBufGroup = 0;
+
+enum : uint64_t
+{
+    TagRecv = 1,
+    TagWrite = 2,
+    TagAccept = 3,
+    TagCancel = 4,
+    TagProvide = 5,
+};
+
+int sysSetup(unsigned entries, io_uring_params* p)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+int sysRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+bool kernelAtLeast(int major, int minor)
+{
+    utsname name{};
+    if (uname(&name) != 0)
+    {
+        return false;
+    }
+    int kmajor = 0;
+    int kminor = 0;
+    if (std::sscanf(name.release, "%d.%d", &kmajor, &kminor) != 2)
+    {
+        return false;
+    }
+    return kmajor > major || (kmajor == major && kminor >= minor);
+}
+
+} // namespace
+
+struct UringRing
+{
+    int fd = -1;
+    int evfd = -1;
+    SOCKET_T sock = INVALID_SOCKET_T;
+    bool listener = false;
+
+    void* sqMap = nullptr;
+    size_t sqMapSize = 0;
+    void* cqMap = nullptr;
+    size_t cqMapSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqFlags = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqCount = 0;
+    unsigned sqLocalTail = 0;
+    unsigned toSubmit = 0;
+    bool inBatch = false;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    // Multishot recv into provided buffers
+    uint8_t* recvBufs = nullptr;
+    bool recvArmed = false;
+    struct RecvEvent
+    {
+        int res;
+        uint16_t bid;
+    };
+    std::deque<RecvEvent> recvEvents;
+    int curBid = -1;
+    uint32_t curOff = 0;
+    uint32_t curLen = 0;
+    bool recvDone = false; // EOF or error reached the reader
+    uint64_t recvBytes = 0; // completed by the kernel, read or not
+
+    // Registered staging buffer for writes, used as a byte ring
+    uint8_t* stage = nullptr;
+    uint64_t stageHead = 0;
+    uint64_t stageTail = 0;
+    bool writeInflight = false;
+    bool writeFailed = false;
+
+    // Multishot accept
+    bool acceptArmed = false;
+    std::deque<SOCKET_T> accepted;
+
+    ~UringRing() { release(); }
+
+    bool setup();
+    void release();
+    io_uring_sqe* getSqe();
+    void submitSoon();
+    int submit(unsigned minComplete, int waitMs);
+    void reap();
+    void onCompletion(const io_uring_cqe& cqe);
+    void armRecv();
+    void provide(uint16_t bid, unsigned count);
+    void queueWrite();
+    void armAccept();
+};
+
+namespace {
+
+thread_local int tBatchDepth = 0;
+thread_local std::vector<UringRing*> tBatchRings;
+
+bool opSupported(const io_uring_probe* probe, unsigned op)
+{
+    return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+}
+
+} // namespace
+
+bool UringRing::setup()
+{
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = kCqEntries;
+    fd = sysSetup(kSqEntries, &params);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // NODROP keeps completions if the CQ overflows, EXT_ARG gives enter() a timeout
+    if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_EXT_ARG) ||
+        !(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        return false;
+    }
+
+    sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqMapSize = std::max(sqMapSize, cqMapSize);
+    sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqMap == MAP_FAILED)
+    {
+        sqMap = nullptr;
+        return false;
+    }
+    cqMap = sqMap;
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqeMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqeMap == MAP_FAILED)
+    {
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+    auto* sq = static_cast<uint8_t*>(sqMap);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqFlags = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqCount = params.sq_entries;
+    sqLocalTail = *sqTail;
+    auto* cq = static_cast<uint8_t*>(cqMap);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Every opcode used below must be known to this kernel
+    std::vector<uint8_t> probeMem(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(probeMem.data());
+    if (sysRegister(fd, IORING_REGISTER_PROBE, probe, 256) < 0 ||
+        !opSupported(probe, IORING_OP_RECV) || !opSupported(probe, IORING_OP_WRITE_FIXED) ||
+        !opSupported(probe, IORING_OP_PROVIDE_BUFFERS) ||
+        !opSupported(probe, IORING_OP_ACCEPT) || !opSupported(probe, IORING_OP_ASYNC_CANCEL))
+    {
+        return false;
+    }
+
+    evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (evfd < 0 || sysRegister(fd, IORING_REGISTER_EVENTFD, &evfd, 1) < 0)
+    {
+        return false;
+    }
+
+    if (listener)
+    {
+        armAccept();
+        return submit(0, 0) >= 0;
+    }
+
+    // Buffers for the multishot recv. Handed over with PROVIDE_BUFFERS rather than a
+    // registered buffer ring, which some 6.x builds answer with ENOBUFS on every recv.
+    recvBufs = static_cast<uint8_t*>(mmap(nullptr, kRecvBufCount * kRecvBufSize, PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (recvBufs == MAP_FAILED)
+    {
+        recvBufs = nullptr;
+        return false;
+    }
+    provide(0, kRecvBufCount);
+
+    // Registered staging buffer for WRITE_FIXED
+    stage = static_cast<uint8_t*>(mmap(nullptr, kStageSize, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (stage == MAP_FAILED)
+    {
+        stage = nullptr;
+        return false;
+    }
+    iovec iov{stage, kStageSize};
+    if (sysRegister(fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+    {
+        return false;
+    }
+
+    armRecv();
+    return submit(0, 0) >= 0;
+}
+
+void UringRing::release()
+{
+    auto it = std::find(tBatchRings.begin(), tBatchRings.end(), this);
+    if (it != tBatchRings.end())
+    {
+        tBatchRings.erase(it);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    if (evfd >= 0)
+    {
+        close(evfd);
+        evfd = -1;
+    }
+    for (SOCKET_T s : accepted)
+    {
+        close(s);
+    }
+    accepted.clear();
+    if (sqes)
+    {
+        munmap(sqes, sqesSize);
+        sqes = nullptr;
+    }
+    if (sqMap)
+    {
+        munmap(sqMap, sqMapSize);
+        sqMap = nullptr;
+        cqMap = nullptr;
+    }
+    if (recvBufs)
+    {
+        munmap(recvBufs, kRecvBufCount * kRecvBufSize);
+        recvBufs = nullptr;
+    }
+    if (stage)
+    {
+        munmap(stage, kStageSize);
+        stage = nullptr;
+    }
+}
+
+io_uring_sqe* UringRing::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (sqLocalTail - head >= sqCount)
+    {
+        submit(0, 0);
+        head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (sqLocalTail - head >= sqCount)
+        {
+            return nullptr;
+        }
+    }
+    const unsigned idx = sqLocalTail & *sqMask;
+    io_uring_sqe* sqe = &sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray[idx] = idx;
+    ++sqLocalTail;
+    ++toSubmit;
+    return sqe;
+}
+
+void UringRing::submitSoon()
+{
+    if (tBatchDepth > 0)
+    {
+        if (!inBatch)
+        {
+            inBatch = true;
+            tBatchRings.push_back(this);
+        }
+        return;
+    }
+    submit(0, 0);
+}
+
+int UringRing::submit(unsigned minComplete, int waitMs)
+{
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+    unsigned flags = 0;
+    io_uring_getevents_arg arg{};
+    __kernel_timespec ts{};
+    void* argp = nullptr;
+    size_t argSize = 0;
+    if (minComplete > 0 || (__atomic_load_n(sqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW))
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    if (minComplete > 0 && waitMs >= 0)
+    {
+        ts.tv_sec = waitMs / 1000;
+        ts.tv_nsec = static_cast<long long>(waitMs % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argSize = sizeof(arg);
+    }
+    if (toSubmit == 0 && flags == 0)
+    {
+        return 0;
+    }
+    int ret = sysEnter(fd, toSubmit, minComplete, flags, argp, argSize);
+    if (ret >= 0)
+    {
+        toSubmit -= std::min<unsigned>(toSubmit, static_cast<unsigned>(ret));
+    }
+    else if (errno == ETIME || errno == EINTR)
+    {
+        ret = 0;
+    }
+    return ret;
+}
+
+void UringRing::reap()
+{
+    if (__atomic_load_n(sqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+    {
+        // Pull completions the kernel parked while the CQ was full
+        submit(0, 0);
+    }
+    unsigned head = *cqHead;
+    const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        const io_uring_cqe cqe = cqes[head & *cqMask];
+        ++head;
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        onCompletion(cqe);
+    }
+}
+
+void UringRing::onCompletion(const io_uring_cqe& cqe)
+{
+    const bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    switch (cqe.user_data)
+    {
+    case TagRecv:
+        recvArmed = more;
+        if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER))
+        {
+            recvEvents.push_back({cqe.res, static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT)});
+            recvBytes += static_cast<uint64_t>(cqe.res);
+        }
+        else if (cqe.res != -ENOBUFS)
+        {
+            // EOF (0) or a socket error; ENOBUFS only means the reader fell behind
+            recvEvents.push_back({cqe.res <= 0 ? cqe.res : -EIO, 0});
+        }
+        break;
+    case TagWrite:
+        writeInflight = false;
+        if (cqe.res > 0)
+        {
+            stageHead += static_cast<uint64_t>(cqe.res);
+        }
+        else if (cqe.res != -EAGAIN && cqe.res != -EINTR)
+        {
+            writeFailed = true;
+        }
+        queueWrite();
+        break;
+    case TagAccept:
+        acceptArmed = more;
+        if (cqe.res >= 0)
+        {
+            accepted.push_back(cqe.res);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void UringRing::armRecv()
+{
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe)
+    {
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sock;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufGroup;
+    sqe->user_data = TagRecv;
+    recvArmed = true;
+    submitSoon();
+}
+
+void UringRing::provide(uint16_t bid, unsigned count)
+{
+    // Queued ahead of any re-arm, so the kernel sees the buffers first
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe)
+    {
+        return;
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(recvBufs + static_cast<size_t>(bid) * kRecvBufSize);
+    sqe->len = kRecvBufSize;
+    sqe->off = bid;
+    sqe->buf_group = kBufGroup;
+    sqe->user_data = TagProvide;
+    submitSoon();
+}
+
+void UringRing::queueWrite()
+{
+    if (writeInflight || writeFailed || stageHead == stageTail)
+    {
+        return;
+    }
+    const uint64_t pos = stageHead % kStageSize;
+    const uint64_t len = std::min(stageTail - stageHead, kStageSize - pos);
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe)
+    {
+        return;
+    }
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = sock;
+    sqe->addr = reinterpret_cast<uint64_t>(stage + pos);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->buf_index = 0;
+    sqe->user_data = TagWrite;
+    writeInflight = true;
+    submitSoon();
+}
+
+void UringRing::armAccept()
+{
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe)
+    {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = sock;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = TagAccept;
+    acceptArmed = true;
+    submitSoon();
+}
+
+UringIO::UringIO() = default;
+
+UringIO::~UringIO()
+{
+    shutdown();
+}
+
+bool UringIO::init(SOCKET_T sock, bool listener)
+{
+    shutdown();
+    // Multishot recv arrived in 6.0
+    if (!kernelAtLeast(6, 0))
+    {
+        return false;
+    }
+    ring = std::make_unique<UringRing>();
+    ring->sock = sock;
+    ring->listener = listener;
+    if (!ring->setup())
+    {
+        ring.reset();
+        return false;
+    }
+    return true;
+}
+
+void UringIO::shutdown()
+{
+    if (!ring)
+    {
+        return;
+    }
+    // Retire armed requests before the buffers they write into are unmapped
+    if (io_uring_sqe* sqe = ring->getSqe())
+    {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+        sqe->user_data = TagCancel;
+        ring->submit(0, 0);
+    }
+    for (int i = 0; i < 10 && (ring->recvArmed || ring->acceptArmed || ring->writeInflight); ++i)
+    {
+        ring->submit(1, 10);
+        ring->reap();
+    }
+    ring.reset();
+}
+
+int UringIO::eventFd() const
+{
+    return ring ? ring->evfd : -1;
+}
+
+void UringIO::clearEvent()
+{
+    eventfd_t count = 0;
+    eventfd_read(ring->evfd, &count); // EAGAIN when nothing was posted since the last reset
+}
+
+uint64_t UringIO::bytesReceived()
+{
+    ring->reap();
+    return ring->recvBytes;
+}
+
+bool UringIO::linkLost()
+{
+    UringRing& r = *ring;
+    r.reap();
+    // An EOF or error is always the last receive event
+    return r.recvDone || r.writeFailed || (!r.recvEvents.empty() && r.recvEvents.back().res <= 0);
+}
+
+int UringIO::recv(uint8_t* data, int size, int waitMs)
+{
+    UringRing& r = *ring;
+    int copied = 0;
+    bool waited = false;
+    while (copied < size)
+    {
+        if (r.curBid >= 0)
+        {
+            const uint32_t n = std::min<uint32_t>(r.curLen - r.curOff, static_cast<uint32_t>(size - copied));
+            std::memcpy(data + copied, r.recvBufs + static_cast<size_t>(r.curBid) * kRecvBufSize + r.curOff, n);
+            copied += static_cast<int>(n);
+            r.curOff += n;
+            if (r.curOff == r.curLen)
+            {
+                r.provide(static_cast<uint16_t>(r.curBid), 1);
+                r.curBid = -1;
+            }
+            continue;
+        }
+
+        r.reap();
+        if (!r.recvEvents.empty())
+        {
+            const UringRing::RecvEvent ev = r.recvEvents.front();
+            if (ev.res <= 0)
+            {
+                // Hand out the bytes in front of the EOF/error first
+                if (copied > 0)
+                {
+                    break;
+                }
+                r.recvDone = true;
+                return -1;
+            }
+            r.recvEvents.pop_front();
+            r.curBid = ev.bid;
+            r.curOff = 0;
+            r.curLen = static_cast<uint32_t>(ev.res);
+            continue;
+        }
+
+        // Nothing buffered: re-arm if the kernel ran out of buffers, then maybe wait once
+        if (r.recvDone)
+        {
+            return copied > 0 ? copied : -1;
+        }
+        if (!r.recvArmed)
+        {
+            r.armRecv();
+        }
+        if (copied > 0 || waitMs == 0 || waited)
+        {
+            break;
+        }
+        r.submit(1, waitMs);
+        waited = true;
+    }
+    return copied;
+}
+
+int UringIO::send(const uint8_t* data, int size)
+{
+    UringRing& r = *ring;
+    r.reap();
+    if (r.writeFailed)
+    {
+        return -1;
+    }
+    const uint64_t space = kStageSize - (r.stageTail - r.stageHead);
+    const uint64_t n = std::min<uint64_t>(space, static_cast<uint64_t>(size));
+    const uint64_t pos = r.stageTail % kStageSize;
+    const uint64_t first = std::min(n, kStageSize - pos);
+    std::memcpy(r.stage + pos, data, first);
+    std::memcpy(r.stage, data + first, n - first);
+    r.stageTail += n;
+    r.queueWrite();
+    return static_cast<int>(n);
+}
+
+bool UringIO::waitSent(int waitMs)
+{
+    UringRing& r = *ring;
+    r.reap();
+    while (r.stageHead != r.stageTail && !r.writeFailed)
+    {
+        const uint64_t before = r.stageHead;
+        r.submit(1, waitMs);
+        r.reap();
+        if (r.stageHead == before && !r.writeFailed && waitMs >= 0)
+        {
+            return false;
+        }
+    }
+    return !r.writeFailed;
+}
+
+SOCKET_T UringIO::accept()
+{
+    UringRing& r = *ring;
+    r.reap();
+    if (r.accepted.empty())
+    {
+        if (!r.acceptArmed)
+        {
+            r.armAccept();
+        }
+        return INVALID_SOCKET_T;
+    }
+    SOCKET_T s = r.accepted.front();
+    r.accepted.pop_front();
+    return s;
+}
+
+void UringIO::beginBatch()
+{
+    ++tBatchDepth;
+}
+
+void UringIO::endBatch()
+{
+    if (--tBatchDepth > 0)
+    {
+        return;
+    }
+    std::vector<UringRing*> rings;
+    rings.swap(tBatchRings);
+    for (UringRing* r : rings)
+    {
+        r->inBatch = false;
+        r->submit(0, 0);
+    }
+}
+
+#else // !BRIDGE_HAVE_URING
+
+struct UringRing
+{
+};
+
+UringIO::UringIO() = default;
+UringIO::~UringIO() = default;
+
+bool UringIO::init(SOCKET_T, bool)
+{
+    return false;
+}
+
+void UringIO::shutdown()
+{
+}
+
+int UringIO::eventFd() const
+{
+    return -1;
+}
+
+void UringIO::clearEvent()
+{
+}
+
+uint64_t UringIO::bytesReceived()
+{
+    return 0;
+}
+
+bool UringIO::linkLost()
+{
+    return true;
+}
+
+int UringIO::recv(uint8_t*, int, int)
+{
+    return -1;
+}
+
+int UringIO::send(const uint8_t*, int)
+{
+    return -1;
+}
+
+bool UringIO::waitSent(int)
+{
+    return false;
+}
+
+SOCKET_T UringIO::accept()
+{
+    return INVALID_SOCKET_T;
+}
+
+void UringIO::beginBatch()
+{
+}
+
+void UringIO::endBatch()
+{
+}
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "net_io.h"
+
+#include <cstdint>
+#include <memory>
+
+struct UringRing;
+
+// Minimal io_uring driver for a single socket, without a liburing dependency:
+//  - data sockets: one multishot recv filling provided buffers, and writes issued
+//    from a registered staging buffer (at most one in flight, so small writes coalesce)
+//  - listen sockets: one multishot accept
+// Requires Linux 6.0+; init() fails otherwise and NetTcpIO keeps the plain socket path.
+// Completions are reaped from the shared CQ ring, so no syscall is needed when data has
+// already arrived; eventFd() becomes readable whenever a completion is posted.
+//
+// Every socket has a ring of its own, so this backend does not cut syscalls below the epoll
+// path: a dispatch round still costs one io_uring_enter per ring with queued work, plus the
+// eventfd read. What it saves is the copy into a caller buffer per recv and a socket wakeup
+// per buffer, through multishot recv into provided buffers and registered write staging.
+class UringIO
+{
+public:
+    UringIO();
+    ~UringIO();
+    UringIO(const UringIO&) = delete;
+    UringIO& operator=(const UringIO&) = delete;
+
+    // Probe the kernel and arm the rings for sock; false means "use the plain path"
+    bool init(SOCKET_T sock, bool listener);
+
+    // Cancel outstanding work and release the rings (the socket itself stays open)
+    void shutdown();
+
+    int eventFd() const;
+
+    // Reset eventFd()'s counter; call it when the fd polls readable, before reaping completions,
+    // so a completion posted meanwhile raises a fresh edge
+    void clearEvent();
+
+    // Copy buffered received bytes out. waitMs: 0 = never block, <0 = wait forever.
+    // Returns bytes copied, 0 when nothing arrived (in time), -1 on EOF or socket error.
+    int recv(uint8_t* data, int size, int waitMs);
+
+    // Stage bytes for sending. Returns bytes accepted (0 while the staging buffer is full),
+    // -1 after a socket error.
+    int send(const uint8_t* data, int size);
+
+    // Wait until every staged byte reached the socket; false on error or timeout
+    bool waitSent(int waitMs);
+
+    // The receive stream ended or a send failed, even if received bytes are still unread
+    bool linkLost();
+
+    // Bytes the multishot recv has completed so far, whether or not recv() handed them out yet
+    uint64_t bytesReceived();
+
+    // Take a connection produced by the multishot accept, INVALID_SOCKET_T when none is ready
+    SOCKET_T accept();
+
+    // While a thread is inside a batch (the event loop opens one around each dispatch round),
+    // queued work is only recorded; endBatch() submits it with one io_uring_enter per ring.
+    static void beginBatch();
+    static void endBatch();
+
+private:
+    std::unique_ptr<UringRing> ring;
+};